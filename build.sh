@@ -0,0 +1,88 @@
+#!/bin/sh
+# -------------------------------------------------------------------------------
+# Build script for Linux-based target platforms (headless).
+# -------------------------------------------------------------------------------
+
+PrintUsage() {
+	echo "BUILD script for Linux target platform."
+	echo "build.sh <shared-name> <internal:on|off> <slowcode:on|off>"
+	echo
+	echo "shared-name      - game shared name, without spaces and special symbols."
+	echo
+	echo "internal:"
+	echo "* on             - Internal build."
+	echo "* off            - Public-release build (shipping)."
+	echo
+	echo "slowcode:"
+	echo "* on             - Enable slow code for debugging purpose."
+	echo "* off            - Cut slow code for faster execution."
+	echo
+}
+
+# If no parameters are provided, print usage information.
+if [ -z "$1" ]; then
+	PrintUsage
+	exit 1
+fi
+
+# -----------------------------------
+# General options for compilation
+# and linking.
+# -----------------------------------
+# General project name, must not contain spaces and deprecated symbols, no extension.
+# The target game platform-specific executable will be named as run$OutputName,
+# the game engine will be named as $OutputName.so.
+OutputName=$1
+
+# -fno-rtti                          - disable RTTI.
+# -fno-exceptions                    - disable exceptions.
+# -Wall -Werror                      - enable most warnings and treat them as errors.
+# -Wno-unused-*                      - the code base relies on unused values from Verify() and friends.
+# -Wno-format                        - the code base prints uptr and u64 with %d and %llu.
+# -DLINUX=1                          - signals we are compiling for Linux platform.
+CommonCompilerFlags="-std=c++11 -msse2 -fno-rtti -fno-exceptions -Wall -Werror -Wno-unused-value -Wno-unused-variable -Wno-unused-function -Wno-unused-but-set-variable -Wno-format -Wno-unknown-pragmas -Wno-missing-braces -DLINUX=1"
+
+# -DINTERNAL=1                       - [debug] signals we are compiling an internal build, not for public-release.
+# -DINTERNAL=0                       - signals we are compiling a public-release build.
+# -g -O0                             - [debug] include debug info and disable optimization.
+# -O2                                - optimize for speed.
+case "$2" in
+	internal:on)  InternalBuildCompilerFlags="-DINTERNAL=1 -g -O0" ;;
+	internal:off) InternalBuildCompilerFlags="-DINTERNAL=0 -O2" ;;
+	*) echo "ERROR: Invalid parameter detected."; PrintUsage; exit 1 ;;
+esac
+
+# -DSLOWCODE=1                       - [debug] signals we are compiling a paranoid build with slow code enabled.
+# -DSLOWCODE=0                       - signals we are compiling a program without any slow code at all.
+case "$3" in
+	slowcode:on)  SlowCodeBuildCompilerFlags="-DSLOWCODE=1" ;;
+	slowcode:off) SlowCodeBuildCompilerFlags="-DSLOWCODE=0" ;;
+	*) echo "ERROR: Invalid parameter detected."; PrintUsage; exit 1 ;;
+esac
+
+Compiler=${CXX:-g++}
+SourceDir=$(cd "$(dirname "$0")" && pwd)
+
+# -----------------------------------
+# Make build directory.
+# -----------------------------------
+mkdir -p "$SourceDir/build"
+cd "$SourceDir/build" || exit 1
+
+# -----------------------------------
+# Build main executable.
+# -----------------------------------
+# Used external libraries:
+# '-ldl'                             - for dlopen()/dlsym().
+# '-lpthread'                        - for POSIX threads.
+$Compiler -o run$OutputName $CommonCompilerFlags $InternalBuildCompilerFlags $SlowCodeBuildCompilerFlags "$SourceDir/game_platform_linux.cpp" -ldl -lpthread || { echo "ERROR: Build failed."; exit 1; }
+
+# -----------------------------------
+# Build game core.
+# -----------------------------------
+$Compiler -o $OutputName.so -fPIC -shared $CommonCompilerFlags $InternalBuildCompilerFlags $SlowCodeBuildCompilerFlags "$SourceDir/game.cpp" -lpthread || { echo "ERROR: Build failed."; exit 1; }
+
+# -----------------------------------
+# Build memory trace replay tool.
+# -----------------------------------
+$Compiler -o memreplay $CommonCompilerFlags $InternalBuildCompilerFlags $SlowCodeBuildCompilerFlags "$SourceDir/game_memreplay.cpp" || { echo "ERROR: Build failed."; exit 1; }
@@ -11,9 +11,9 @@ RegisterCommand(const char *Name, command_callback *Callback) {
 
 	command_cache *Cache = &GameState.CommandCache;
 
-	EnterTicketMutex(&Cache->Mutex);
+	EnterRWMutexWrite(&Cache->Mutex);
 
-	command *NewCommand = (command *)AllocFromPool(&GameState.CommandsPool);
+	command *NewCommand = (command *)AllocFromPool(&GameState.CommandsPool, MemoryFlag_Zero);
 	if (NewCommand) {
 		strncpy(NewCommand->Name, Name, ArraySize(NewCommand->Name) - 1);
 		NewCommand->Callback = Callback;
@@ -28,9 +28,10 @@ RegisterCommand(const char *Name, command_callback *Callback) {
 		GameState.PlatformAPI->Outf("RegisterCommand[%s]: Out of memory!", Name);
 	}
 
-	LeaveTicketMutex(&Cache->Mutex);
+	LeaveRWMutexWrite(&Cache->Mutex);
 }
 
+// NOTE(ivan): The caller must hold the commands cache mutex, for reading at least.
 inline command *
 FindCommand(const char *Name) {
 	Assert(Name);
@@ -52,7 +53,7 @@ UnregisterCommand(const char *Name) {
 
 	command_cache *Cache = &GameState.CommandCache;
 
-	EnterTicketMutex(&Cache->Mutex);
+	EnterRWMutexWrite(&Cache->Mutex);
 
 	command *Command = FindCommand(Name);
 	if (Command) {
@@ -60,13 +61,14 @@ UnregisterCommand(const char *Name) {
 			Command->NextCommand->PrevCommand = Command->PrevCommand;
 		if (Command->PrevCommand)
 			Command->PrevCommand->NextCommand = Command->NextCommand;
-		if (--Cache->NumCommands == 0)
-			Cache->TopCommand = 0;
+		if (Cache->TopCommand == Command)
+			Cache->TopCommand = Command->NextCommand;
+		Cache->NumCommands--;
 
 		FreeFromPool(&GameState.CommandsPool, Command);
 	}
 
-	LeaveTicketMutex(&Cache->Mutex);
+	LeaveRWMutexWrite(&Cache->Mutex);
 }
 
 void
@@ -77,13 +79,19 @@ ExecCommand(const char *Command, ...) {
 	CollectArgsN(FullCommand, ArraySize(FullCommand) - 1, Command);
 
 	u32 NumTokens;
-	char **Tokens = TokenizeString(&GameState.PerFrameHeap, Command, &NumTokens, " \t");
+	char **Tokens = TokenizeString(&GameState.GeneralHeap, FullCommand, &NumTokens, " \t");
 	if (Tokens) {
+		// NOTE(ivan): Callback is called outside of the lock, it might register or unregister commands.
+		command_cache *Cache = &GameState.CommandCache;
+		EnterRWMutexRead(&Cache->Mutex);
 		command *Info = FindCommand(Tokens[0]);
-		if (Info)
-			Info->Callback(Tokens, NumTokens);
+		command_callback *Callback = Info ? Info->Callback : 0;
+		LeaveRWMutexRead(&Cache->Mutex);
+
+		if (Callback)
+			Callback(Tokens, NumTokens);
 		
-		FreeTokenizedString(&GameState.PerFrameHeap, Tokens, NumTokens);
+		FreeTokenizedString(&GameState.GeneralHeap, Tokens, NumTokens);
 	}
 }
 
@@ -94,18 +102,21 @@ PushSetting(const char *Name, const char *Value) {
 
 	setting_cache *Cache = &GameState.SettingCache;
 
+	EnterRWMutexWrite(&Cache->Mutex);
+
 	// NOTE(ivan): If already exists - change its value.
 	for (setting *Setting = Cache->TopSetting; Setting; Setting = Setting->PrevSetting) {
 		if (strcmp(Setting->Name, Name) == 0) {
 			memset(Setting->Value, 0, sizeof(Setting->Value));
 			strncpy(Setting->Value, Value, ArraySize(Setting->Value) - 1);
 
+			LeaveRWMutexWrite(&Cache->Mutex);
 			return;
 		}
 	}
 
 	// NOTE(ivan): Insert new setting.
-	setting *NewSetting = (setting *)AllocFromPool(&GameState.SettingsPool);
+	setting *NewSetting = (setting *)AllocFromPool(&GameState.SettingsPool, MemoryFlag_Zero);
 	if (NewSetting) {
 		strncpy(NewSetting->Name, Name, ArraySize(NewSetting->Name) - 1);
 		strncpy(NewSetting->Value, Value, ArraySize(NewSetting->Value) - 1);
@@ -119,6 +130,8 @@ PushSetting(const char *Name, const char *Value) {
 	} else {
 		GameState.PlatformAPI->Outf("PushSetting[%s]: Out of memory!", Name);
 	}
+
+	LeaveRWMutexWrite(&Cache->Mutex);
 }
 
 b32
@@ -128,27 +141,38 @@ LoadSettingsFromFile(const char *FileName) {
 	GameState.PlatformAPI->Outf("Loading settings from file '%s'...", FileName);
 
 	b32 Result = false;
-	
-	file_handle FileHandle = GameState.PlatformAPI->FOpen(FileName, FileAccessType_OpenForReading);
-	if (FileHandle != NOTFOUND) {
-		char LineBuffer[1024] = {};
-		while (GetLineFromFile(FileHandle, LineBuffer, ArraySize(LineBuffer) - 1)) {
+
+	// NOTE(ivan): The whole file is read and parsed in scratch memory, each line's tokens in a nested scope,
+	// everything is released at once when the file is done.
+	memory_stack *Scratch = &GameState.ScratchStack;
+	temporary_memory FileMemory = BeginTemporaryMemory(Scratch);
+
+	piece File = ReadEntireFile(Scratch, FileName);
+	if (File.Base) {
+		char *Line = (char *)File.Base;
+		while (*Line) {
+			char *LineEnd = strchr(Line, '\n');
+			char *NextLine = LineEnd ? (LineEnd + 1) : (Line + strlen(Line));
+			if (LineEnd)
+				*LineEnd = 0;
+
+			temporary_memory LineMemory = BeginTemporaryMemory(Scratch);
 			u32 NumTokens;
-			char **Tokens = TokenizeString(&GameState.PerFrameHeap, LineBuffer, &NumTokens, " \t");
-			if (Tokens) {
-				if (NumTokens >= 2)
-					PushSetting(Tokens[0], Tokens[1]);
+			char **Tokens = TokenizeStringOnStack(Scratch, Line, &NumTokens, " \t\r");
+			if (Tokens && NumTokens >= 2)
+				PushSetting(Tokens[0], Tokens[1]);
+			EndTemporaryMemory(LineMemory);
 
-				FreeTokenizedString(&GameState.PerFrameHeap, Tokens, NumTokens);
-			}
+			Line = NextLine;
 		}
 
 		Result = true;
-		GameState.PlatformAPI->FClose(FileHandle);
 		GameState.PlatformAPI->Outf("...success");
 	} else {
-		GameState.PlatformAPI->Outf("...fail, file not found!");
+		GameState.PlatformAPI->Outf("...fail, file cannot be read!");
 	}
+
+	EndTemporaryMemory(FileMemory);
 	
 	return Result;
 }
@@ -162,7 +186,7 @@ SaveSettingsToFile(const char *FileName) {
 	setting_cache *Cache = &GameState.SettingCache;
 	b32 Result = false;
 
-	EnterTicketMutex(&Cache->Mutex);
+	EnterRWMutexRead(&Cache->Mutex);
 
 	file_handle FileHandle = GameState.PlatformAPI->FOpen(FileName, FileAccessType_OpenForWriting);
 	if (FileHandle != NOTFOUND) {
@@ -170,7 +194,7 @@ SaveSettingsToFile(const char *FileName) {
 		
 		for (setting *Setting = Cache->TopSetting; Setting; Setting = Setting->PrevSetting) {
 			char String[1024] = {};
-			u32 StringLength = snprintf(String, ArraySize(String) - 1, "%s %s", Setting->Name, Setting->Value);
+			u32 StringLength = snprintf(String, ArraySize(String) - 1, "%s %s\n", Setting->Name, Setting->Value);
 
 			GameState.PlatformAPI->FWrite(FileHandle, String, StringLength);
 		}
@@ -181,30 +205,34 @@ SaveSettingsToFile(const char *FileName) {
 		GameState.PlatformAPI->Outf("...fail, access denied!");
 	}
 
-	LeaveTicketMutex(&Cache->Mutex);
+	LeaveRWMutexRead(&Cache->Mutex);
 	
 	return Result;
 }
 
-const char *
-GetSetting(const char *Name) {
+b32
+GetSetting(const char *Name, char *Value, u32 ValueSize) {
 	Assert(Name);
+	Assert(Value);
+	Assert(ValueSize);
 
 	setting_cache *Cache = &GameState.SettingCache;
-	const char *Result = 0;
+	b32 Result = false;
 
-	EnterTicketMutex(&Cache->Mutex);
+	EnterRWMutexRead(&Cache->Mutex);
 
 	for (setting *Setting = Cache->TopSetting; Setting; Setting = Setting->PrevSetting) {
 		if (strcmp(Setting->Name, Name) == 0) {
-			Result = Setting->Value;
+			strncpy(Value, Setting->Value, ValueSize - 1);
+			Value[ValueSize - 1] = 0;
+			Result = true;
 			break;
 		}
 	}
 
-	LeaveTicketMutex(&Cache->Mutex);
+	LeaveRWMutexRead(&Cache->Mutex);
 	
-	return 0;
+	return Result;
 }
 
 inline void
@@ -264,8 +292,9 @@ OutCPUStats(void) {
 								GameState.PlatformAPI->CPUInfo.NumL1,
 								GameState.PlatformAPI->CPUInfo.NumL2,
 								GameState.PlatformAPI->CPUInfo.NumL3);
-	GameState.PlatformAPI->Outf("CPU NUMA-nodes: %d.",
-								GameState.PlatformAPI->CPUInfo.NumNUMA);
+	GameState.PlatformAPI->Outf("CPU NUMA-nodes: %d%s.",
+								GameState.PlatformAPI->CPUInfo.NumNUMA,
+								GameState.PlatformAPI->CPUInfo.IsNUMASimulated ? " (simulated)" : "");
 	
 	GameState.PlatformAPI->Outf("--------------------------------------------------------------------------");
 }
@@ -277,30 +306,101 @@ OutMemoryStackStats(memory_stack *Stack) {
 	EnterTicketMutex(&Stack->Mutex);
 	
 	const f64 Mb = (f64)(1024 * 1024);
-	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, used %.3f Mb, free %.3f Mb.",
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, used %.3f Mb, free %.3f Mb.",
 								Stack->Name,
 								(f32)(Stack->Piece.Size / Mb),
+								(f32)(Stack->CommittedSize / Mb),
 								(f32)(Stack->Mark / Mb),
 								(f32)((Stack->Piece.Size - Stack->Mark) / Mb));
 
 	LeaveTicketMutex(&Stack->Mutex);
 }
 
+inline void
+OutMemoryDoubleStackStats(memory_double_stack *Stack) {
+	Assert(Stack);
+
+	EnterTicketMutex(&Stack->Mutex);
+
+	uptr UsedSize = Stack->Marks[MemoryStackEnd_Low] + Stack->Marks[MemoryStackEnd_High];
+	const f64 Mb = (f64)(1024 * 1024);
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, used %.3f Mb low + %.3f Mb high, free %.3f Mb.",
+								Stack->Name,
+								(f32)(Stack->Piece.Size / Mb),
+								(f32)((Stack->CommittedSizes[MemoryStackEnd_Low] + Stack->CommittedSizes[MemoryStackEnd_High]) / Mb),
+								(f32)(Stack->Marks[MemoryStackEnd_Low] / Mb),
+								(f32)(Stack->Marks[MemoryStackEnd_High] / Mb),
+								(f32)((Stack->Piece.Size - UsedSize) / Mb));
+
+	LeaveTicketMutex(&Stack->Mutex);
+}
+
+inline void
+OutMemoryFrameArenaStats(memory_frame_arena *Arena) {
+	Assert(Arena);
+
+	uptr CommittedSize = 0;
+	for (u32 Index = 0; Index < Arena->NumBuffers; Index++)
+		CommittedSize += Arena->CommittedSizes[Index];
+
+	const f64 Mb = (f64)(1024 * 1024);
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, %d buffers, current %d, used %.3f Mb of %.3f Mb.",
+								Arena->Name,
+								(f32)(Arena->Piece.Size / Mb),
+								(f32)(CommittedSize / Mb),
+								Arena->NumBuffers,
+								Arena->CurrentBuffer,
+								(f32)(Arena->Mark / Mb),
+								(f32)(Arena->BufferSize / Mb));
+}
+
 inline void
 OutMemoryPoolStats(memory_pool *Pool) {
 	Assert(Pool);
 
-	EnterTicketMutex(&Pool->Mutex);
-	
+	// NOTE(ivan): Blocks cached in magazines are counted as allocated by the shared stack, but they are free.
+	u32 NumCachedBlocks = 0;
+	if (Pool->MagazineSize) {
+		for (u32 ThreadIndex = 0; ThreadIndex < MAX_MEMORY_POOL_THREADS; ThreadIndex++)
+			NumCachedBlocks += GetPoolMagazine(Pool, ThreadIndex)->NumBlocks;
+	}
+	u32 NumAllocBlocks = Pool->NumAllocBlocks - NumCachedBlocks;
+
+	u32 MaxBlocks = Pool->MaxBlocks + Pool->NumChunks * Pool->BlocksPerChunk;
+
 	const f64 Mb = (f64)(1024 * 1024);
-	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, blocksize %d bytes, alloc %d blocks, free %d blocks.",
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, blocksize %d bytes, alloc %d blocks, free %d blocks%s.",
 								Pool->Name,
-								(f32)(((Pool->BlockSize + sizeof(memory_pool_block)) * Pool->MaxBlocks) / Mb),
+								(f32)((Pool->Piece.Size + Pool->MagazineStride * MAX_MEMORY_POOL_THREADS + Pool->BitmapSize) / Mb),
+								(f32)(Pool->CommittedSize / Mb),
 								Pool->BlockSize,
-								Pool->NumAllocBlocks,
-								Pool->NumFreeBlocks);
+								NumAllocBlocks,
+								MaxBlocks - NumAllocBlocks,
+								Pool->Bitmap ? ", bitmap" : "");
+
+	if (Pool->PoolFlags & MemoryPoolFlag_Growable) {
+		GameState.PlatformAPI->Outf("    %d of %d chunks linked, %d blocks per chunk, parent [%s].",
+									Pool->NumChunks,
+									MAX_MEMORY_POOL_CHUNKS,
+									Pool->BlocksPerChunk,
+									Pool->ParentHeap->Name);
+	}
 
-	LeaveTicketMutex(&Pool->Mutex);
+	if (Pool->MagazineSize) {
+		for (u32 ThreadIndex = 0; ThreadIndex < MAX_MEMORY_POOL_THREADS; ThreadIndex++) {
+			memory_pool_magazine *Magazine = GetPoolMagazine(Pool, ThreadIndex);
+
+			u64 NumRequests = Magazine->NumHits + Magazine->NumMisses;
+			if (NumRequests) {
+				GameState.PlatformAPI->Outf("    thread %d magazine: %d cached blocks, hit rate %.2f%% (%llu hits, %llu misses).",
+											ThreadIndex,
+											Magazine->NumBlocks,
+											(f32)((f64)Magazine->NumHits / (f64)NumRequests * 100.0),
+											Magazine->NumHits,
+											Magazine->NumMisses);
+			}
+		}
+	}
 }
 
 inline void
@@ -310,11 +410,59 @@ OutMemoryHeapStats(memory_heap *Heap) {
 	EnterTicketMutex(&Heap->Mutex);
 
 	const f64 Mb = (f64)(1024 * 1024);
-	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, used %.3f Mb, %d blocks.",
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, used %.3f Mb, %d blocks, %d free blocks.",
 								Heap->Name,
 								(f32)(Heap->Piece.Size / Mb),
+								(f32)(Heap->CommittedSize / Mb),
+								(f32)(Heap->UsedSize / Mb),
+								Heap->NumBlocks,
+								Heap->NumFreeBlocks);
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+inline void
+OutMemoryBuddyStats(memory_buddy *Buddy) {
+	Assert(Buddy);
+
+	EnterTicketMutex(&Buddy->Mutex);
+
+	// NOTE(ivan): The shallowest non-empty level holds the largest free block.
+	uptr LargestFreeSize = 0;
+	if (Buddy->LevelBitmap)
+		LargestFreeSize = Buddy->DataSize >> FindLeastSignificantBit64(Buddy->LevelBitmap).Index;
+
+	const f64 Mb = (f64)(1024 * 1024);
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, used %.3f Mb of %.3f Mb, %d blocks, largest free %.3f Mb.",
+								Buddy->Name,
+								(f32)(Buddy->Piece.Size / Mb),
+								(f32)(Buddy->CommittedSize / Mb),
+								(f32)(Buddy->UsedSize / Mb),
+								(f32)(Buddy->DataSize / Mb),
+								Buddy->NumBlocks,
+								(f32)(LargestFreeSize / Mb));
+
+	LeaveTicketMutex(&Buddy->Mutex);
+}
+
+inline void
+OutMemoryHandleHeapStats(memory_handle_heap *Heap) {
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	const f64 Mb = (f64)(1024 * 1024);
+	GameState.PlatformAPI->Outf("[%s] : eated %.3f Mb, committed %.3f Mb, used %.3f Mb, top %.3f Mb, %d blocks, %d pinned, %d of %d handles, moved %.3f Mb.",
+								Heap->Name,
+								(f32)((Heap->Piece.Size + Heap->TablePiece.Size) / Mb),
+								(f32)((Heap->CommittedSize + Heap->TableCommittedSize) / Mb),
 								(f32)(Heap->UsedSize / Mb),
-								Heap->NumBlocks);
+								(f32)(Heap->Top / Mb),
+								Heap->NumBlocks,
+								Heap->NumPinnedBlocks,
+								Heap->NumHandles,
+								Heap->MaxHandles,
+								(f32)(Heap->NumMovedBytes / Mb));
 
 	LeaveTicketMutex(&Heap->Mutex);
 }
@@ -323,23 +471,180 @@ static void
 OutMemoryTableStats(void) {
 	GameState.PlatformAPI->Outf("-------------------------------------------------------------------------------");
 	
-	OutMemoryHeapStats(&GameState.PerFrameHeap);
+	OutMemoryFrameArenaStats(&GameState.FrameArena);
+	OutMemoryHeapStats(&GameState.GeneralHeap);
 	OutMemoryStackStats(&GameState.PermanentStack);
+	OutMemoryStackStats(&GameState.ScratchStack);
+	OutMemoryDoubleStackStats(&GameState.LevelStack);
+	OutMemoryBuddyStats(&GameState.ResourceBuddy);
+	OutMemoryHandleHeapStats(&GameState.RelocatableHeap);
 	
 	OutMemoryPoolStats(&GameState.CommandsPool);
 	OutMemoryPoolStats(&GameState.SettingsPool);
+
+	for (u32 Node = 0; Node < GameState.NumNUMAPartitions; Node++) {
+		OutMemoryHeapStats(&GameState.NUMAPartitions[Node].Heap);
+		OutMemoryPoolStats(&GameState.NUMAPartitions[Node].SmallPool);
+	}
 	
 	GameState.PlatformAPI->Outf("-------------------------------------------------------------------------------");
 	const f64 Mb = (f64)(1024 * 1024);
 	EnterTicketMutex(&GameState.GameMemory->Mutex);
 	GameState.PlatformAPI->Outf("* Game primary storage total size: %.3f Mb.",
 								(f64)GameState.GameMemory->StorageTotalSize / Mb);
+	GameState.PlatformAPI->Outf("* Game primary storage committed size: %.3f Mb.",
+								(f64)GameState.GameMemory->CommittedSize / Mb);
 	GameState.PlatformAPI->Outf("* Game primary storage left space size: %.3f Mb",
 								(f64)GameState.GameMemory->FreeStorage.Size / Mb);
+	GameState.PlatformAPI->Outf("* Game primary storage page size: %.0f Kb (%s).",
+								(f64)GameState.PlatformAPI->PageSize / 1024,
+								GameState.PlatformAPI->IsLargePages ? "large pages" : "regular pages");
 	LeaveTicketMutex(&GameState.GameMemory->Mutex);
 	GameState.PlatformAPI->Outf("-------------------------------------------------------------------------------");	
 }
 
+#if MEMORY_TELEMETRY
+// NOTE(ivan): Telemetry output goes to the console, or to a file if a valid handle is given.
+static void
+OutTelemetryLine(file_handle FileHandle, const char *Format, ...) {
+	Assert(Format);
+
+	char Buffer[2048] = {};
+	CollectArgsN(Buffer, ArraySize(Buffer) - 2, Format);
+
+	if (FileHandle != NOTFOUND) {
+		u32 BufferLength = (u32)strlen(Buffer);
+		Buffer[BufferLength++] = '\n';
+		GameState.PlatformAPI->FWrite(FileHandle, Buffer, BufferLength);
+	} else {
+		GameState.PlatformAPI->Outf("%s", Buffer);
+	}
+}
+
+static void
+OutMemoryTelemetry(file_handle FileHandle, const char *Name, uptr PartitionSize, memory_telemetry *Telemetry) {
+	Assert(Name);
+	Assert(Telemetry);
+
+	const f64 Mb = (f64)(1024 * 1024);
+	OutTelemetryLine(FileHandle, "[%s] : %llu allocs, %llu frees, %llu failed, peak %.3f Mb of %.3f Mb (%.2f%%).",
+					 Name,
+					 Telemetry->NumAllocs,
+					 Telemetry->NumFrees,
+					 Telemetry->NumFailedAllocs,
+					 (f64)Telemetry->PeakUsedSize / Mb,
+					 (f64)PartitionSize / Mb,
+					 PartitionSize ? ((f64)Telemetry->PeakUsedSize / (f64)PartitionSize * 100.0) : 0.0);
+
+	// NOTE(ivan): Size histogram, only non-empty buckets.
+	char Histogram[1024] = {};
+	u32 HistogramLength = 0;
+	for (u32 Bucket = 0; Bucket < MEMORY_TELEMETRY_HISTOGRAM_SIZE; Bucket++) {
+		if (Telemetry->SizeHistogram[Bucket] && HistogramLength < (ArraySize(Histogram) - 1))
+			HistogramLength += snprintf(Histogram + HistogramLength, ArraySize(Histogram) - HistogramLength - 1,
+										" %llu+:%llu", (u64)1 << Bucket, Telemetry->SizeHistogram[Bucket]);
+	}
+	if (HistogramLength)
+		OutTelemetryLine(FileHandle, "    sizes (bytes+:allocs):%s", Histogram);
+
+	// NOTE(ivan): Call sites.
+	for (u32 Index = 0; Index < MAX_MEMORY_TELEMETRY_CALL_SITES; Index++) {
+		memory_call_site *CallSite = &Telemetry->CallSites[Index];
+		if (CallSite->Key && CallSite->File)
+			OutTelemetryLine(FileHandle, "    %s(%d): %llu allocs, %llu failed, %.3f Mb total.",
+							 CallSite->File,
+							 CallSite->Line,
+							 CallSite->NumAllocs,
+							 CallSite->NumFailedAllocs,
+							 (f64)CallSite->TotalSize / Mb);
+	}
+	if (Telemetry->NumLostCallSites)
+		OutTelemetryLine(FileHandle, "    %llu allocs from call sites that did not fit the table.",
+						 Telemetry->NumLostCallSites);
+}
+
+static void
+OutMemoryTelemetryTable(file_handle FileHandle) {
+	OutTelemetryLine(FileHandle, "-------------------------------------------------------------------------------");
+
+	OutMemoryTelemetry(FileHandle, GameState.FrameArena.Name,
+					   GameState.FrameArena.BufferSize, &GameState.FrameArena.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.GeneralHeap.Name,
+					   GameState.GeneralHeap.Piece.Size, &GameState.GeneralHeap.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.PermanentStack.Name,
+					   GameState.PermanentStack.Piece.Size, &GameState.PermanentStack.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.ScratchStack.Name,
+					   GameState.ScratchStack.Piece.Size, &GameState.ScratchStack.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.LevelStack.Name,
+					   GameState.LevelStack.Piece.Size, &GameState.LevelStack.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.ResourceBuddy.Name,
+					   GameState.ResourceBuddy.DataSize, &GameState.ResourceBuddy.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.RelocatableHeap.Name,
+					   GameState.RelocatableHeap.Piece.Size, &GameState.RelocatableHeap.Telemetry);
+
+	OutMemoryTelemetry(FileHandle, GameState.CommandsPool.Name,
+					   GameState.CommandsPool.Piece.Size, &GameState.CommandsPool.Telemetry);
+	OutMemoryTelemetry(FileHandle, GameState.SettingsPool.Name,
+					   GameState.SettingsPool.Piece.Size, &GameState.SettingsPool.Telemetry);
+
+	for (u32 Node = 0; Node < GameState.NumNUMAPartitions; Node++) {
+		numa_partitions *Partitions = &GameState.NUMAPartitions[Node];
+		OutMemoryTelemetry(FileHandle, Partitions->Heap.Name,
+						   Partitions->Heap.Piece.Size, &Partitions->Heap.Telemetry);
+		OutMemoryTelemetry(FileHandle, Partitions->SmallPool.Name,
+						   Partitions->SmallPool.Piece.Size, &Partitions->SmallPool.Telemetry);
+	}
+
+	OutTelemetryLine(FileHandle, "-------------------------------------------------------------------------------");
+}
+#endif // #if MEMORY_TELEMETRY
+
+#if MUTEX_PROFILING
+// NOTE(ivan): Mutex profiles of all the modules, the most waited for first. Mutexes never entered are skipped.
+static void
+OutMutexProfilesTable(void) {
+	u32 NumProfiles = 0;
+	mutex_profile *Profiles = GameState.PlatformAPI->GetMutexProfiles(&NumProfiles);
+
+	mutex_profile *Sorted[MAX_PLATFORM_MUTEX_PROFILES];
+	u32 NumSorted = 0;
+	for (u32 Index = 0; Index < NumProfiles; Index++) {
+		mutex_profile *Profile = &Profiles[Index];
+		if (!Profile->NumEnters)
+			continue;
+
+		u32 Position = NumSorted++;
+		for (; Position && Sorted[Position - 1]->WaitClocks < Profile->WaitClocks; Position--)
+			Sorted[Position] = Sorted[Position - 1];
+		Sorted[Position] = Profile;
+	}
+
+	GameState.PlatformAPI->Outf("-------------------------------------------------------------------------------");
+	for (u32 Index = 0; Index < NumSorted; Index++) {
+		mutex_profile *Profile = Sorted[Index];
+		GameState.PlatformAPI->Outf("[%s] : %llu enters, %llu contended (%.2f%%), wait %llu clocks (max %llu), hold %.1f clocks avg (max %llu).",
+									Profile->Name,
+									Profile->NumEnters,
+									Profile->NumContendedEnters,
+									(f64)Profile->NumContendedEnters / (f64)Profile->NumEnters * 100.0,
+									Profile->WaitClocks,
+									Profile->MaxWaitClocks,
+									(f64)Profile->HoldClocks / (f64)Profile->NumEnters,
+									Profile->MaxHoldClocks);
+	}
+	GameState.PlatformAPI->Outf("-------------------------------------------------------------------------------");
+}
+
+static b32
+CommandOutMutexStats(char **Params, u32 NumParams) {
+	UnusedParam(Params);
+	UnusedParam(NumParams);
+
+	OutMutexProfilesTable();
+	return true;
+}
+#endif // #if MUTEX_PROFILING
+
 static b32
 CommandQuit(char **Params, u32 NumParams) {
 	if (NumParams >= 2) {
@@ -380,6 +685,239 @@ CommandOutCPU(char **Params, u32 NumParams) {
 	return true;
 }
 
+#if MEMORY_TELEMETRY
+// NOTE(ivan): Usage: outmemstats [file-name].
+static b32
+CommandOutMemStats(char **Params, u32 NumParams) {
+	if (NumParams >= 2) {
+		file_handle FileHandle = GameState.PlatformAPI->FOpen(Params[1], FileAccessType_OpenForWriting);
+		if (FileHandle == NOTFOUND) {
+			GameState.PlatformAPI->Outf("outmemstats: cannot open file '%s'!", Params[1]);
+			return false;
+		}
+
+		OutMemoryTelemetryTable(FileHandle);
+		GameState.PlatformAPI->FClose(FileHandle);
+	} else {
+		OutMemoryTelemetryTable(NOTFOUND);
+	}
+
+	return true;
+}
+
+// NOTE(ivan): Usage: memtrace [file-name], starts memory trace if a file name is given, stops it otherwise.
+static b32
+CommandMemTrace(char **Params, u32 NumParams) {
+	if (NumParams >= 2)
+		return StartMemoryTrace(Params[1]);
+
+	StopMemoryTrace();
+	return true;
+}
+#endif // #if MEMORY_TELEMETRY
+
+#if INTERNAL
+// NOTE(ivan): Mutex contention microbenchmark. Each thread takes and releases its own mutex and bumps the counter
+// the mutex guards, once with the mutexes packed next to each other the way containers used to keep them, and once
+// with padded mutexes. Threads never wait for each other, so all the slowdown of the packed layout is false sharing.
+// Both layouts use the same bare ticket lock, since ticket_mutex cannot be packed, so only the layout differs.
+#define MEMBENCH_ITERATIONS 1000000
+
+// NOTE(ivan): Bare ticket lock followed by the data it guards.
+struct membench_slot {
+	volatile u64 Ticket;
+	volatile u64 Serving;
+	volatile u64 Counter;
+};
+
+struct CacheAligned membench_padded_slot {
+	membench_slot Slot;
+};
+
+static struct membench_state {
+	membench_slot PackedSlots[MAX_PLATFORM_THREADS];
+	membench_padded_slot PaddedSlots[MAX_PLATFORM_THREADS];
+
+	b32 IsPadded;
+	u64 Clocks[MAX_PLATFORM_THREADS];
+} MemBenchState;
+
+static PLATFORM_THREAD_PROC(MemBenchThread) {
+	membench_state *State = (membench_state *)Param;
+	membench_slot *Slot = (State->IsPadded ? &State->PaddedSlots[ThreadIndex].Slot : &State->PackedSlots[ThreadIndex]);
+	u64 StartClock = __rdtsc();
+
+	for (u32 Iteration = 0; Iteration < MEMBENCH_ITERATIONS; Iteration++) {
+		u64 Ticket = AtomicIncrementU64(&Slot->Ticket) - 1;
+		while (Ticket != Slot->Serving)
+			YieldProcessor();
+		Slot->Counter++;
+		AtomicIncrementU64(&Slot->Serving);
+	}
+
+	State->Clocks[ThreadIndex] = __rdtsc() - StartClock;
+}
+
+// NOTE(ivan): Runs the benchmark on a given count of threads, returns the slowest thread's clocks per iteration.
+static f64
+RunMemBench(u32 NumThreads, b32 IsPadded) {
+	MemBenchState.IsPadded = IsPadded;
+	if (!GameState.PlatformAPI->RunThreads(MemBenchThread, &MemBenchState, NumThreads))
+		return 0.0;
+
+	u64 MaxClocks = 0;
+	for (u32 Index = 0; Index < NumThreads; Index++)
+		MaxClocks = Max(MaxClocks, MemBenchState.Clocks[Index]);
+
+	return (f64)MaxClocks / (f64)MEMBENCH_ITERATIONS;
+}
+
+// NOTE(ivan): Usage: membench [threads-count], all core threads by default.
+static b32
+CommandMemBench(char **Params, u32 NumParams) {
+	u32 NumThreads = GameState.PlatformAPI->CPUInfo.NumCoreThreads;
+	if (NumParams >= 2)
+		NumThreads = (u32)atoi(Params[1]);
+	NumThreads = Min(Max(NumThreads, 2u), (u32)MAX_PLATFORM_THREADS);
+
+	f64 PackedClocks = RunMemBench(NumThreads, false);
+	f64 PaddedClocks = RunMemBench(NumThreads, true);
+	if (PackedClocks == 0.0 || PaddedClocks == 0.0) {
+		GameState.PlatformAPI->Outf("membench: cannot start %u threads!", NumThreads);
+		return false;
+	}
+
+	GameState.PlatformAPI->Outf("membench: %u threads, packed mutexes %.1f clocks, padded mutexes %.1f clocks per lock, %.2fx.",
+								NumThreads, PackedClocks, PaddedClocks, PackedClocks / PaddedClocks);
+	return true;
+}
+
+// NOTE(ivan): Job system microbenchmark. Group jobs each add a batch of leaf jobs and wait for them, so the workers
+// go through nested waits and steal from each other. The same leaves are then computed serially on the primary thread,
+// the results must match. Group jobs take their scratch memory from the NUMA-node partitions of the worker they run on.
+#define JOBBENCH_NUM_GROUPS 64
+#define JOBBENCH_JOBS_PER_GROUP 256
+#define JOBBENCH_LEAF_ITERATIONS 4096
+
+#define JOBBENCH_NUM_LEAVES (JOBBENCH_NUM_GROUPS * JOBBENCH_JOBS_PER_GROUP)
+
+static struct jobbench_state {
+	u64 GroupSums[JOBBENCH_NUM_GROUPS];
+	u32 NumJobsRun[MAX_PLATFORM_JOB_WORKERS]; // NOTE(ivan): Per worker, each one bumps its own.
+	volatile b32 IsOutOfMemory;
+} JobBenchState;
+
+// NOTE(ivan): Leaf's parameter and result, one small pool block each, so the leaves do not share cache lines.
+struct jobbench_leaf {
+	u64 Result;
+	u32 LeafIndex;
+};
+
+static u64
+JobBenchLeaf(u32 LeafIndex) {
+	u64 Value = LeafIndex + 1;
+	for (u32 Iteration = 0; Iteration < JOBBENCH_LEAF_ITERATIONS; Iteration++)
+		Value = Value * 6364136223846793005ull + 1442695040888963407ull;
+
+	return Value;
+}
+
+static PLATFORM_JOB_PROC(JobBenchLeafJob) {
+	jobbench_leaf *Leaf = (jobbench_leaf *)Param;
+	Leaf->Result = JobBenchLeaf(Leaf->LeafIndex);
+	JobBenchState.NumJobsRun[WorkerIndex]++;
+}
+
+static PLATFORM_JOB_PROC(JobBenchGroupJob) {
+	u32 GroupIndex = (u32)(uptr)Param;
+
+	// NOTE(ivan): The worker might be moved to another node while it waits, so the memory
+	// goes back to the partitions it came from rather than to the local ones.
+	numa_partitions *Partitions = GetLocalNUMAPartitions();
+	platform_job *Jobs = (platform_job *)AllocFromHeap(&Partitions->Heap, sizeof(platform_job) * JOBBENCH_JOBS_PER_GROUP, 0);
+	if (!Jobs) {
+		JobBenchState.IsOutOfMemory = true;
+		return;
+	}
+
+	u32 NumJobs = 0;
+	for (; NumJobs < JOBBENCH_JOBS_PER_GROUP; NumJobs++) {
+		jobbench_leaf *Leaf = (jobbench_leaf *)AllocFromPool(&Partitions->SmallPool, 0);
+		if (!Leaf) {
+			JobBenchState.IsOutOfMemory = true;
+			break;
+		}
+
+		Leaf->LeafIndex = GroupIndex * JOBBENCH_JOBS_PER_GROUP + NumJobs;
+		Jobs[NumJobs] = {JobBenchLeafJob, Leaf};
+	}
+
+	platform_job_counter Counter = {};
+	GameState.PlatformAPI->AddJobs(Jobs, NumJobs, &Counter);
+	GameState.PlatformAPI->WaitForJobCounter(&Counter);
+
+	u64 Sum = 0;
+	for (u32 Index = 0; Index < NumJobs; Index++) {
+		jobbench_leaf *Leaf = (jobbench_leaf *)Jobs[Index].Param;
+		Sum += Leaf->Result;
+		FreeFromPool(&Partitions->SmallPool, Leaf);
+	}
+	FreeFromHeap(&Partitions->Heap, Jobs);
+
+	JobBenchState.GroupSums[GroupIndex] = Sum;
+	JobBenchState.NumJobsRun[WorkerIndex]++;
+}
+
+static b32
+CommandJobBench(char **Params, u32 NumParams) {
+	UnusedParam(Params);
+	UnusedParam(NumParams);
+
+	Assert(sizeof(jobbench_leaf) <= NUMA_SMALL_POOL_BLOCK_SIZE);
+
+	platform_api *API = GameState.PlatformAPI;
+	memset(&JobBenchState, 0, sizeof(JobBenchState));
+
+	u64 StartClock = __rdtsc();
+	platform_job Jobs[JOBBENCH_NUM_GROUPS];
+	for (u32 Index = 0; Index < JOBBENCH_NUM_GROUPS; Index++)
+		Jobs[Index] = {JobBenchGroupJob, (void *)(uptr)Index};
+
+	platform_job_counter Counter = {};
+	API->AddJobs(Jobs, ArraySize(Jobs), &Counter);
+	API->WaitForJobCounter(&Counter);
+	u64 JobClocks = __rdtsc() - StartClock;
+
+	StartClock = __rdtsc();
+	u64 Checksum = 0;
+	for (u32 LeafIndex = 0; LeafIndex < JOBBENCH_NUM_LEAVES; LeafIndex++)
+		Checksum += JobBenchLeaf(LeafIndex);
+	u64 SerialClocks = __rdtsc() - StartClock;
+
+	if (JobBenchState.IsOutOfMemory) {
+		API->Outf("jobbench: out of NUMA-node memory!");
+		return false;
+	}
+
+	u64 JobChecksum = 0;
+	for (u32 Index = 0; Index < JOBBENCH_NUM_GROUPS; Index++)
+		JobChecksum += JobBenchState.GroupSums[Index];
+	if (JobChecksum != Checksum) {
+		API->Outf("jobbench: results do not match!");
+		return false;
+	}
+
+	u32 NumJobs = JOBBENCH_NUM_GROUPS * (JOBBENCH_JOBS_PER_GROUP + 1);
+	API->Outf("jobbench: %u workers, %u jobs, %.1f clocks per job, serial %.1f clocks per leaf, %.2fx.",
+			  API->NumJobWorkers, NumJobs, (f64)JobClocks / (f64)NumJobs,
+			  (f64)SerialClocks / (f64)JOBBENCH_NUM_LEAVES, (f64)SerialClocks / (f64)JobClocks);
+	for (u32 WorkerIndex = 0; WorkerIndex < API->NumJobWorkers; WorkerIndex++)
+		API->Outf("...worker %u ran %u jobs", WorkerIndex, JobBenchState.NumJobsRun[WorkerIndex]);
+
+	return true;
+}
+#endif // #if INTERNAL
+
 static b32
 CommandOutRAM(char **Params, u32 NumParams) {
 	UnusedParam(Params);
@@ -389,11 +927,124 @@ CommandOutRAM(char **Params, u32 NumParams) {
 	return true;
 }
 
+// NOTE(ivan): Game memory partition plan. Per-NUMA-node partitions are added at run-time, one set for each node.
+// Name, type, partition, unit, amount, block size, parameter, pool flags, parent heap.
+static memory_plan_entry GameMemoryPlan[] = {
+	{"frame_arena", MemoryPartitionType_FrameArena, &GameState.FrameArena, MemoryPlanUnit_Weight, 10, 0, 2},
+	{"general_heap", MemoryPartitionType_Heap, &GameState.GeneralHeap, MemoryPlanUnit_Weight, 10},
+	{"permanent_stack", MemoryPartitionType_Stack, &GameState.PermanentStack, MemoryPlanUnit_Weight, 8},
+	{"scratch_stack", MemoryPartitionType_Stack, &GameState.ScratchStack, MemoryPlanUnit_Bytes, Megabytes(1)},
+	{"level_stack", MemoryPartitionType_DoubleStack, &GameState.LevelStack, MemoryPlanUnit_Weight, 8},
+	{"resources_buddy", MemoryPartitionType_Buddy, &GameState.ResourceBuddy, MemoryPlanUnit_Weight, 8, Kilobytes(64)},
+	{"relocatable_heap", MemoryPartitionType_HandleHeap, &GameState.RelocatableHeap, MemoryPlanUnit_Weight, 6, 0, 65536},
+	{"commands_pool", MemoryPartitionType_GrowablePool, &GameState.CommandsPool, MemoryPlanUnit_Count, 1024,
+	 sizeof(command), 1024, 0, &GameState.GeneralHeap},
+	{"settings_pool", MemoryPartitionType_GrowablePool, &GameState.SettingsPool, MemoryPlanUnit_Count, 1024,
+	 sizeof(setting), 1024, 0, &GameState.GeneralHeap},
+	{"spare", MemoryPartitionType_Spare, 0, MemoryPlanUnit_Weight, 32}
+};
+
+// NOTE(ivan): Per-NUMA-node plan entries, partitions' names must outlive the plan's loading.
+#define NUM_NUMA_PLAN_ENTRIES 2
+static char NUMAPlanEntryNames[MAX_NUMA_PARTITIONS * NUM_NUMA_PLAN_ENTRIES][32];
+
+static u32
+AddNUMAMemoryPlanEntries(memory_plan_entry *Entries, u32 NumNodes) {
+	Assert(Entries);
+	Assert(NumNodes <= MAX_NUMA_PARTITIONS);
+
+	u32 Result = 0;
+
+	for (u32 Node = 0; Node < NumNodes; Node++) {
+		numa_partitions *Partitions = &GameState.NUMAPartitions[Node];
+		char (*Names)[32] = NUMAPlanEntryNames + Node * NUM_NUMA_PLAN_ENTRIES;
+		memory_plan_entry *Entry = Entries + Result;
+
+		snprintf(Names[0], ArraySize(Names[0]), "node%u_heap", Node);
+		Entry[0] = {Names[0], MemoryPartitionType_Heap, &Partitions->Heap, MemoryPlanUnit_Weight, 2};
+		snprintf(Names[1], ArraySize(Names[1]), "node%u_small_pool", Node);
+		Entry[1] = {Names[1], MemoryPartitionType_Pool, &Partitions->SmallPool, MemoryPlanUnit_Weight, 2,
+					NUMA_SMALL_POOL_BLOCK_SIZE, NUMA_SMALL_POOL_MAGAZINE_SIZE};
+
+		for (u32 Index = 0; Index < NUM_NUMA_PLAN_ENTRIES; Index++) {
+			Entry[Index].IsNUMABound = true;
+			Entry[Index].NUMANode = Node;
+		}
+		Result += NUM_NUMA_PLAN_ENTRIES;
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Overrides plan entries' sizes with the ones listed in a given file, so the memory can be tuned
+// per deployment without recompiling. Each line is "<partition name> <bytes|count|weight> <amount>",
+// bytes can be suffixed with k, m or g. Lines that do not match any entry are reported and skipped.
+static b32
+LoadMemoryPlanFromFile(memory_plan_entry *Entries, u32 NumEntries, const char *FileName) {
+	Assert(Entries);
+	Assert(FileName);
+
+	GameState.PlatformAPI->Outf("Loading memory plan from file '%s'...", FileName);
+
+	b32 Result = false;
+
+	// NOTE(ivan): No partitions exist yet, so the lines are parsed in place instead of being tokenized.
+	file_handle FileHandle = GameState.PlatformAPI->FOpen(FileName, FileAccessType_OpenForReading);
+	if (FileHandle != NOTFOUND) {
+		char LineBuffer[1024] = {};
+		while (GetLineFromFile(FileHandle, LineBuffer, ArraySize(LineBuffer) - 1)) {
+			char Name[128], Unit[16], Suffix[2] = {};
+			unsigned long long Amount;
+			if (sscanf(LineBuffer, "%127s %15s %llu%1[kKmMgG]", Name, Unit, &Amount, Suffix) < 3)
+				continue;
+
+			memory_plan_entry *Entry = 0;
+			for (u32 Index = 0; Index < NumEntries; Index++) {
+				if (strcmp(Entries[Index].Name, Name) == 0) {
+					Entry = &Entries[Index];
+					break;
+				}
+			}
+			if (!Entry) {
+				GameState.PlatformAPI->Outf("LoadMemoryPlanFromFile: Unknown partition '%s'!", Name);
+				continue;
+			}
+
+			if (strcmp(Unit, "bytes") == 0) {
+				if (Suffix[0] == 'k' || Suffix[0] == 'K')
+					Amount = Kilobytes(Amount);
+				else if (Suffix[0] == 'm' || Suffix[0] == 'M')
+					Amount = Megabytes(Amount);
+				else if (Suffix[0] == 'g' || Suffix[0] == 'G')
+					Amount = Gigabytes(Amount);
+				Entry->Unit = MemoryPlanUnit_Bytes;
+			} else if (strcmp(Unit, "count") == 0) {
+				Entry->Unit = MemoryPlanUnit_Count;
+			} else if (strcmp(Unit, "weight") == 0) {
+				Entry->Unit = MemoryPlanUnit_Weight;
+			} else {
+				GameState.PlatformAPI->Outf("LoadMemoryPlanFromFile: Unknown unit '%s' of partition '%s'!", Unit, Name);
+				continue;
+			}
+			Entry->Amount = (uptr)Amount;
+		}
+
+		Result = true;
+		GameState.PlatformAPI->FClose(FileHandle);
+		GameState.PlatformAPI->Outf("...success");
+	} else {
+		GameState.PlatformAPI->Outf("...fail, file not found, using built-in plan!");
+	}
+
+	return Result;
+}
+
 extern "C" GAME_TRIGGER(GameTrigger) {
 	// NOTE(ivan): Various game file names.
 	static const char GameDefaultSettingsFileName[] = "data/default.set";
 	static const char GameUserSettingsFileName[] = "data/user.set";
 	static const char GameEdSettingsFileName[] = "data/ed.set";
+	static const char GameMemoryPlanFileName[] = "data/memory.set";
 
 	switch (TriggerType) {
 		////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -412,19 +1063,33 @@ extern "C" GAME_TRIGGER(GameTrigger) {
 		// NOTE(ivan): Output CPU information.
 		OutCPUStats();
 
+#if MEMORY_TELEMETRY
+		// NOTE(ivan): Start memory trace before partitioning, so it sees the containers created.
+		const char *MemoryTraceFileName = GameState.PlatformAPI->CheckParamValue("-memtrace");
+		if (MemoryTraceFileName)
+			StartMemoryTrace(MemoryTraceFileName);
+#endif
+
+#if MUTEX_PROFILING
+		// NOTE(ivan): Containers profile their own mutexes when created.
+		GameState.PlatformAPI->ProfileMutex(&GameState.GameMemory->Mutex, "game_memory");
+		GameState.PlatformAPI->ProfileMutex(&GameState.CommandCache.Mutex.WriterMutex, "command_cache_writers");
+		GameState.PlatformAPI->ProfileMutex(&GameState.SettingCache.Mutex.WriterMutex, "setting_cache_writers");
+#endif
+
 		// NOTE(ivan): Organize memory partitions.
-		// TODO(ivan): Calibrate memory partitions sizes to make them
-		// as adequate as possible.
 		GameState.PlatformAPI->Outf("Partitioning game primary storage...");
-		u32 FreeStoragePercent = 100;
-		FreeStoragePercent = CreateMemoryHeap(&GameState.PerFrameHeap, "per_frame_heap",
-											  Percentage(10, FreeStoragePercent));
-		FreeStoragePercent = CreateMemoryStack(&GameState.PermanentStack, "permanent_stack",
-											   Percentage(10, FreeStoragePercent));
-		FreeStoragePercent = CreateMemoryPool(&GameState.CommandsPool, "commands_pool",
-											  sizeof(command), Percentage(10, FreeStoragePercent));
-		FreeStoragePercent = CreateMemoryPool(&GameState.SettingsPool, "settings_pool",
-											  sizeof(setting), Percentage(10, FreeStoragePercent));
+		memory_plan_entry MemoryPlan[ArraySize(GameMemoryPlan) + MAX_NUMA_PARTITIONS * NUM_NUMA_PLAN_ENTRIES];
+		u32 NumMemoryPlanEntries = ArraySize(GameMemoryPlan);
+		memcpy(MemoryPlan, GameMemoryPlan, sizeof(GameMemoryPlan));
+
+		GameState.NumNUMAPartitions = Min(GameState.PlatformAPI->CPUInfo.NumNUMA, (u32)MAX_NUMA_PARTITIONS);
+		NumMemoryPlanEntries += AddNUMAMemoryPlanEntries(MemoryPlan + NumMemoryPlanEntries, GameState.NumNUMAPartitions);
+
+		LoadMemoryPlanFromFile(MemoryPlan, NumMemoryPlanEntries, GameMemoryPlanFileName);
+		uptr LeftoverSize = ApplyMemoryPlan(MemoryPlan, NumMemoryPlanEntries);
+		GameState.PlatformAPI->Outf("Primary storage left unpartitioned: %.3f Mb.", (f64)LeftoverSize / (f64)Megabytes(1));
+
 		if (IsInternal())
 			OutMemoryTableStats();
 
@@ -433,13 +1098,32 @@ extern "C" GAME_TRIGGER(GameTrigger) {
 		RegisterCommand("restart", CommandRestart);
 		RegisterCommand("outcpu", CommandOutCPU);
 		RegisterCommand("outram", CommandOutRAM);
-		if (IsInternal()) {
-			RegisterCommand("causeav", CommandCauseAV);
-		}
+#if INTERNAL
+		RegisterCommand("causeav", CommandCauseAV);
+		RegisterCommand("membench", CommandMemBench);
+		RegisterCommand("jobbench", CommandJobBench);
+#endif
+#if MEMORY_TELEMETRY
+		RegisterCommand("outmemstats", CommandOutMemStats);
+		RegisterCommand("memtrace", CommandMemTrace);
+#endif
+#if MUTEX_PROFILING
+		RegisterCommand("outmutexstats", CommandOutMutexStats);
+#endif
 
 		// NOTE(ivan): Load settings.
 		LoadSettingsFromFile(GameDefaultSettingsFileName);
 		LoadSettingsFromFile(GameUserSettingsFileName);
+
+#if INTERNAL
+		// NOTE(ivan): Run the contention microbenchmark on start-up if asked.
+		if (GameState.PlatformAPI->CheckParam("-membench") != NOTFOUND)
+			ExecCommand("membench");
+
+		// NOTE(ivan): Same for the job system microbenchmark.
+		if (GameState.PlatformAPI->CheckParam("-jobbench") != NOTFOUND)
+			ExecCommand("jobbench");
+#endif
 	} break;
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -451,23 +1135,44 @@ extern "C" GAME_TRIGGER(GameTrigger) {
 		// NOTE(ivan): Output memory stats.
 		if (IsInternal())
 			OutMemoryTableStats();
+
+#if MUTEX_PROFILING
+		// NOTE(ivan): Output mutex contention stats.
+		OutMutexProfilesTable();
+#endif
 		
 		// NOTE(ivan): Save settings.
 		SaveSettingsToFile(GameUserSettingsFileName);
+
+#if MEMORY_TELEMETRY
+		StopMemoryTrace();
+#endif
 	} break;
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 		// NOTE(ivan): Game frame update.
 		////////////////////////////////////////////////////////////////////////////////////////////////////
 	case GameTriggerType_Frame: {
-		// NOTE(ivan): Clean up per-frame heap.
-		ResetMemoryHeap(&GameState.PerFrameHeap);
+		// NOTE(ivan): Switch frame arena to the next buffer, previous frame's data stays readable during this frame.
+		// Its contents are never expected to be zeroed.
+		AdvanceFrameArena(&GameState.FrameArena, 0);
+
+		// NOTE(ivan): Spend about a percent of the frame on relocatable heap compaction.
+		CompactMemoryHandleHeap(&GameState.RelocatableHeap, Max(GameState.GameClocks->CPUClocksPerFrame / 100, (u64)1));
 
 #if INTERNAL		
 		// NOTE(ivan): Restart if requested.
 		if (GameState.GameInput->KbButtons[KeyCode_F1].IsDown)
 			RestartGame();
 #endif		
+	} break;
+
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+		// NOTE(ivan): Platform layer's thread exit, called on that thread.
+		////////////////////////////////////////////////////////////////////////////////////////////////////
+	case GameTriggerType_ThreadExit: {
+		// NOTE(ivan): Give the thread's pool magazines back, so short-lived threads do not leak them.
+		ReleaseMemoryThread();
 	} break;
 	}
 }
@@ -12,13 +12,15 @@
 
 // NOTE(ivan): Game memory.
 // NOTE(ivan): Game memory structure represents game primary storage which cannot be grown
-// and is meant to be partitioned to various memory containers at game initialization. The whole chunk
-// of primary storage is always initially zeroed.
+// and is meant to be partitioned to various memory containers at game initialization. The primary storage
+// is a reserved address space range, its pages are committed by the containers on demand
+// and always read as zeros when committed.
 struct game_memory {
-	piece FreeStorage;     // NOTE(ivan): Storage's starting address of its free space and size of this space in bytes.
-	uptr StorageTotalSize; // NOTE(ivan): Storage's total size in bytes.
-
 	ticket_mutex Mutex;
+
+	piece FreeStorage;     // NOTE(ivan): Storage's starting address of its free space and size of this space in bytes.
+	uptr StorageTotalSize; // NOTE(ivan): Storage's total reserved size in bytes.
+	uptr CommittedSize;    // NOTE(ivan): Storage's currently committed size in bytes.
 };
 
 // NOTE(ivan): Game clocks and timings for current frame.
@@ -156,11 +158,12 @@ struct command {
 };
 
 // NOTE(ivan): Commands cache.
+// NOTE(ivan): Lookups take the mutex for reading, so they run concurrently.
 struct command_cache {
+	rw_mutex Mutex; // NOTE(ivan): For synchronization.
+
 	command *TopCommand;
 	u32 NumCommands;
-
-	ticket_mutex Mutex; // NOTE(ivan): For synchronization.
 };
 
 void RegisterCommand(const char *Name, command_callback *Callback);
@@ -178,17 +181,36 @@ struct setting {
 };
 
 // NOTE(ivan): Settings cache.
+// NOTE(ivan): Lookups take the mutex for reading, so they run concurrently.
 struct setting_cache {
+	rw_mutex Mutex; // NOTE(ivan): For synchronization.
+
 	setting *TopSetting;
 	u32 NumSettings;
-
-	ticket_mutex Mutex; // NOTE(ivan): For synchronization.
 };
 
 // NOTE(ivan): Settings load, save, and access.
+// NOTE(ivan): LoadSettingsFromFile() parses on the scratch stack, so it must be called on the primary thread.
+// NOTE(ivan): GetSetting() copies the value into a given buffer while the cache is locked, since the cache's own copy
+// is rewritten if the setting is pushed again. The value is cut to fit the buffer. Returns false if there is no such setting.
 b32 LoadSettingsFromFile(const char *FileName);
 b32 SaveSettingsToFile(const char *FileName);
-const char * GetSetting(const char *Name);
+b32 GetSetting(const char *Name, char *Value, u32 ValueSize);
+
+// NOTE(ivan): Maximum count of NUMA-nodes that get their own memory partitions,
+// nodes past this count share the partitions of the lower nodes.
+#define MAX_NUMA_PARTITIONS 8
+
+// NOTE(ivan): Memory partitions bound to one NUMA-node. Job workers should prefer the partitions
+// of the node they run on (see GetLocalNUMAPartitions()) over the shared ones for the data they produce.
+// Memory must be given back to the partitions it came from, which might not be the local ones by then.
+struct numa_partitions {
+	memory_heap Heap;
+	memory_pool SmallPool; // NOTE(ivan): For small objects of up to NUMA_SMALL_POOL_BLOCK_SIZE bytes.
+};
+
+#define NUMA_SMALL_POOL_BLOCK_SIZE 64
+#define NUMA_SMALL_POOL_MAGAZINE_SIZE 32
 
 // NOTE(ivan): Game globals.
 extern struct game_state {
@@ -201,11 +223,18 @@ extern struct game_state {
 	game_clocks *GameClocks;
 	game_input *GameInput;
 	
-	// NOTE(ivan): Game memory partitions.
-	memory_heap PerFrameHeap;    // NOTE(ivan): Contains temporary data for one frame, gets cleaned at each new frame.
-	memory_stack PermanentStack; // NOTE(ivan): Contains data that will stay online till the program complete shutdown.
-	memory_pool CommandsPool;    // NOTE(ivan): Special pool for commands cache.
-	memory_pool SettingsPool;    // NOTE(ivan): Special pool for settings cache.
+	// NOTE(ivan): Game memory partitions. Each one is cache line aligned (see game_memory.h), so do the caches below.
+	memory_frame_arena FrameArena; // NOTE(ivan): Contains temporary data for one frame, stays valid for one more frame.
+	memory_heap GeneralHeap;       // NOTE(ivan): Contains short-lived data of various sizes that is freed explicitly.
+	memory_stack PermanentStack;   // NOTE(ivan): Contains data that will stay online till the program complete shutdown.
+	memory_stack ScratchStack;     // NOTE(ivan): Primary thread's scratch data, allocated inside temporary memory scopes only.
+	memory_double_stack LevelStack; // NOTE(ivan): Low end contains level data, high end contains the level's load-time scratch data.
+	memory_buddy ResourceBuddy;    // NOTE(ivan): Contains power-of-two sized resources like textures and sound buffers.
+	memory_handle_heap RelocatableHeap; // NOTE(ivan): Contains long-lived data referenced by handles, compacted a bit each frame.
+	memory_pool CommandsPool;      // NOTE(ivan): Special pool for commands cache, grows from the general heap.
+	memory_pool SettingsPool;      // NOTE(ivan): Special pool for settings cache, grows from the general heap.
+	numa_partitions NUMAPartitions[MAX_NUMA_PARTITIONS]; // NOTE(ivan): One set per NUMA-node.
+	u32 NumNUMAPartitions;
 
 	// NOTE(ivan): Game primary commands and settings caches.
 	// NOTE(ivan): Should not be more than once instance of these structure that are meant to be singletons.
@@ -213,6 +242,16 @@ extern struct game_state {
 	setting_cache SettingCache;
 } GameState;
 
+// NOTE(ivan): Returns the partitions of the NUMA-node the calling thread runs on at the moment.
+// The thread might be moved to another node right after, which is harmless, just slower.
+inline numa_partitions *
+GetLocalNUMAPartitions(void) {
+	Assert(GameState.NumNUMAPartitions);
+
+	u32 Node = GameState.PlatformAPI->GetCurrentNUMANode();
+	return &GameState.NUMAPartitions[Node % GameState.NumNUMAPartitions];
+}
+
 inline void
 QuitGame(s32 QuitCode) {
 	GameState.PlatformAPI->QuitRequested = true;
@@ -228,7 +267,8 @@ RestartGame(void) {
 enum game_trigger_type {
 	GameTriggerType_Prepare, // NOTE(ivan): Game connection with platform layer, complete initialization.
 	GameTriggerType_Release, // NOTE(ivan): Game tear down, all resources release.
-	GameTriggerType_Frame    // NOTE(ivan): Game frame update.
+	GameTriggerType_Frame,   // NOTE(ivan): Game frame update.
+	GameTriggerType_ThreadExit // NOTE(ivan): Platform layer's thread that might have run game code is about to exit.
 };
 
 // NOTE(ivan): Game trigger function prototype.
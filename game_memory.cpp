@@ -1,102 +1,550 @@
 #include "game_memory.h"
 
+// NOTE(ivan): NUMA node new partitions are bound to, NOTFOUND if none. Guarded by the game memory mutex.
+static s32 PartitionsNUMANode = NOTFOUND;
+
+void
+SetPartitionsNUMANode(s32 Node) {
+	Assert(Node == NOTFOUND || (u32)Node < GameState.PlatformAPI->CPUInfo.NumNUMA);
+
+	EnterTicketMutex(&GameState.GameMemory->Mutex);
+	PartitionsNUMANode = Node;
+	LeaveTicketMutex(&GameState.GameMemory->Mutex);
+}
+
+// NOTE(ivan): Carves a partition out of the primary storage's reserved address space.
+// Partitions are page-aligned, so each one commits and decommits its pages independently.
 inline u8 *
 EatGameMemory(uptr Size) {
 	Assert(Size);
 
 	u8 *Result = 0;
 
+	if (GameState.PlatformAPI->PageSize)
+		Size = AlignPow2(Size, GameState.PlatformAPI->PageSize);
+
 	EnterTicketMutex(&GameState.GameMemory->Mutex);
 
-	if (Size < GameState.GameMemory->FreeStorage.Size)
+	if (Size <= GameState.GameMemory->FreeStorage.Size)
 		Result = ConsumeSize(&GameState.GameMemory->FreeStorage, Size);
+	s32 Node = PartitionsNUMANode;
 
 	LeaveTicketMutex(&GameState.GameMemory->Mutex);
 
+	// NOTE(ivan): The partition stays usable if it cannot be bound, its pages just land wherever the OS puts them.
+	if (Result && Node != NOTFOUND) {
+		if (!GameState.PlatformAPI->BindMemoryToNUMANode(Result, Size, (u32)Node))
+			GameState.PlatformAPI->Outf("EatGameMemory: Cannot bind partition to NUMA-node %d!", Node);
+	}
+
 	return Result;
 }
 
-inline u32
-GetFreeGameMemorySizePercentage(void) {
-	u32 Result;
+inline b32
+CommitGameMemory(u8 *Base, uptr Size) {
+	Assert(Base);
+	Assert(Size);
 
-	EnterTicketMutex(&GameState.GameMemory->Mutex);
-	Result = SizeToPercentage(GameState.GameMemory->FreeStorage.Size,
-							  GameState.GameMemory->StorageTotalSize);
-	LeaveTicketMutex(&GameState.GameMemory->Mutex);
+	b32 Result = GameState.PlatformAPI->CommitMemory(Base, Size);
+	if (Result) {
+		EnterTicketMutex(&GameState.GameMemory->Mutex);
+		GameState.GameMemory->CommittedSize += Size;
+		LeaveTicketMutex(&GameState.GameMemory->Mutex);
+	}
 
 	return Result;
 }
 
-inline uptr
-CalculateGameMemorySizeByPercent(u32 SizePercentage) {
-	uptr Result;
-	
+inline void
+DecommitGameMemory(u8 *Base, uptr Size) {
+	Assert(Base);
+	Assert(Size);
+
+	GameState.PlatformAPI->DecommitMemory(Base, Size);
+
 	EnterTicketMutex(&GameState.GameMemory->Mutex);
-	Result = PercentageToSize(SizePercentage,
-							  GameState.GameMemory->StorageTotalSize);
+	GameState.GameMemory->CommittedSize -= Size;
 	LeaveTicketMutex(&GameState.GameMemory->Mutex);
+}
+
+// NOTE(ivan): Makes sure that the first Size bytes of a partition are committed.
+// Commits in MEMORY_COMMIT_GRANULARITY steps, never past the partition's cap.
+static b32
+CommitPartitionMemory(piece *Piece, volatile uptr *CommittedSize, uptr Size) {
+	Assert(Piece);
+	Assert(CommittedSize);
+	Assert(Size <= Piece->Size);
+
+	if (Size <= *CommittedSize)
+		return true;
+
+	uptr PageSize = GameState.PlatformAPI->PageSize;
+	uptr NewCommittedSize = Min(AlignPow2(Size, Max((uptr)MEMORY_COMMIT_GRANULARITY, PageSize)),
+								AlignPow2(Piece->Size, PageSize));
+	if (!CommitGameMemory(Piece->Base + *CommittedSize, NewCommittedSize - *CommittedSize))
+		return false;
+
+	*CommittedSize = NewCommittedSize;
+	return true;
+}
+
+// NOTE(ivan): Clears a partition's dirty memory. Large dirty ranges are not written over,
+// instead all partition pages are given back to the OS to be committed again on demand.
+static void
+ClearPartitionMemory(piece *Piece, volatile uptr *CommittedSize, uptr DirtySize) {
+	Assert(Piece);
+	Assert(CommittedSize);
+	Assert(DirtySize <= *CommittedSize);
+
+	if (DirtySize >= MEMORY_PURGE_THRESHOLD) {
+		DecommitGameMemory(Piece->Base, *CommittedSize);
+		*CommittedSize = 0;
+	} else if (DirtySize) {
+		memset(Piece->Base, 0, DirtySize);
+	}
+}
+
+// NOTE(ivan): Index of the current thread for per-thread memory caches plus one, 0 means not assigned yet.
+// Indices are taken from a bit set of MAX_MEMORY_POOL_THREADS slots and are given back by ReleaseMemoryThread(),
+// threads that find all the slots taken get MAX_MEMORY_POOL_THREADS, which means no per-thread caches.
+static ThreadLocal u32 MemoryThreadIndex;
+static volatile u64 MemoryThreadSlots; // NOTE(ivan): Bit set means the slot is taken.
+static volatile u32 IsMemoryThreadSlotsOutReported;
+
+inline u32
+GetMemoryThreadIndex(void) {
+	if (!MemoryThreadIndex) {
+		u32 Index = MAX_MEMORY_POOL_THREADS;
+		for (;;) {
+			u64 Slots = MemoryThreadSlots;
+			if (Slots == (u64)-1) {
+				if (!AtomicExchangeU32(&IsMemoryThreadSlotsOutReported, 1))
+					GameState.PlatformAPI->Outf("GetMemoryThreadIndex: Out of thread slots, pool magazines are bypassed!");
+				break;
+			}
+
+			u32 FreeIndex = FindLeastSignificantBit64(~Slots).Index;
+			if (AtomicCompareExchangeU64(&MemoryThreadSlots, Slots | ((u64)1 << FreeIndex), Slots) == Slots) {
+				Index = FreeIndex;
+				break;
+			}
+		}
+		MemoryThreadIndex = Index + 1;
+	}
+	return MemoryThreadIndex - 1;
+}
+
+#if MEMORY_TELEMETRY
+// NOTE(ivan): Finds or claims a call site table slot, returns 0 if the table is full.
+// User-space pointers never use their top 16 bits, so the line number is packed in there.
+static memory_call_site *
+GetMemoryCallSite(memory_telemetry *Telemetry, const char *File, u32 Line) {
+	Assert(Telemetry);
+	Assert(File);
+
+	u64 Key = (u64)(uptr)File ^ ((u64)(Line & 0xFFFF) << 48);
+	u32 StartIndex = (u32)((Key ^ (Key >> 7) ^ Line) % MAX_MEMORY_TELEMETRY_CALL_SITES);
+
+	for (u32 Probe = 0; Probe < MAX_MEMORY_TELEMETRY_CALL_SITES; Probe++) {
+		memory_call_site *CallSite = &Telemetry->CallSites[(StartIndex + Probe) % MAX_MEMORY_TELEMETRY_CALL_SITES];
+
+		u64 SlotKey = CallSite->Key;
+		if (!SlotKey) {
+			SlotKey = AtomicCompareExchangeU64(&CallSite->Key, Key, 0);
+			if (!SlotKey) {
+				CallSite->File = File;
+				CallSite->Line = Line;
+				return CallSite;
+			}
+		}
+		if (SlotKey == Key)
+			return CallSite;
+	}
+
+	return 0;
+}
+
+static void
+RecordMemoryAlloc(memory_telemetry *Telemetry, uptr Size, u64 UsedSize, const char *File, u32 Line) {
+	Assert(Telemetry);
+	Assert(Size);
+
+	AtomicIncrementU64(&Telemetry->NumAllocs);
+	AtomicIncrementU64(&Telemetry->SizeHistogram[Min(FindMostSignificantBit64(Size).Index,
+													  (u32)(MEMORY_TELEMETRY_HISTOGRAM_SIZE - 1))]);
+
+	u64 PeakUsedSize = Telemetry->PeakUsedSize;
+	while (UsedSize > PeakUsedSize) {
+		u64 OldPeakUsedSize = AtomicCompareExchangeU64(&Telemetry->PeakUsedSize, UsedSize, PeakUsedSize);
+		if (OldPeakUsedSize == PeakUsedSize)
+			break;
+		PeakUsedSize = OldPeakUsedSize;
+	}
+
+	if (File) {
+		memory_call_site *CallSite = GetMemoryCallSite(Telemetry, File, Line);
+		if (CallSite) {
+			AtomicIncrementU64(&CallSite->NumAllocs);
+			AtomicAddU64(&CallSite->TotalSize, Size);
+		} else {
+			AtomicIncrementU64(&Telemetry->NumLostCallSites);
+		}
+	}
+}
+
+static void
+RecordMemoryFailedAlloc(memory_telemetry *Telemetry, const char *File, u32 Line) {
+	Assert(Telemetry);
+
+	AtomicIncrementU64(&Telemetry->NumFailedAllocs);
+
+	if (File) {
+		memory_call_site *CallSite = GetMemoryCallSite(Telemetry, File, Line);
+		if (CallSite)
+			AtomicIncrementU64(&CallSite->NumFailedAllocs);
+		else
+			AtomicIncrementU64(&Telemetry->NumLostCallSites);
+	}
+}
+
+inline void
+RecordMemoryFree(memory_telemetry *Telemetry) {
+	Assert(Telemetry);
+	AtomicIncrementU64(&Telemetry->NumFrees);
+}
+
+// NOTE(ivan): For the containers that release many allocations at once (f.e. stack scope ends and resets).
+inline void
+RecordMemoryFrees(memory_telemetry *Telemetry, u64 NumFrees) {
+	Assert(Telemetry);
+	if (NumFrees)
+		AtomicAddU64(&Telemetry->NumFrees, NumFrees);
+}
+
+// NOTE(ivan): Memory trace state. Events are gathered in a buffer that is written out when it gets full,
+// containers are registered even when the trace is off, so a trace started later still knows all of them.
+#define MAX_MEMORY_TRACE_CONTAINERS 256
+#define MEMORY_TRACE_BUFFER_SIZE 8192 // NOTE(ivan): In events.
+
+struct memory_trace_registration {
+	memory_trace_event CreateEvent;
+	memory_trace_container Container;
+};
+
+static struct memory_trace {
+	ticket_mutex Mutex;
+
+	volatile b32 IsActive;
+	file_handle FileHandle;
+	u64 StartClock;
+	u64 NumWrittenEvents;
+
+	memory_trace_registration Containers[MAX_MEMORY_TRACE_CONTAINERS];
+	u32 NumContainers;
+
+	memory_trace_event Events[MEMORY_TRACE_BUFFER_SIZE];
+	u32 NumEvents;
+} MemoryTrace;
+
+// NOTE(ivan): Must be called with the trace mutex held.
+static void
+FlushMemoryTrace(void) {
+	if (MemoryTrace.NumEvents) {
+		u32 Size = sizeof(memory_trace_event) * MemoryTrace.NumEvents;
+		if (GameState.PlatformAPI->FWrite(MemoryTrace.FileHandle, MemoryTrace.Events, Size) != Size)
+			GameState.PlatformAPI->Outf("FlushMemoryTrace: Cannot write %u events!", MemoryTrace.NumEvents);
+
+		MemoryTrace.NumWrittenEvents += MemoryTrace.NumEvents;
+		MemoryTrace.NumEvents = 0;
+	}
+}
+
+// NOTE(ivan): Must be called with the trace mutex held. Events are kept next to each other in the trace.
+static void
+AppendMemoryTraceEvents(const memory_trace_event *Events, u32 NumEvents) {
+	Assert(Events);
+	Assert(NumEvents <= MEMORY_TRACE_BUFFER_SIZE);
+
+	if ((MemoryTrace.NumEvents + NumEvents) > MEMORY_TRACE_BUFFER_SIZE)
+		FlushMemoryTrace();
+
+	memcpy(MemoryTrace.Events + MemoryTrace.NumEvents, Events, sizeof(memory_trace_event) * NumEvents);
+	MemoryTrace.NumEvents += NumEvents;
+}
+
+static void
+AppendMemoryTraceContainer(memory_trace_registration *Registration, u64 Clock) {
+	Assert(Registration);
+
+	memory_trace_event Events[2];
+	Events[0] = Registration->CreateEvent;
+	Events[0].Clock = Clock;
+	Events[0].Thread = (u8)Min(GetMemoryThreadIndex(), (u32)0xFF);
+	memcpy(&Events[1], &Registration->Container, sizeof(memory_trace_event));
+
+	AppendMemoryTraceEvents(Events, ArraySize(Events));
+}
+
+// NOTE(ivan): Gives the container an id and, if the trace is on, logs its creation. Re-creating
+// a container keeps its id.
+static void
+RegisterMemoryTraceContainer(memory_telemetry *Telemetry, memory_partition_type Type, const char *Name,
+							 uptr Size, uptr BlockSize, u32 Param, u32 PoolFlags) {
+	Assert(Telemetry);
+	Assert(Name);
+
+	EnterTicketMutex(&MemoryTrace.Mutex);
+
+	memory_trace_registration *Registration = 0;
+	if (Telemetry->TraceId) {
+		Registration = &MemoryTrace.Containers[Telemetry->TraceId - 1];
+	} else if (MemoryTrace.NumContainers < MAX_MEMORY_TRACE_CONTAINERS) {
+		Registration = &MemoryTrace.Containers[MemoryTrace.NumContainers++];
+		Telemetry->TraceId = MemoryTrace.NumContainers;
+	}
+
+	if (Registration) {
+		memset(Registration, 0, sizeof(*Registration));
+		Registration->CreateEvent.Op = MemoryTraceOp_Create;
+		Registration->CreateEvent.ContainerId = (u16)Telemetry->TraceId;
+		Registration->CreateEvent.Size = Size;
+		Registration->CreateEvent.Address = BlockSize;
+		Registration->CreateEvent.Param = Param;
+
+		strncpy(Registration->Container.Name, Name, ArraySize(Registration->Container.Name) - 1);
+		Registration->Container.Type = Type;
+		Registration->Container.PoolFlags = PoolFlags;
+
+		if (MemoryTrace.IsActive)
+			AppendMemoryTraceContainer(Registration, __rdtsc() - MemoryTrace.StartClock);
+	} else {
+		GameState.PlatformAPI->Outf("RegisterMemoryTraceContainer[%s]: Too many containers, not traced!", Name);
+	}
+
+	LeaveTicketMutex(&MemoryTrace.Mutex);
+}
+
+// NOTE(ivan): Stamps the events with the container's id, the clock and the calling thread, and logs them.
+static void
+RecordMemoryTraceEvents(memory_telemetry *Telemetry, memory_trace_event *Events, u32 NumEvents) {
+	Assert(Telemetry);
+	Assert(Events);
+
+	if (!MemoryTrace.IsActive || !Telemetry->TraceId)
+		return;
+
+	u8 Thread = (u8)Min(GetMemoryThreadIndex(), (u32)0xFF);
+
+	EnterTicketMutex(&MemoryTrace.Mutex);
+
+	// NOTE(ivan): The trace might have been stopped while waiting for the mutex.
+	if (MemoryTrace.IsActive) {
+		u64 Clock = __rdtsc() - MemoryTrace.StartClock;
+		for (u32 Index = 0; Index < NumEvents; Index++) {
+			Events[Index].Clock = Clock;
+			Events[Index].ContainerId = (u16)Telemetry->TraceId;
+			Events[Index].Thread = Thread;
+		}
+
+		AppendMemoryTraceEvents(Events, NumEvents);
+	}
+
+	LeaveTicketMutex(&MemoryTrace.Mutex);
+}
+
+inline void
+RecordMemoryTrace(memory_telemetry *Telemetry, memory_trace_op Op, u64 Address, u64 Size, u32 Param) {
+	if (MemoryTrace.IsActive) {
+		memory_trace_event Event = {};
+		Event.Op = (u8)Op;
+		Event.Address = Address;
+		Event.Size = Size;
+		Event.Param = Param;
+
+		RecordMemoryTraceEvents(Telemetry, &Event, 1);
+	}
+}
+
+// NOTE(ivan): Logged as two events, the second one carries the new address.
+inline void
+RecordMemoryTraceRealloc(memory_telemetry *Telemetry, u64 OldAddress, u64 NewAddress, u64 Size, u32 Flags) {
+	if (MemoryTrace.IsActive) {
+		memory_trace_event Events[2] = {};
+		Events[0].Op = MemoryTraceOp_Realloc;
+		Events[0].Address = OldAddress;
+		Events[0].Size = Size;
+		Events[0].Param = Flags;
+		Events[1].Op = MemoryTraceOp_Realloc;
+		Events[1].Address = NewAddress;
+
+		RecordMemoryTraceEvents(Telemetry, Events, ArraySize(Events));
+	}
+}
+
+b32
+StartMemoryTrace(const char *FileName) {
+	Assert(FileName);
+
+	b32 Result = false;
+
+	EnterTicketMutex(&MemoryTrace.Mutex);
+
+	if (!MemoryTrace.IsActive) {
+		MemoryTrace.FileHandle = GameState.PlatformAPI->FOpen(FileName, FileAccessType_OpenForWriting);
+		if (MemoryTrace.FileHandle != NOTFOUND) {
+			memory_trace_header Header = {};
+			Header.Magic = MEMORY_TRACE_MAGIC;
+			Header.Version = MEMORY_TRACE_VERSION;
+			Header.EventSize = sizeof(memory_trace_event);
+			GameState.PlatformAPI->FWrite(MemoryTrace.FileHandle, &Header, sizeof(Header));
+
+			MemoryTrace.StartClock = __rdtsc();
+			MemoryTrace.NumWrittenEvents = 0;
+			MemoryTrace.NumEvents = 0;
+
+			for (u32 Index = 0; Index < MemoryTrace.NumContainers; Index++)
+				AppendMemoryTraceContainer(&MemoryTrace.Containers[Index], 0);
+
+			CompleteWritesBeforeFutureWrites();
+			MemoryTrace.IsActive = true;
+			Result = true;
+		}
+	}
+
+	LeaveTicketMutex(&MemoryTrace.Mutex);
+
+	if (Result)
+		GameState.PlatformAPI->Outf("Memory trace started, writing to '%s'.", FileName);
+	else
+		GameState.PlatformAPI->Outf("StartMemoryTrace: Cannot open '%s' or the trace is already on!", FileName);
 
 	return Result;
 }
 
-u32
-CreateMemoryStack(memory_stack *Stack, const char *Name, u32 SizePercentage) {
+void
+StopMemoryTrace(void) {
+	b32 WasActive = false;
+	u64 NumEvents = 0;
+
+	EnterTicketMutex(&MemoryTrace.Mutex);
+
+	if (MemoryTrace.IsActive) {
+		FlushMemoryTrace();
+		GameState.PlatformAPI->FClose(MemoryTrace.FileHandle);
+
+		MemoryTrace.IsActive = false;
+		WasActive = true;
+		NumEvents = MemoryTrace.NumWrittenEvents;
+	}
+
+	LeaveTicketMutex(&MemoryTrace.Mutex);
+
+	if (WasActive)
+		GameState.PlatformAPI->Outf("Memory trace stopped, %llu events written.", NumEvents);
+}
+#endif // #if MEMORY_TELEMETRY
+
+// NOTE(ivan): Partition sizes are rounded down to the page size, because partitions are page-aligned
+// and a partition must never eat more than the size it has been given.
+inline uptr
+AlignPartitionSize(uptr Size) {
+	uptr PageSize = GameState.PlatformAPI->PageSize;
+	return PageSize ? (Size & ~(PageSize - 1)) : Size;
+}
+
+void
+CreateMemoryStack(memory_stack *Stack, const char *Name, uptr Size) {
 	Assert(Stack);
 	Assert(Name);
-	Assert(SizePercentage);
 
-	u32 Result = 0;
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Stack->Mutex, Name);
+#endif
 
 	EnterTicketMutex(&Stack->Mutex);
 
-	uptr Size = CalculateGameMemorySizeByPercent(SizePercentage);
-	Stack->Piece.Base = EatGameMemory(Size);
+	Size = AlignPartitionSize(Size);
+	Stack->Piece.Base = Size ? EatGameMemory(Size) : 0;
 	if (Stack->Piece.Base) {
 		strncpy(Stack->Name, Name, ArraySize(Stack->Name) - 1);
 		
 		Stack->Piece.Size = Size;
 		Stack->Mark = 0;
+		Stack->HighWaterMark = 0;
+		Stack->CommittedSize = 0;
+		Stack->NumAllocations = 0;
+
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Stack->Telemetry, MemoryPartitionType_Stack, Name, Size, 0, 0, 0);
+#endif
 	} else {
 		GameState.PlatformAPI->Crashf("CreateMemoryStack[%s]: Out of memory!", Name);
 	}
 
-	Result = GetFreeGameMemorySizePercentage();
-
 	LeaveTicketMutex(&Stack->Mutex);
-
-	return Result;
 }
 
 void
-ResetMemoryStack(memory_stack *Stack) {
+ResetMemoryStack(memory_stack *Stack, u32 Flags) {
 	Assert(Stack);
 
 	EnterTicketMutex(&Stack->Mutex);
 
+	Assert(Stack->NumTemporaryScopes == 0);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFrees(&Stack->Telemetry, Stack->NumAllocations);
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags);
+#endif
+
 	Stack->Mark = 0;
-	memset(Stack->Piece.Base, 0, Stack->Piece.Size);
+	Stack->NumAllocations = 0;
+	if (Flags & MemoryFlag_Zero) {
+		ClearPartitionMemory(&Stack->Piece, &Stack->CommittedSize, Stack->HighWaterMark);
+		Stack->HighWaterMark = 0;
+	}
 
 	LeaveTicketMutex(&Stack->Mutex);
 }
 
 void *
-AllocFromStack(memory_stack *Stack, uptr Size) {
+AllocFromStackTagged(memory_stack *Stack, uptr Size, u32 Flags, const char *File, u32 Line) {
 	Assert(Stack);
 	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
 
 	void *Result = 0;
 
 	EnterTicketMutex(&Stack->Mutex);
 	
-	uptr RealSize = Size + sizeof(uptr);
-	if ((Stack->Mark + RealSize) < Stack->Piece.Size) {
-		*((uptr *)Stack->Piece.Base + Stack->Mark + Size) = Size;
-		Result = Stack->Piece.Base + Stack->Mark;
+	// NOTE(ivan): The padding in front of the allocation is counted in the size stored past it,
+	// so PopStack() takes the padding off too. Scoped allocations are never popped, they have no footer.
+	b32 IsScoped = (Stack->NumTemporaryScopes != 0);
+	uptr Top = (uptr)(Stack->Piece.Base + Stack->Mark);
+	uptr Padding = AlignPow2(Top, GetMemoryFlagsAlignment(Flags)) - Top;
+	uptr RealSize = Padding + Size + (IsScoped ? 0 : sizeof(uptr));
+	if (((Stack->Mark + RealSize) <= Stack->Piece.Size) &&
+		CommitPartitionMemory(&Stack->Piece, &Stack->CommittedSize, Stack->Mark + RealSize)) {
+		Result = Stack->Piece.Base + Stack->Mark + Padding;
+		if (!IsScoped)
+			*((uptr *)((u8 *)Result + Size)) = Padding + Size;
 		Stack->Mark += RealSize;
+		Stack->HighWaterMark = Max(Stack->HighWaterMark, Stack->Mark);
+		Stack->NumAllocations++;
 
-		memset(Result, 0, Size);
+		if (Flags & MemoryFlag_Zero)
+			memset(Result, 0, Size);
+
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Stack->Telemetry, Size, Stack->Mark, File, Line);
+		RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Size, Flags);
+#endif
 	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Stack->Telemetry, File, Line);
+		RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags);
+#endif
 		GameState.PlatformAPI->Outf("AllocFromStack[%s]: Out of memory!", Stack->Name);
 	}
 
@@ -111,305 +559,2763 @@ PopStack(memory_stack *Stack) {
 
 	EnterTicketMutex(&Stack->Mutex);
 
+	Assert(Stack->NumTemporaryScopes == 0);
+
 	uptr Size = *((uptr *)(Stack->Piece.Base + Stack->Mark - sizeof(uptr)));
 	uptr RealSize = Size + sizeof(uptr);
 
 	Stack->Mark -= RealSize;
+	Stack->NumAllocations--;
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFree(&Stack->Telemetry);
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Pop, 0, 0, 0);
+#endif
 
 	LeaveTicketMutex(&Stack->Mutex);
 }
 
-inline memory_pool_block *
-GetBlockByIndex(memory_pool *Pool, u32 Index) {
-	Assert(Pool);
-	return (memory_pool_block *)(Pool->Piece.Base + ((sizeof(memory_pool_block) + Pool->BlockSize) * Index));
+temporary_memory
+BeginTemporaryMemory(memory_stack *Stack) {
+	Assert(Stack);
+
+	temporary_memory Result = {};
+
+	EnterTicketMutex(&Stack->Mutex);
+
+	Result.Stack = Stack;
+	Result.Mark = Stack->Mark;
+	Result.NumAllocations = Stack->NumAllocations;
+	Result.Depth = ++Stack->NumTemporaryScopes;
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_BeginScope, 0, 0, 0);
+#endif
+
+	LeaveTicketMutex(&Stack->Mutex);
+
+	return Result;
 }
 
-inline memory_pool_block *
-GetBlockByData(void *Data) {
-	Assert(Data);
-	return (memory_pool_block *)((u8 *)Data - sizeof(memory_pool_block));
+void
+EndTemporaryMemory(temporary_memory TempMemory) {
+	memory_stack *Stack = TempMemory.Stack;
+	Assert(Stack);
+
+	EnterTicketMutex(&Stack->Mutex);
+
+	// NOTE(ivan): Scopes must be closed in reverse order, and nothing below the scope's mark
+	// can be popped while the scope is open.
+	Assert(Stack->NumTemporaryScopes == TempMemory.Depth);
+	Assert(Stack->Mark >= TempMemory.Mark);
+	Assert(Stack->NumAllocations >= TempMemory.NumAllocations);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFrees(&Stack->Telemetry, Stack->NumAllocations - TempMemory.NumAllocations);
+#endif
+
+	Stack->Mark = TempMemory.Mark;
+	Stack->NumAllocations = TempMemory.NumAllocations;
+	Stack->NumTemporaryScopes--;
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_EndScope, 0, 0, 0);
+#endif
+
+	LeaveTicketMutex(&Stack->Mutex);
 }
 
+// NOTE(ivan): Returns the address of Size bytes that are Offset bytes away from a given end of a double-ended stack.
 inline u8 *
-GetBlockData(memory_pool_block *Block) {
-	Assert(Block);
-	return ((u8 *)Block + sizeof(memory_pool_block));
+GetDoubleStackRange(memory_double_stack *Stack, memory_stack_end End, uptr Offset, uptr Size) {
+	Assert(Stack);
+	Assert((Offset + Size) <= Stack->Piece.Size);
+
+	if (End == MemoryStackEnd_Low)
+		return Stack->Piece.Base + Offset;
+	return Stack->Piece.Base + Stack->Piece.Size - Offset - Size;
 }
 
-u32
-CreateMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, u32 SizePercentage) {
-	Assert(Pool);
-	Assert(Name);
-	Assert(BlockSize);
-	Assert(SizePercentage);
+inline memory_stack_end
+GetOtherStackEnd(memory_stack_end End) {
+	return (End == MemoryStackEnd_Low) ? MemoryStackEnd_High : MemoryStackEnd_Low;
+}
 
-	u32 Result = 0;
+// NOTE(ivan): Makes sure that the first Size bytes from a given end are committed. Pages already committed
+// by the other end are not committed again, they stay owned by the other end.
+static b32
+CommitDoubleStackMemory(memory_double_stack *Stack, memory_stack_end End, uptr Size) {
+	Assert(Stack);
 
-	EnterTicketMutex(&Pool->Mutex);
+	if (Size <= Stack->CommittedSizes[End])
+		return true;
 
-	uptr Size = CalculateGameMemorySizeByPercent(SizePercentage);
-	uptr FullBlockSize = sizeof(memory_pool_block) + BlockSize;
-	u32 BlocksInSize = (u32)(Size / FullBlockSize);
-	u32 BlocksToAlloc = BlocksInSize + ((Size % FullBlockSize) ? 1 : 0);
-	uptr SizeToAlloc = FullBlockSize * BlocksToAlloc;
+	uptr PageSize = GameState.PlatformAPI->PageSize;
+	uptr NewCommittedSize = Min(AlignPow2(Size, Max((uptr)MEMORY_COMMIT_GRANULARITY, PageSize)),
+								Stack->Piece.Size - Stack->CommittedSizes[GetOtherStackEnd(End)]);
+	if (NewCommittedSize > Stack->CommittedSizes[End]) {
+		uptr CommitSize = NewCommittedSize - Stack->CommittedSizes[End];
+		if (!CommitGameMemory(GetDoubleStackRange(Stack, End, Stack->CommittedSizes[End], CommitSize), CommitSize))
+			return false;
 
-	Pool->Piece.Base = EatGameMemory(SizeToAlloc);
-	if (Pool->Piece.Base) {
-		Pool->Piece.Size = SizeToAlloc;
-		Pool->BlockSize = BlockSize;
-		Pool->MaxBlocks = BlocksToAlloc;
+		Stack->CommittedSizes[End] = NewCommittedSize;
+	}
 
-		strncpy(Pool->Name, Name, ArraySize(Pool->Name) - 1);
+	return true;
+}
+
+void
+CreateMemoryDoubleStack(memory_double_stack *Stack, const char *Name, uptr Size) {
+	Assert(Stack);
+	Assert(Name);
+
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Stack->Mutex, Name);
+#endif
+
+	EnterTicketMutex(&Stack->Mutex);
 
-		Pool->AllocBlocks = 0;
-		Pool->FreeBlocks = (memory_pool_block *)Pool->Piece.Base;
-		for (u32 Index = 0; Index < Pool->MaxBlocks; Index++) {
-			memory_pool_block *NewBlock = GetBlockByIndex(Pool, Index);
+	Size = AlignPartitionSize(Size);
+	Stack->Piece.Base = Size ? EatGameMemory(Size) : 0;
+	if (Stack->Piece.Base) {
+		strncpy(Stack->Name, Name, ArraySize(Stack->Name) - 1);
 
-			if (Index > 0)
-				NewBlock->PrevBlock = GetBlockByIndex(Pool, Index - 1);
-			if (Index < (Pool->MaxBlocks - 1))
-				NewBlock->NextBlock = GetBlockByIndex(Pool, Index + 1);
+		Stack->Piece.Size = Size;
+		for (u32 End = 0; End < MemoryStackEnd_MaxCount; End++) {
+			Stack->Marks[End] = 0;
+			Stack->HighWaterMarks[End] = 0;
+			Stack->CommittedSizes[End] = 0;
+			Stack->NumAllocations[End] = 0;
 		}
 
-		Pool->NumAllocBlocks = 0;
-		Pool->NumFreeBlocks = Pool->MaxBlocks;
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Stack->Telemetry, MemoryPartitionType_DoubleStack, Name, Size, 0, 0, 0);
+#endif
 	} else {
-		GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Out of memory!", Name);
+		GameState.PlatformAPI->Crashf("CreateMemoryDoubleStack[%s]: Out of memory!", Name);
 	}
 
-	Result = GetFreeGameMemorySizePercentage();
-	
-	LeaveTicketMutex(&Pool->Mutex);
-
-	return Result;
+	LeaveTicketMutex(&Stack->Mutex);
 }
 
 void
-ResetMemoryPool(memory_pool *Pool) {
-	Assert(Pool);
+ResetMemoryDoubleStack(memory_double_stack *Stack, memory_stack_end End, u32 Flags) {
+	Assert(Stack);
+	Assert(End < MemoryStackEnd_MaxCount);
 
-	EnterTicketMutex(&Pool->Mutex);
-	
-	Pool->AllocBlocks = 0;
-	Pool->FreeBlocks = GetBlockByIndex(Pool, 0);
-	for (u32 Index = 0; Index < Pool->MaxBlocks; Index++) {
-		memory_pool_block *NewBlock = GetBlockByIndex(Pool, Index);
-		
-		if (Index > 0)
-			NewBlock->PrevBlock = GetBlockByIndex(Pool, Index - 1);
-		if (Index < (Pool->MaxBlocks - 1))
-			NewBlock->NextBlock = GetBlockByIndex(Pool, Index + 1);
+	EnterTicketMutex(&Stack->Mutex);
 
-		u8 *NewData = GetBlockData(NewBlock);
-		memset(NewData, 0, Pool->BlockSize);
+	Assert(Stack->NumTemporaryScopes[End] == 0);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFrees(&Stack->Telemetry, Stack->NumAllocations[End]);
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags | (End << MEMORY_TRACE_END_SHIFT));
+#endif
+
+	memory_stack_end OtherEnd = GetOtherStackEnd(End);
+	Stack->Marks[End] = 0;
+	Stack->NumAllocations[End] = 0;
+
+	if (Flags & MemoryFlag_Zero) {
+		uptr DirtySize = Stack->HighWaterMarks[End];
+		if (DirtySize >= MEMORY_PURGE_THRESHOLD) {
+			// NOTE(ivan): Pages the other end lives in are kept and handed over to the other end,
+			// the rest of the end's pages are given back to the OS.
+			uptr PageSize = Max(GameState.PlatformAPI->PageSize, (uptr)1);
+			uptr ReleaseSize = Min(Stack->CommittedSizes[End],
+								   (Stack->Piece.Size - Stack->Marks[OtherEnd]) & ~(PageSize - 1));
+			if (ReleaseSize) {
+				DecommitGameMemory(GetDoubleStackRange(Stack, End, 0, ReleaseSize), ReleaseSize);
+				Stack->HighWaterMarks[OtherEnd] = Min(Stack->HighWaterMarks[OtherEnd], Stack->Piece.Size - ReleaseSize);
+			}
+			if (ReleaseSize < Stack->CommittedSizes[End])
+				Stack->CommittedSizes[OtherEnd] = Stack->Piece.Size - ReleaseSize;
+			Stack->CommittedSizes[End] = 0;
+
+			if (DirtySize > ReleaseSize)
+				memset(GetDoubleStackRange(Stack, End, ReleaseSize, DirtySize - ReleaseSize), 0, DirtySize - ReleaseSize);
+		} else if (DirtySize) {
+			memset(GetDoubleStackRange(Stack, End, 0, DirtySize), 0, DirtySize);
+		}
+
+		Stack->HighWaterMarks[End] = 0;
 	}
-	
-	Pool->NumAllocBlocks = 0;
-	Pool->NumFreeBlocks = Pool->MaxBlocks;
 
-	LeaveTicketMutex(&Pool->Mutex);
+	LeaveTicketMutex(&Stack->Mutex);
 }
 
 void *
-AllocFromPool(memory_pool *Pool) {
-	Assert(Pool);
+AllocFromDoubleStackTagged(memory_double_stack *Stack, memory_stack_end End, uptr Size, u32 Flags,
+						   const char *File, u32 Line) {
+	Assert(Stack);
+	Assert(End < MemoryStackEnd_MaxCount);
+	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
 
 	void *Result = 0;
-	
-	EnterTicketMutex(&Pool->Mutex);
 
-	memory_pool_block *TargetBlock = Pool->FreeBlocks;
-	if (TargetBlock) {
-		if (TargetBlock->PrevBlock)
-			TargetBlock->PrevBlock->NextBlock = TargetBlock->NextBlock;
-		if (TargetBlock->NextBlock)
-			TargetBlock->NextBlock->PrevBlock = TargetBlock->PrevBlock;
-		Pool->FreeBlocks = TargetBlock->NextBlock;
-		Pool->NumFreeBlocks--;
-		
-		if (Pool->AllocBlocks)
-			Pool->AllocBlocks->PrevBlock = TargetBlock;
-		TargetBlock->NextBlock = Pool->AllocBlocks;
-		TargetBlock->PrevBlock = 0;
-		Pool->AllocBlocks = TargetBlock;
-		Pool->NumAllocBlocks++;
-
-		Result = GetBlockData(TargetBlock);
-		memset(Result, 0, Pool->BlockSize);
+	EnterTicketMutex(&Stack->Mutex);
+
+	// NOTE(ivan): Both ends of the partition are page-aligned, so aligning the offset from the end aligns the address:
+	// the low end aligns the allocation's start, the high end aligns the allocation's end that is its start from that side.
+	memory_stack_end OtherEnd = GetOtherStackEnd(End);
+	uptr Alignment = GetMemoryFlagsAlignment(Flags);
+	uptr AlignedSize = Align8(Size);
+	uptr NewMark;
+	if (End == MemoryStackEnd_Low)
+		NewMark = AlignPow2(Stack->Marks[End], Alignment) + AlignedSize;
+	else
+		NewMark = AlignPow2(Stack->Marks[End] + AlignedSize, Alignment);
+
+	if ((NewMark <= (Stack->Piece.Size - Stack->Marks[OtherEnd])) &&
+		CommitDoubleStackMemory(Stack, End, NewMark)) {
+		Result = GetDoubleStackRange(Stack, End, NewMark - AlignedSize, AlignedSize);
+		Stack->Marks[End] = NewMark;
+		Stack->HighWaterMarks[End] = Max(Stack->HighWaterMarks[End], NewMark);
+		Stack->NumAllocations[End]++;
+
+		// NOTE(ivan): The other end's dirty bytes that are taken over are not its concern anymore.
+		Stack->HighWaterMarks[OtherEnd] = Min(Stack->HighWaterMarks[OtherEnd], Stack->Piece.Size - NewMark);
+
+		if (Flags & MemoryFlag_Zero)
+			memset(Result, 0, AlignedSize);
+
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Stack->Telemetry, Size, Stack->Marks[MemoryStackEnd_Low] + Stack->Marks[MemoryStackEnd_High],
+						  File, Line);
+		RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Size, Flags | (End << MEMORY_TRACE_END_SHIFT));
+#endif
 	} else {
-		GameState.PlatformAPI->Outf("AllocFromPool[%s]: Out of memory!", Pool->Name);
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Stack->Telemetry, File, Line);
+		RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags | (End << MEMORY_TRACE_END_SHIFT));
+#endif
+		GameState.PlatformAPI->Outf("AllocFromDoubleStack[%s]: Out of memory!", Stack->Name);
 	}
-	
-	LeaveTicketMutex(&Pool->Mutex);
+
+	LeaveTicketMutex(&Stack->Mutex);
+
+	return Result;
+}
+
+double_stack_temporary_memory
+BeginDoubleStackTemporaryMemory(memory_double_stack *Stack, memory_stack_end End) {
+	Assert(Stack);
+	Assert(End < MemoryStackEnd_MaxCount);
+
+	double_stack_temporary_memory Result = {};
+
+	EnterTicketMutex(&Stack->Mutex);
+
+	Result.Stack = Stack;
+	Result.End = End;
+	Result.Mark = Stack->Marks[End];
+	Result.NumAllocations = Stack->NumAllocations[End];
+	Result.Depth = ++Stack->NumTemporaryScopes[End];
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_BeginScope, 0, 0, End << MEMORY_TRACE_END_SHIFT);
+#endif
+
+	LeaveTicketMutex(&Stack->Mutex);
 
 	return Result;
 }
 
 void
-FreeFromPool(memory_pool *Pool, void *Base) {
-	Assert(Pool);
-	Assert(Base);
+EndDoubleStackTemporaryMemory(double_stack_temporary_memory TempMemory) {
+	memory_double_stack *Stack = TempMemory.Stack;
+	Assert(Stack);
 
-	EnterTicketMutex(&Pool->Mutex);
+	EnterTicketMutex(&Stack->Mutex);
 
-	memory_pool_block *Block = GetBlockByData(Base);
+	Assert(Stack->NumTemporaryScopes[TempMemory.End] == TempMemory.Depth);
+	Assert(Stack->Marks[TempMemory.End] >= TempMemory.Mark);
+	Assert(Stack->NumAllocations[TempMemory.End] >= TempMemory.NumAllocations);
 
-	if (Block->NextBlock)
-		Block->NextBlock->PrevBlock = Block->PrevBlock;
-	if (Block->PrevBlock)
-		Block->PrevBlock->NextBlock = Block->NextBlock;
-	Pool->NumAllocBlocks--;
+#if MEMORY_TELEMETRY
+	RecordMemoryFrees(&Stack->Telemetry, Stack->NumAllocations[TempMemory.End] - TempMemory.NumAllocations);
+#endif
 
-	if (Pool->FreeBlocks)
-		Pool->FreeBlocks->PrevBlock = Block;
-	Block->NextBlock = Pool->AllocBlocks;
-	Block->PrevBlock = 0;
-	Pool->FreeBlocks = Block;
-	Pool->NumFreeBlocks++;
+	Stack->Marks[TempMemory.End] = TempMemory.Mark;
+	Stack->NumAllocations[TempMemory.End] = TempMemory.NumAllocations;
+	Stack->NumTemporaryScopes[TempMemory.End]--;
 
-	LeaveTicketMutex(&Pool->Mutex);
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Stack->Telemetry, MemoryTraceOp_EndScope, 0, 0, TempMemory.End << MEMORY_TRACE_END_SHIFT);
+#endif
+
+	LeaveTicketMutex(&Stack->Mutex);
 }
 
-u32
-CreateMemoryHeap(memory_heap *Heap, const char *Name, u32 SizePercentage) {
-	Assert(Heap);
+void
+CreateMemoryFrameArena(memory_frame_arena *Arena, const char *Name, u32 NumBuffers, uptr Size) {
+	Assert(Arena);
 	Assert(Name);
-	Assert(SizePercentage);
+	Assert(NumBuffers && NumBuffers <= MAX_MEMORY_FRAME_ARENA_BUFFERS);
 
-	u32 Result = 0;
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Arena->Mutex, Name);
+#endif
 
-	EnterTicketMutex(&Heap->Mutex);
+	EnterTicketMutex(&Arena->Mutex);
 
-	uptr Size = CalculateGameMemorySizeByPercent(SizePercentage);
-	Heap->Piece.Base = EatGameMemory(Size);
-	if (Heap->Piece.Base) {
-		Heap->Piece.Size = Size;
+	// NOTE(ivan): Each buffer is page-aligned, so it can be committed and decommitted on its own.
+	uptr BufferSize = AlignPartitionSize(Size / NumBuffers);
 
-		strncpy(Heap->Name, Name, ArraySize(Heap->Name) - 1);
+	Arena->Piece.Base = BufferSize ? EatGameMemory(BufferSize * NumBuffers) : 0;
+	if (Arena->Piece.Base) {
+		strncpy(Arena->Name, Name, ArraySize(Arena->Name) - 1);
+
+		Arena->Piece.Size = BufferSize * NumBuffers;
+		Arena->BufferSize = BufferSize;
+		Arena->NumBuffers = NumBuffers;
+		Arena->CurrentBuffer = 0;
+		Arena->Mark = 0;
 
-		memory_heap_block *EntireBlock = (memory_heap_block *)Heap->Piece.Base;
-		EntireBlock->Size = Heap->Piece.Size - sizeof(memory_heap_block);
-		EntireBlock->IsFree = true;
-		EntireBlock->NextBlock = 0;
-		EntireBlock->PrevBlock = 0;
+		for (u32 Index = 0; Index < MAX_MEMORY_FRAME_ARENA_BUFFERS; Index++) {
+			Arena->CommittedSizes[Index] = 0;
+			Arena->DirtySizes[Index] = 0;
+		}
 
-		Heap->Blocks = EntireBlock;
-		Heap->NumBlocks = 0;
-		Heap->UsedSize = 0;
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Arena->Telemetry, MemoryPartitionType_FrameArena, Name, Arena->Piece.Size, 0, NumBuffers, 0);
+#endif
 	} else {
-		GameState.PlatformAPI->Crashf("CreateMemoryHeap[%s]: Out of memory!", Name);
+		GameState.PlatformAPI->Crashf("CreateMemoryFrameArena[%s]: Out of memory!", Name);
 	}
 
-	Result = GetFreeGameMemorySizePercentage();
+	LeaveTicketMutex(&Arena->Mutex);
+}
+
+inline piece
+GetFrameArenaBuffer(memory_frame_arena *Arena, u32 Index) {
+	Assert(Arena);
+	Assert(Index < Arena->NumBuffers);
+
+	piece Result;
+	Result.Base = Arena->Piece.Base + (Arena->BufferSize * Index);
+	Result.Size = Arena->BufferSize;
 
-	LeaveTicketMutex(&Heap->Mutex);
-	
 	return Result;
 }
 
 void
-ResetMemoryHeap(memory_heap *Heap) {
-	Assert(Heap);
+AdvanceFrameArena(memory_frame_arena *Arena, u32 Flags) {
+	Assert(Arena);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Arena->Telemetry, MemoryTraceOp_Advance, 0, 0, Flags);
+#endif
+
+	// NOTE(ivan): Remember how much of the buffer being left has been used, it gets cleared
+	// only when it becomes current again and the caller asks for zeroing.
+	u32 Current = Arena->CurrentBuffer;
+	Arena->DirtySizes[Current] = Max(Arena->DirtySizes[Current],
+									 Min((uptr)Arena->Mark, (uptr)Arena->CommittedSizes[Current]));
+
+	u32 Next = (Current + 1) % Arena->NumBuffers;
+	if ((Flags & MemoryFlag_Zero) && Arena->DirtySizes[Next]) {
+		piece Buffer = GetFrameArenaBuffer(Arena, Next);
+		ClearPartitionMemory(&Buffer, &Arena->CommittedSizes[Next], Arena->DirtySizes[Next]);
+		Arena->DirtySizes[Next] = 0;
+	}
 
-	EnterTicketMutex(&Heap->Mutex);
+	Arena->CurrentBuffer = Next;
+	Arena->Mark = 0;
+}
 
-	memory_heap_block *EntireBlock = (memory_heap_block *)Heap->Piece.Base;
+void *
+AllocFromFrameArenaTagged(memory_frame_arena *Arena, uptr Size, u32 Flags, const char *File, u32 Line) {
+	Assert(Arena);
+	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	void *Result = 0;
+
+	Size = Align8(Size);
+	u32 Current = Arena->CurrentBuffer;
+
+	// NOTE(ivan): Bump the mark only if the allocation fits, so a failed large allocation
+	// does not leave the rest of the buffer unusable. Buffers are page-aligned, so an aligned offset is an aligned address.
+	u64 Alignment = GetMemoryFlagsAlignment(Flags);
+	u64 End = 0;
+	u64 Mark = Arena->Mark;
+	for (;;) {
+		u64 Start = AlignPow2(Mark, Alignment);
+		if ((Start + Size) > Arena->BufferSize)
+			break;
+
+		u64 OldMark = AtomicCompareExchangeU64(&Arena->Mark, Start + Size, Mark);
+		if (OldMark == Mark) {
+			End = Start + Size;
+			break;
+		}
+		Mark = OldMark;
+	}
+
+	if (End) {
+		if (End <= Arena->CommittedSizes[Current]) {
+			Result = Arena->Piece.Base + (Arena->BufferSize * Current) + (End - Size);
+		} else {
+			EnterTicketMutex(&Arena->Mutex);
+
+			piece Buffer = GetFrameArenaBuffer(Arena, Current);
+			if (CommitPartitionMemory(&Buffer, &Arena->CommittedSizes[Current], (uptr)End))
+				Result = Buffer.Base + (End - Size);
+
+			LeaveTicketMutex(&Arena->Mutex);
+		}
+	}
+
+	if (Result) {
+		if (Flags & MemoryFlag_Zero)
+			memset(Result, 0, Size);
+
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Arena->Telemetry, Size, End, File, Line);
+		RecordMemoryTrace(&Arena->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Size, Flags);
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Arena->Telemetry, File, Line);
+		RecordMemoryTrace(&Arena->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromFrameArena[%s]: Out of memory!", Arena->Name);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Index of the first block of growable pool's first chunk.
+inline u32
+GetPoolFirstChunkBlockIndex(memory_pool *Pool) {
+	Assert(Pool);
+	return Pool->NumPrimaryBitmapWords * 64;
+}
+
+inline u8 *
+GetPoolBlockByIndex(memory_pool *Pool, u32 Index) {
+	Assert(Pool);
+
+	if (Index < Pool->MaxBlocks)
+		return Pool->Piece.Base + (Pool->BlockSize * Index);
+
+	Assert(Index >= GetPoolFirstChunkBlockIndex(Pool));
+	u32 ChunkBlockIndex = Index - GetPoolFirstChunkBlockIndex(Pool);
+	u32 ChunkIndex = ChunkBlockIndex / Pool->BlocksPerChunk;
+	Assert(ChunkIndex < MAX_MEMORY_POOL_CHUNKS);
+	Assert(Pool->Chunks[ChunkIndex]);
+
+	return Pool->Chunks[ChunkIndex] + (Pool->BlockSize * (ChunkBlockIndex % Pool->BlocksPerChunk));
+}
+
+inline u32
+GetPoolBlockIndex(memory_pool *Pool, void *Data) {
+	Assert(Pool);
+	Assert(Data);
+
+	uptr Offset = (uptr)((u8 *)Data - Pool->Piece.Base);
+	if (Offset < Pool->Piece.Size) {
+		Assert((Offset % Pool->BlockSize) == 0);
+		return (u32)(Offset / Pool->BlockSize);
+	}
+
+	// NOTE(ivan): Not in the partition, look up the chunk that contains the block.
+	uptr ChunkSize = Pool->BlockSize * Pool->BlocksPerChunk;
+	for (u32 ChunkIndex = 0; ChunkIndex < Pool->NumChunks; ChunkIndex++) {
+		Offset = (uptr)((u8 *)Data - Pool->Chunks[ChunkIndex]);
+		if (Offset < ChunkSize) {
+			Assert((Offset % Pool->BlockSize) == 0);
+			return GetPoolFirstChunkBlockIndex(Pool) + ChunkIndex * Pool->BlocksPerChunk + (u32)(Offset / Pool->BlockSize);
+		}
+	}
+
+	Assert(!"Block does not belong to the pool!");
+	return 0;
+}
+
+inline void
+InitMemoryPoolBlocks(memory_pool *Pool) {
+	Assert(Pool);
+
+	// NOTE(ivan): Only the words that cover carved blocks might be dirty. Bits past the last block
+	// are kept set, so they never look free.
+	if (Pool->Bitmap) {
+		u32 NumDirtyWords = Min((Pool->NumCarvedBlocks + 63) / 64 + 1, Pool->NumPrimaryBitmapWords);
+		memset((void *)Pool->Bitmap, 0, sizeof(u64) * NumDirtyWords);
+		if (Pool->MaxBlocks % 64)
+			Pool->Bitmap[Pool->NumPrimaryBitmapWords - 1] = ~(u64)0 << (Pool->MaxBlocks % 64);
+
+		// NOTE(ivan): Give all chunks back, their words get full again.
+		if (Pool->PoolFlags & MemoryPoolFlag_Growable) {
+			for (u32 ChunkIndex = 0; ChunkIndex < Pool->NumChunks; ChunkIndex++) {
+				FreeFromHeap(Pool->ParentHeap, Pool->Chunks[ChunkIndex]);
+				Pool->Chunks[ChunkIndex] = 0;
+			}
+			Pool->NumChunks = 0;
+
+			memset((void *)(Pool->Bitmap + Pool->NumPrimaryBitmapWords), 0xFF,
+				   sizeof(u64) * (Pool->BlocksPerChunk / 64) * MAX_MEMORY_POOL_CHUNKS);
+		}
+
+		Pool->NumBitmapWords = Pool->NumPrimaryBitmapWords;
+		Pool->BitmapHint = 0;
+	}
+
+	Pool->FreeHead = 0;
+	Pool->NumCarvedBlocks = 0;
+	Pool->NumAllocBlocks = 0;
+
+	if (Pool->Magazines)
+		memset(Pool->Magazines, 0, Pool->MagazineStride * MAX_MEMORY_POOL_THREADS);
+}
+
+// NOTE(ivan): Pops up to NumBlocks blocks off the shared free stack with one exchange,
+// and carves never used blocks if the stack has not got enough. Returns the count of blocks popped.
+static u32
+PopPoolBlocks(memory_pool *Pool, u8 **Blocks, u32 NumBlocks) {
+	Assert(Pool);
+	Assert(Blocks);
+	Assert(NumBlocks);
+
+	u32 Result = 0;
+
+	u64 Head = Pool->FreeHead;
+	while ((u32)Head) {
+		// NOTE(ivan): The blocks might be popped and overwritten by another thread while the chain is being
+		// followed, in that case the tag will not match and the exchange below will fail. An overwritten link
+		// might hold any value though, so an index past the carved blocks is never followed.
+		u32 NumPopped = 0;
+		u32 NextIndex = (u32)Head;
+		while (NextIndex && NumPopped < NumBlocks) {
+			if (NextIndex > Pool->NumCarvedBlocks)
+				break;
+
+			u8 *Block = GetPoolBlockByIndex(Pool, NextIndex - 1);
+			Blocks[NumPopped++] = Block;
+			NextIndex = *((volatile u32 *)Block);
+		}
+
+		if (NextIndex > Pool->NumCarvedBlocks) {
+			Head = Pool->FreeHead;
+			continue;
+		}
+
+		u64 NewHead = ((((Head >> 32) + 1) << 32) | NextIndex);
+		u64 PrevHead = AtomicCompareExchangeU64(&Pool->FreeHead, NewHead, Head);
+		if (PrevHead == Head) {
+			Result = NumPopped;
+			break;
+		}
+
+		Head = PrevHead;
+	}
+
+	// NOTE(ivan): Free stack has run dry, carve never used blocks.
+	if (Result < NumBlocks) {
+		u32 NumCarvedBlocks = Pool->NumCarvedBlocks;
+		while (NumCarvedBlocks < Pool->MaxBlocks) {
+			u32 NumToCarve = Min(NumBlocks - Result, Pool->MaxBlocks - NumCarvedBlocks);
+
+			// NOTE(ivan): The blocks' pages are committed before the blocks are carved, so a failed commit
+			// carves nothing and no block index is lost. Pages committed for a carve that then loses the race
+			// are used by the next carve.
+			uptr BlocksEnd = Pool->BlockSize * (NumCarvedBlocks + NumToCarve);
+			if (BlocksEnd > Pool->CommittedSize) {
+				EnterTicketMutex(&Pool->Mutex);
+				b32 IsCommitted = CommitPartitionMemory(&Pool->Piece, &Pool->CommittedSize, BlocksEnd);
+				LeaveTicketMutex(&Pool->Mutex);
+
+				if (!IsCommitted)
+					break;
+			}
+
+			u32 PrevNumCarvedBlocks = AtomicCompareExchangeU32(&Pool->NumCarvedBlocks,
+															   NumCarvedBlocks + NumToCarve, NumCarvedBlocks);
+			if (PrevNumCarvedBlocks == NumCarvedBlocks) {
+				for (u32 Index = 0; Index < NumToCarve; Index++)
+					Blocks[Result++] = GetPoolBlockByIndex(Pool, NumCarvedBlocks + Index);
+				break;
+			}
+
+			NumCarvedBlocks = PrevNumCarvedBlocks;
+		}
+	}
+
+	if (Result)
+		AtomicAddU32(&Pool->NumAllocBlocks, Result);
+
+	return Result;
+}
+
+// NOTE(ivan): Commits pages up to the end of a given block, and raises the carved blocks count to cover it.
+// Chunk blocks live in the parent heap's memory that is committed already.
+static b32
+CommitPoolBitmapBlock(memory_pool *Pool, u32 Index) {
+	Assert(Pool);
+
+	if (Index >= Pool->MaxBlocks)
+		return true;
+
+	uptr BlockEnd = Pool->BlockSize * (Index + 1);
+	if (BlockEnd > Pool->CommittedSize) {
+		EnterTicketMutex(&Pool->Mutex);
+		b32 IsCommitted = CommitPartitionMemory(&Pool->Piece, &Pool->CommittedSize, BlockEnd);
+		LeaveTicketMutex(&Pool->Mutex);
+
+		if (!IsCommitted)
+			return false;
+	}
+
+	u32 NumCarvedBlocks = Pool->NumCarvedBlocks;
+	while (NumCarvedBlocks < (Index + 1)) {
+		u32 PrevNumCarvedBlocks = AtomicCompareExchangeU32(&Pool->NumCarvedBlocks, Index + 1, NumCarvedBlocks);
+		if (PrevNumCarvedBlocks == NumCarvedBlocks)
+			break;
+
+		NumCarvedBlocks = PrevNumCarvedBlocks;
+	}
+
+	return true;
+}
+
+inline void
+ReleasePoolBitmapBlock(memory_pool *Pool, u32 Index) {
+	Assert(Pool);
+	Assert((Index / 64) < Pool->NumBitmapWords);
+
+	u32 WordIndex = Index / 64;
+	u64 Bit = (u64)1 << (Index % 64);
+
+	u64 Word = Pool->Bitmap[WordIndex];
+	while (true) {
+		Assert(Word & Bit);
+
+		u64 PrevWord = AtomicCompareExchangeU64(&Pool->Bitmap[WordIndex], Word & ~Bit, Word);
+		if (PrevWord == Word)
+			break;
+
+		Word = PrevWord;
+	}
+
+	// NOTE(ivan): Let the next search start at the freed block's word.
+	u32 Hint = Pool->BitmapHint;
+	while (WordIndex < Hint) {
+		u32 PrevHint = AtomicCompareExchangeU32(&Pool->BitmapHint, WordIndex, Hint);
+		if (PrevHint == Hint)
+			break;
+
+		Hint = PrevHint;
+	}
+}
+
+// NOTE(ivan): Claims up to NumBlocks lowest free blocks, scanning the bitmap a 64-bit word at a time
+// from the hint, and claiming as many bits of a word as needed with one exchange. Returns the count of blocks claimed.
+static u32
+ClaimPoolBitmapBlocks(memory_pool *Pool, u8 **Blocks, u32 NumBlocks) {
+	Assert(Pool);
+	Assert(Pool->Bitmap);
+	Assert(Blocks);
+	Assert(NumBlocks);
+
+	u32 Result = 0;
+
+	// NOTE(ivan): Words past NumBitmapWords belong to unlinked chunks and are kept full,
+	// so a stale words count is harmless.
+	u32 NumBitmapWords = Pool->NumBitmapWords;
+	u32 FirstWordIndex = Min((u32)Pool->BitmapHint, NumBitmapWords);
+	u32 WordIndex = FirstWordIndex;
+	while (Result < NumBlocks) {
+		// NOTE(ivan): A block freed below the hint while the hint was being raised could be missed,
+		// so give the bitmap one more pass from the start before reporting that the pool is full.
+		if (WordIndex >= NumBitmapWords) {
+			if (!FirstWordIndex)
+				break;
+
+			FirstWordIndex = 0;
+			WordIndex = 0;
+			continue;
+		}
+
+		u64 Word = Pool->Bitmap[WordIndex];
+		if (Word == ~(u64)0) {
+			WordIndex++;
+			continue;
+		}
+
+		u64 ClaimedBits = 0;
+		u64 FreeBits = ~Word;
+		for (u32 NumClaimed = Result; FreeBits && NumClaimed < NumBlocks; NumClaimed++) {
+			ClaimedBits |= (FreeBits & (0 - FreeBits));
+			FreeBits &= (FreeBits - 1);
+		}
+
+		u64 NewWord = Word | ClaimedBits;
+		if (AtomicCompareExchangeU64(&Pool->Bitmap[WordIndex], NewWord, Word) != Word)
+			continue;
+
+		if (NewWord == ~(u64)0)
+			AtomicCompareExchangeU32(&Pool->BitmapHint, WordIndex + 1, WordIndex);
+
+		u32 LastIndex = WordIndex * 64 + FindMostSignificantBit64(ClaimedBits).Index;
+		if (!CommitPoolBitmapBlock(Pool, LastIndex)) {
+			for (u64 Bits = ClaimedBits; Bits; Bits &= (Bits - 1))
+				ReleasePoolBitmapBlock(Pool, WordIndex * 64 + FindLeastSignificantBit64(Bits).Index);
+			break;
+		}
+
+		for (u64 Bits = ClaimedBits; Bits; Bits &= (Bits - 1))
+			Blocks[Result++] = GetPoolBlockByIndex(Pool, WordIndex * 64 + FindLeastSignificantBit64(Bits).Index);
+		WordIndex++;
+	}
+
+	if (Result)
+		AtomicAddU32(&Pool->NumAllocBlocks, Result);
+
+	return Result;
+}
+
+// NOTE(ivan): Links one more chunk to a growable pool. Returns false if the pool cannot grow,
+// true if it has grown, also if another thread has grown it since the caller saw NumChunksSeen chunks.
+static b32
+GrowMemoryPool(memory_pool *Pool, u32 NumChunksSeen) {
+	Assert(Pool);
+	Assert(Pool->PoolFlags & MemoryPoolFlag_Growable);
+
+	b32 Result = false;
+
+	EnterTicketMutex(&Pool->Mutex);
+
+	if (Pool->NumChunks != NumChunksSeen) {
+		Result = true;
+	} else if (Pool->NumChunks < MAX_MEMORY_POOL_CHUNKS) {
+		// NOTE(ivan): Chunks are cache line aligned, so their blocks are aligned as well as the partition's ones.
+		u8 *Chunk = (u8 *)AllocFromHeap(Pool->ParentHeap, Pool->BlockSize * Pool->BlocksPerChunk, MemoryFlag_Align64);
+		if (Chunk) {
+			u32 ChunkIndex = Pool->NumChunks;
+			u32 NumChunkWords = Pool->BlocksPerChunk / 64;
+			u32 FirstWordIndex = Pool->NumPrimaryBitmapWords + ChunkIndex * NumChunkWords;
+
+			// NOTE(ivan): The chunk must be visible before its words get free.
+			Pool->Chunks[ChunkIndex] = Chunk;
+			CompleteWritesBeforeFutureWrites();
+
+			for (u32 WordIndex = FirstWordIndex; WordIndex < (FirstWordIndex + NumChunkWords); WordIndex++)
+				Pool->Bitmap[WordIndex] = 0;
+
+			Pool->NumBitmapWords = FirstWordIndex + NumChunkWords;
+			Pool->NumChunks = ChunkIndex + 1;
+
+			Result = true;
+		}
+	}
+
+	LeaveTicketMutex(&Pool->Mutex);
+
+	return Result;
+}
+
+// NOTE(ivan): Tells without taking the mutex whether the tail chunk looks empty and the rest of the pool
+// has at least half a chunk of free blocks. The rest of the pool being nearly full keeps the chunk,
+// so the pool does not link and release the same chunk over and over.
+inline b32
+CanShrinkMemoryPool(memory_pool *Pool) {
+	Assert(Pool);
+
+	u32 NumChunks = Pool->NumChunks;
+	if (!NumChunks)
+		return false;
+
+	u32 RestCapacity = Pool->MaxBlocks + (NumChunks - 1) * Pool->BlocksPerChunk;
+	if ((Pool->NumAllocBlocks + Pool->BlocksPerChunk / 2) > RestCapacity)
+		return false;
+
+	u32 NumChunkWords = Pool->BlocksPerChunk / 64;
+	u32 FirstWordIndex = Pool->NumPrimaryBitmapWords + (NumChunks - 1) * NumChunkWords;
+	for (u32 WordIndex = FirstWordIndex; WordIndex < (FirstWordIndex + NumChunkWords); WordIndex++) {
+		if (Pool->Bitmap[WordIndex])
+			return false;
+	}
+
+	return true;
+}
+
+// NOTE(ivan): Gives empty tail chunks of a growable pool back to the parent heap.
+static void
+ShrinkMemoryPool(memory_pool *Pool) {
+	Assert(Pool);
+	Assert(Pool->PoolFlags & MemoryPoolFlag_Growable);
+
+	EnterTicketMutex(&Pool->Mutex);
+
+	while (CanShrinkMemoryPool(Pool)) {
+		u32 ChunkIndex = Pool->NumChunks - 1;
+
+		// NOTE(ivan): Claim all chunk's blocks at once, so nobody can take one while the chunk is being released.
+		// The chunk is not empty if any of its words is not free, in that case give the claimed words back.
+		u32 NumChunkWords = Pool->BlocksPerChunk / 64;
+		u32 FirstWordIndex = Pool->NumPrimaryBitmapWords + ChunkIndex * NumChunkWords;
+
+		u32 NumClaimedWords = 0;
+		while (NumClaimedWords < NumChunkWords) {
+			if (AtomicCompareExchangeU64(&Pool->Bitmap[FirstWordIndex + NumClaimedWords], ~(u64)0, 0) != 0)
+				break;
+			NumClaimedWords++;
+		}
+		if (NumClaimedWords < NumChunkWords) {
+			for (u32 WordIndex = 0; WordIndex < NumClaimedWords; WordIndex++)
+				Pool->Bitmap[FirstWordIndex + WordIndex] = 0;
+			break;
+		}
+
+		Pool->NumBitmapWords = FirstWordIndex;
+		Pool->NumChunks = ChunkIndex;
+
+		FreeFromHeap(Pool->ParentHeap, Pool->Chunks[ChunkIndex]);
+		Pool->Chunks[ChunkIndex] = 0;
+	}
+
+	LeaveTicketMutex(&Pool->Mutex);
+}
+
+// NOTE(ivan): Pushes a chain of blocks that are already linked to each other, from First to Last, with one exchange.
+inline void
+PushPoolBlocks(memory_pool *Pool, u8 *First, u8 *Last, u32 NumBlocks) {
+	Assert(Pool);
+	Assert(First);
+	Assert(Last);
+	Assert(NumBlocks);
+
+	u32 FirstIndex = GetPoolBlockIndex(Pool, First);
+
+	u64 Head = Pool->FreeHead;
+	while (true) {
+		*((volatile u32 *)Last) = (u32)Head;
+
+		u64 NewHead = ((((Head >> 32) + 1) << 32) | (FirstIndex + 1));
+		u64 PrevHead = AtomicCompareExchangeU64(&Pool->FreeHead, NewHead, Head);
+		if (PrevHead == Head)
+			break;
+
+		Head = PrevHead;
+	}
+
+	AtomicAddU32(&Pool->NumAllocBlocks, (u32)(-(s32)NumBlocks));
+}
+
+// NOTE(ivan): Pool's layout: magazines, bitmap, and blocks, each one in its own page-aligned partition.
+struct memory_pool_layout {
+	uptr MagazineStride;
+	uptr MagazinesSize;
+	u32 NumPrimaryBitmapWords;
+	uptr BitmapSize;
+	uptr BlocksSize;
+};
+
+static memory_pool_layout
+GetMemoryPoolLayout(uptr BlockSize, u32 NumBlocks, u32 MagazineSize, u32 PoolFlags, u32 BlocksPerChunk) {
+	memory_pool_layout Result = {};
+
+	uptr PageSize = Max(GameState.PlatformAPI->PageSize, (uptr)1);
+
+	// NOTE(ivan): Each magazine is placed on its own cache lines.
+	if (MagazineSize && !(PoolFlags & MemoryPoolFlag_Bitmap)) {
+		Result.MagazineStride = AlignPow2((uptr)(sizeof(memory_pool_magazine) + sizeof(u8 *) * MagazineSize),
+										  (uptr)CACHE_LINE_SIZE);
+		Result.MagazinesSize = AlignPow2(Result.MagazineStride * MAX_MEMORY_POOL_THREADS, PageSize);
+	}
+
+	// NOTE(ivan): Growable pool's bitmap also has words for all chunks it might ever link.
+	if (PoolFlags & MemoryPoolFlag_Bitmap) {
+		Result.NumPrimaryBitmapWords = (NumBlocks + 63) / 64;
+		u32 NumChunksBitmapWords = 0;
+		if (PoolFlags & MemoryPoolFlag_Growable)
+			NumChunksBitmapWords = (BlocksPerChunk / 64) * MAX_MEMORY_POOL_CHUNKS;
+		Result.BitmapSize = AlignPow2((uptr)(sizeof(u64) * (Result.NumPrimaryBitmapWords + NumChunksBitmapWords)), PageSize);
+	}
+
+	Result.BlocksSize = AlignPow2(BlockSize * NumBlocks, PageSize);
+
+	return Result;
+}
+
+inline uptr
+GetMemoryPoolLayoutSize(memory_pool_layout *Layout) {
+	Assert(Layout);
+	return Layout->MagazinesSize + Layout->BitmapSize + Layout->BlocksSize;
+}
+
+uptr
+CalculateMemoryPoolSize(uptr BlockSize, u32 NumBlocks, u32 MagazineSize, u32 PoolFlags, u32 BlocksPerChunk) {
+	Assert(BlockSize);
+	Assert(NumBlocks);
+
+	BlockSize = Align8(Max(BlockSize, (uptr)sizeof(u32)));
+	BlocksPerChunk = (u32)AlignPow2((uptr)BlocksPerChunk, (uptr)64);
+
+	memory_pool_layout Layout = GetMemoryPoolLayout(BlockSize, NumBlocks, MagazineSize, PoolFlags, BlocksPerChunk);
+	return GetMemoryPoolLayoutSize(&Layout);
+}
+
+// NOTE(ivan): Pools that have magazines, so ReleaseMemoryThread() can find the exiting thread's magazines.
+static memory_pool *MagazinePools[MAX_MEMORY_MAGAZINE_POOLS];
+static volatile u32 NumMagazinePools;
+
+static void
+RegisterMagazinePool(memory_pool *Pool) {
+	Assert(Pool);
+
+	for (u32 Index = 0; Index < Min(NumMagazinePools, (u32)MAX_MEMORY_MAGAZINE_POOLS); Index++) {
+		if (MagazinePools[Index] == Pool)
+			return;
+	}
+
+	u32 Index = AtomicIncrementU32(&NumMagazinePools) - 1;
+	if (Index < MAX_MEMORY_MAGAZINE_POOLS)
+		MagazinePools[Index] = Pool;
+	else
+		GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Too many pools with magazines!", Pool->Name);
+}
+
+void
+CreateMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, uptr Size, u32 MagazineSize, u32 PoolFlags) {
+	Assert(Pool);
+	Assert(Name);
+	Assert(BlockSize);
+	Assert(!((PoolFlags & MemoryPoolFlag_Bitmap) && MagazineSize));
+	Assert(!(PoolFlags & MemoryPoolFlag_Growable) || ((PoolFlags & MemoryPoolFlag_Bitmap) && Pool->ParentHeap));
+
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Pool->Mutex, Name);
+#endif
+
+	EnterTicketMutex(&Pool->Mutex);
+
+	// NOTE(ivan): Each free block must be able to hold the next free block index.
+	BlockSize = Align8(Max(BlockSize, (uptr)sizeof(u32)));
+
+	// NOTE(ivan): Find the largest count of blocks whose layout fits the size, the blocks' partition
+	// gets the tail of its last page for free, so the count is raised to fill the page up.
+	u32 MinBlocks = 0, MaxBlocks = (u32)Min(Size / BlockSize, (uptr)0xFFFFFFFF);
+	while (MinBlocks < MaxBlocks) {
+		u32 NumBlocks = MaxBlocks - (MaxBlocks - MinBlocks) / 2;
+		memory_pool_layout Layout = GetMemoryPoolLayout(BlockSize, NumBlocks, MagazineSize, PoolFlags, Pool->BlocksPerChunk);
+		if (GetMemoryPoolLayoutSize(&Layout) <= Size)
+			MinBlocks = NumBlocks;
+		else
+			MaxBlocks = NumBlocks - 1;
+	}
+	memory_pool_layout Layout = GetMemoryPoolLayout(BlockSize, MinBlocks, MagazineSize, PoolFlags, Pool->BlocksPerChunk);
+	u32 BlocksToAlloc = (u32)(Layout.BlocksSize / BlockSize);
+	if (PoolFlags & MemoryPoolFlag_Bitmap)
+		BlocksToAlloc = Min(BlocksToAlloc, Layout.NumPrimaryBitmapWords * 64);
+	if (!MinBlocks)
+		GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Out of memory!", Name);
+
+	// NOTE(ivan): Magazines and bitmap are tiny compared to the blocks, so they are committed right away.
+	if (Layout.MagazinesSize) {
+		Pool->Magazines = EatGameMemory(Layout.MagazinesSize);
+		if (Pool->Magazines && CommitGameMemory(Pool->Magazines, Layout.MagazinesSize)) {
+			Pool->MagazineStride = Layout.MagazineStride;
+			Pool->MagazineSize = MagazineSize;
+		} else {
+			GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Out of memory!", Name);
+		}
+	}
+
+	if (Layout.BitmapSize) {
+		Pool->Bitmap = (volatile u64 *)EatGameMemory(Layout.BitmapSize);
+		if (Pool->Bitmap && CommitGameMemory((u8 *)Pool->Bitmap, Layout.BitmapSize)) {
+			Pool->BitmapSize = Layout.BitmapSize;
+			Pool->NumPrimaryBitmapWords = Layout.NumPrimaryBitmapWords;
+			Pool->NumBitmapWords = Layout.NumPrimaryBitmapWords;
+		} else {
+			GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Out of memory!", Name);
+		}
+	}
+
+	Pool->Piece.Base = EatGameMemory(Layout.BlocksSize);
+	if (Pool->Piece.Base) {
+		Pool->Piece.Size = Layout.BlocksSize;
+		Pool->CommittedSize = 0;
+		Pool->BlockSize = BlockSize;
+		Pool->MaxBlocks = BlocksToAlloc;
+		Pool->PoolFlags = PoolFlags;
+
+		strncpy(Pool->Name, Name, ArraySize(Pool->Name) - 1);
+
+		InitMemoryPoolBlocks(Pool);
+
+		if (Pool->Magazines)
+			RegisterMagazinePool(Pool);
+
+#if MEMORY_TELEMETRY
+		if (PoolFlags & MemoryPoolFlag_Growable) {
+			RegisterMemoryTraceContainer(&Pool->Telemetry, MemoryPartitionType_GrowablePool, Name, Size, BlockSize,
+										 Pool->BlocksPerChunk, PoolFlags);
+		} else {
+			RegisterMemoryTraceContainer(&Pool->Telemetry, MemoryPartitionType_Pool, Name, Size, BlockSize,
+										 MagazineSize, PoolFlags);
+		}
+#endif
+	} else {
+		GameState.PlatformAPI->Crashf("CreateMemoryPool[%s]: Out of memory!", Name);
+	}
+
+	LeaveTicketMutex(&Pool->Mutex);
+}
+
+void
+CreateGrowableMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, uptr Size,
+						 memory_heap *ParentHeap, u32 BlocksPerChunk) {
+	Assert(Pool);
+	Assert(ParentHeap);
+	Assert(BlocksPerChunk);
+
+	Pool->ParentHeap = ParentHeap;
+	Pool->BlocksPerChunk = (u32)AlignPow2((uptr)BlocksPerChunk, (uptr)64);
+
+	CreateMemoryPool(Pool, Name, BlockSize, Size, 0, MemoryPoolFlag_Bitmap | MemoryPoolFlag_Growable);
+}
+
+void
+ResetMemoryPool(memory_pool *Pool, u32 Flags) {
+	Assert(Pool);
+
+	EnterTicketMutex(&Pool->Mutex);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags);
+#endif
+
+	if (Flags & MemoryFlag_Zero)
+		ClearPartitionMemory(&Pool->Piece, &Pool->CommittedSize, Pool->BlockSize * Min(Pool->NumCarvedBlocks, Pool->MaxBlocks));
+	InitMemoryPoolBlocks(Pool);
+
+#if MEMORY_TELEMETRY
+	Pool->Telemetry.UsedSize = 0;
+#endif
+
+	LeaveTicketMutex(&Pool->Mutex);
+}
+
+// NOTE(ivan): Takes up to NumBlocks blocks bypassing the magazines, growable pools grow as needed.
+// Returns the count of blocks taken.
+static u32
+TakePoolBlocks(memory_pool *Pool, u8 **Blocks, u32 NumBlocks) {
+	Assert(Pool);
+
+	u32 Result = 0;
+
+	if (Pool->Bitmap) {
+		Result = ClaimPoolBitmapBlocks(Pool, Blocks, NumBlocks);
+		while (Result < NumBlocks && (Pool->PoolFlags & MemoryPoolFlag_Growable)) {
+			if (!GrowMemoryPool(Pool, Pool->NumChunks))
+				break;
+			Result += ClaimPoolBitmapBlocks(Pool, Blocks + Result, NumBlocks - Result);
+		}
+	} else {
+		Result = PopPoolBlocks(Pool, Blocks, NumBlocks);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Gives blocks back bypassing the magazines, the free stack gets them as one chain.
+static void
+GivePoolBlocks(memory_pool *Pool, u8 **Blocks, u32 NumBlocks) {
+	Assert(Pool);
+	Assert(Blocks);
+	Assert(NumBlocks);
+
+	if (Pool->Bitmap) {
+		for (u32 Index = 0; Index < NumBlocks; Index++)
+			ReleasePoolBitmapBlock(Pool, GetPoolBlockIndex(Pool, Blocks[Index]));
+		AtomicAddU32(&Pool->NumAllocBlocks, (u32)(-(s32)NumBlocks));
+
+		if ((Pool->PoolFlags & MemoryPoolFlag_Growable) && CanShrinkMemoryPool(Pool))
+			ShrinkMemoryPool(Pool);
+	} else {
+		for (u32 Index = 0; Index < (NumBlocks - 1); Index++)
+			*((u32 *)Blocks[Index]) = GetPoolBlockIndex(Pool, Blocks[Index + 1]) + 1;
+		PushPoolBlocks(Pool, Blocks[0], Blocks[NumBlocks - 1], NumBlocks);
+	}
+}
+
+// NOTE(ivan): Partition's blocks start at a page and chunks at a cache line, so every block is aligned
+// to the largest power of two the block size is a multiple of, up to the cache line size.
+inline uptr
+GetPoolBlockAlignment(memory_pool *Pool) {
+	Assert(Pool);
+	return Min(Pool->BlockSize & (~Pool->BlockSize + 1), (uptr)CACHE_LINE_SIZE);
+}
+
+void *
+AllocFromPoolTagged(memory_pool *Pool, u32 Flags, const char *File, u32 Line) {
+	Assert(Pool);
+	Assert(GetMemoryFlagsAlignment(Flags) <= GetPoolBlockAlignment(Pool));
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	u8 *Result = 0;
+
+	u32 ThreadIndex = (Pool->MagazineSize ? GetMemoryThreadIndex() : MAX_MEMORY_POOL_THREADS);
+	if (ThreadIndex < MAX_MEMORY_POOL_THREADS) {
+		memory_pool_magazine *Magazine = GetPoolMagazine(Pool, ThreadIndex);
+		u8 **MagazineBlocks = (u8 **)(Magazine + 1);
+
+		if (Magazine->NumBlocks) {
+			Magazine->NumHits++;
+		} else {
+			// NOTE(ivan): Refill a half of the magazine, so the next few frees do not drain it right away.
+			Magazine->NumMisses++;
+			Magazine->NumBlocks = PopPoolBlocks(Pool, MagazineBlocks, Max(Pool->MagazineSize / 2, (u32)1));
+		}
+
+		if (Magazine->NumBlocks)
+			Result = MagazineBlocks[--Magazine->NumBlocks];
+	} else {
+		TakePoolBlocks(Pool, &Result, 1);
+	}
+
+	if (Result) {
+		if (Flags & MemoryFlag_Zero)
+			memset(Result, 0, Pool->BlockSize);
+
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Pool->Telemetry, Pool->BlockSize,
+						  AtomicAddU64(&Pool->Telemetry.UsedSize, Pool->BlockSize), File, Line);
+		RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Pool->BlockSize, Flags);
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Pool->Telemetry, File, Line);
+		RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Alloc, 0, Pool->BlockSize, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromPool[%s]: Out of memory!", Pool->Name);
+	}
+
+	return Result;
+}
+
+void
+FreeFromPool(memory_pool *Pool, void *Base) {
+	Assert(Pool);
+	Assert(Base);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Free, (uptr)Base, 0, 0);
+#endif
+
+	u32 ThreadIndex = (Pool->MagazineSize ? GetMemoryThreadIndex() : MAX_MEMORY_POOL_THREADS);
+	if (ThreadIndex < MAX_MEMORY_POOL_THREADS) {
+		memory_pool_magazine *Magazine = GetPoolMagazine(Pool, ThreadIndex);
+		u8 **MagazineBlocks = (u8 **)(Magazine + 1);
+
+		if (Magazine->NumBlocks == Pool->MagazineSize) {
+			// NOTE(ivan): Magazine is full, drain its older half to the shared stack as one chain.
+			u32 NumToDrain = Max(Pool->MagazineSize / 2, (u32)1);
+			GivePoolBlocks(Pool, MagazineBlocks, NumToDrain);
+
+			Magazine->NumBlocks -= NumToDrain;
+			memmove(MagazineBlocks, MagazineBlocks + NumToDrain, sizeof(u8 *) * Magazine->NumBlocks);
+		}
+
+		MagazineBlocks[Magazine->NumBlocks++] = (u8 *)Base;
+	} else {
+		u8 *Block = (u8 *)Base;
+		GivePoolBlocks(Pool, &Block, 1);
+	}
+
+#if MEMORY_TELEMETRY
+	AtomicAddU64(&Pool->Telemetry.UsedSize, (u64)0 - Pool->BlockSize);
+	RecordMemoryFree(&Pool->Telemetry);
+#endif
+}
+
+void
+ReleaseMemoryThread(void) {
+	if (!MemoryThreadIndex)
+		return;
+
+	u32 ThreadIndex = MemoryThreadIndex - 1;
+	if (ThreadIndex < MAX_MEMORY_POOL_THREADS) {
+		u32 NumPools = Min(NumMagazinePools, (u32)MAX_MEMORY_MAGAZINE_POOLS);
+		for (u32 Index = 0; Index < NumPools; Index++) {
+			memory_pool *Pool = MagazinePools[Index];
+			memory_pool_magazine *Magazine = GetPoolMagazine(Pool, ThreadIndex);
+			if (Magazine->NumBlocks) {
+				GivePoolBlocks(Pool, (u8 **)(Magazine + 1), Magazine->NumBlocks);
+				Magazine->NumBlocks = 0;
+			}
+		}
+
+		// NOTE(ivan): Magazine must be empty before the slot is seen as free by another thread.
+		CompleteWritesBeforeFutureWrites();
+		for (;;) {
+			u64 Slots = MemoryThreadSlots;
+			if (AtomicCompareExchangeU64(&MemoryThreadSlots, Slots & ~((u64)1 << ThreadIndex), Slots) == Slots)
+				break;
+		}
+	}
+
+	MemoryThreadIndex = 0;
+}
+
+b32
+AllocFromPoolBatchTagged(memory_pool *Pool, void **Blocks, u32 NumBlocks, u32 Flags, const char *File, u32 Line) {
+	Assert(Pool);
+	Assert(Blocks);
+	Assert(NumBlocks);
+	Assert(GetMemoryFlagsAlignment(Flags) <= GetPoolBlockAlignment(Pool));
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	b32 Result = true;
+
+	u32 NumTaken = TakePoolBlocks(Pool, (u8 **)Blocks, NumBlocks);
+	if (NumTaken < NumBlocks) {
+		if (NumTaken)
+			GivePoolBlocks(Pool, (u8 **)Blocks, NumTaken);
+		Result = false;
+	}
+
+	if (Result) {
+		if (Flags & MemoryFlag_Zero) {
+			for (u32 Index = 0; Index < NumBlocks; Index++)
+				memset(Blocks[Index], 0, Pool->BlockSize);
+		}
+
+#if MEMORY_TELEMETRY
+		u64 UsedSize = AtomicAddU64(&Pool->Telemetry.UsedSize, Pool->BlockSize * NumBlocks);
+		for (u32 Index = 0; Index < NumBlocks; Index++) {
+			RecordMemoryAlloc(&Pool->Telemetry, Pool->BlockSize, UsedSize, File, Line);
+			RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Alloc, (uptr)Blocks[Index], Pool->BlockSize, Flags);
+		}
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Pool->Telemetry, File, Line);
+		RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Alloc, 0, Pool->BlockSize, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromPoolBatch[%s]: Out of memory!", Pool->Name);
+	}
+
+	return Result;
+}
+
+void
+FreeFromPoolBatch(memory_pool *Pool, void **Blocks, u32 NumBlocks) {
+	Assert(Pool);
+	Assert(Blocks);
+
+	if (NumBlocks) {
+#if MEMORY_TELEMETRY
+		for (u32 Index = 0; Index < NumBlocks; Index++)
+			RecordMemoryTrace(&Pool->Telemetry, MemoryTraceOp_Free, (uptr)Blocks[Index], 0, 0);
+#endif
+
+		GivePoolBlocks(Pool, (u8 **)Blocks, NumBlocks);
+
+#if MEMORY_TELEMETRY
+		AtomicAddU64(&Pool->Telemetry.UsedSize, (u64)0 - Pool->BlockSize * NumBlocks);
+		for (u32 Index = 0; Index < NumBlocks; Index++)
+			RecordMemoryFree(&Pool->Telemetry);
+#endif
+	}
+}
+
+void *
+GetNextPoolBlock(memory_pool *Pool, void *Block) {
+	Assert(Pool);
+	Assert(Pool->Bitmap);
+
+	// NOTE(ivan): Allocated blocks are below the carved blocks count in the partition, or in linked chunks.
+	u32 Index = (Block ? (GetPoolBlockIndex(Pool, Block) + 1) : 0);
+	u32 NumCarvedBlocks = Pool->NumCarvedBlocks;
+	u32 FirstChunkBlockIndex = GetPoolFirstChunkBlockIndex(Pool);
+	u32 EndIndex = Pool->NumBitmapWords * 64;
+	while (Index < EndIndex) {
+		if (Index >= NumCarvedBlocks && Index < FirstChunkBlockIndex) {
+			Index = FirstChunkBlockIndex;
+			continue;
+		}
+
+		u64 Word = Pool->Bitmap[Index / 64] & (~(u64)0 << (Index % 64));
+		if (Word) {
+			Index = (Index & ~63u) + FindLeastSignificantBit64(Word).Index;
+			if (Index < NumCarvedBlocks || Index >= FirstChunkBlockIndex)
+				return GetPoolBlockByIndex(Pool, Index);
+			continue;
+		}
+
+		Index = (Index & ~63u) + 64;
+	}
+
+	return 0;
+}
+
+inline void
+MapHeapSize(uptr Size, u32 *FL, u32 *SL) {
+	Assert(FL);
+	Assert(SL);
+
+	if (Size < MEMORY_HEAP_SMALL_SIZE) {
+		*FL = 0;
+		*SL = (u32)(Size >> (MEMORY_HEAP_SMALL_LOG2 - MEMORY_HEAP_SL_LOG2));
+	} else {
+		u32 MSB = FindMostSignificantBit64(Size).Index;
+		*FL = MSB - MEMORY_HEAP_SMALL_LOG2 + 1;
+		*SL = (u32)(Size >> (MSB - MEMORY_HEAP_SL_LOG2)) ^ MEMORY_HEAP_SL_COUNT;
+	}
+}
+
+inline void
+InsertFreeHeapBlock(memory_heap *Heap, memory_heap_block *Block) {
+	Assert(Heap);
+	Assert(Block);
+
+	u32 FL, SL;
+	MapHeapSize(Block->Size, &FL, &SL);
+
+	memory_heap_block *Head = (Heap->SLBitmaps[FL] & (1 << SL)) ? Heap->FreeBlocks[FL][SL] : 0;
+	Block->NextFreeBlock = Head;
+	Block->PrevFreeBlock = 0;
+	if (Head)
+		Head->PrevFreeBlock = Block;
+	Heap->FreeBlocks[FL][SL] = Block;
+
+	Heap->SLBitmaps[FL] |= (1 << SL);
+	Heap->FLBitmap |= ((u64)1 << FL);
+
+	Block->IsFree = true;
+	Heap->NumFreeBlocks++;
+}
+
+inline void
+RemoveFreeHeapBlock(memory_heap *Heap, memory_heap_block *Block) {
+	Assert(Heap);
+	Assert(Block);
+	Assert(Block->IsFree);
+
+	if (Block->NextFreeBlock)
+		Block->NextFreeBlock->PrevFreeBlock = Block->PrevFreeBlock;
+	if (Block->PrevFreeBlock) {
+		Block->PrevFreeBlock->NextFreeBlock = Block->NextFreeBlock;
+	} else {
+		u32 FL, SL;
+		MapHeapSize(Block->Size, &FL, &SL);
+
+		Heap->FreeBlocks[FL][SL] = Block->NextFreeBlock;
+		if (!Block->NextFreeBlock) {
+			Heap->SLBitmaps[FL] &= ~(1 << SL);
+			if (!Heap->SLBitmaps[FL])
+				Heap->FLBitmap &= ~((u64)1 << FL);
+		}
+	}
+
+	Block->IsFree = false;
+	Heap->NumFreeBlocks--;
+}
+
+inline memory_heap_block *
+FindFreeHeapBlock(memory_heap *Heap, uptr Size) {
+	Assert(Heap);
+	Assert(Size);
+
+	// NOTE(ivan): Round the size up to the next size class boundary,
+	// so any block in the found class is large enough.
+	if (Size >= MEMORY_HEAP_SMALL_SIZE)
+		Size += ((uptr)1 << (FindMostSignificantBit64(Size).Index - MEMORY_HEAP_SL_LOG2)) - 1;
+
+	u32 FL, SL;
+	MapHeapSize(Size, &FL, &SL);
+	if (FL >= MEMORY_HEAP_FL_COUNT)
+		return 0;
+
+	u32 SLBitmap = Heap->SLBitmaps[FL] & (~0u << SL);
+	if (!SLBitmap) {
+		if ((FL + 1) >= MEMORY_HEAP_FL_COUNT)
+			return 0;
+
+		u64 FLBitmap = Heap->FLBitmap & (~(u64)0 << (FL + 1));
+		if (!FLBitmap)
+			return 0;
+
+		FL = FindLeastSignificantBit64(FLBitmap).Index;
+		SLBitmap = Heap->SLBitmaps[FL];
+	}
+
+	SL = FindLeastSignificantBit(SLBitmap).Index;
+	return Heap->FreeBlocks[FL][SL];
+}
+
+inline void
+InitMemoryHeapBlocks(memory_heap *Heap) {
+	Assert(Heap);
+
+	if (!CommitPartitionMemory(&Heap->Piece, &Heap->CommittedSize, sizeof(memory_heap_block)))
+		GameState.PlatformAPI->Crashf("InitMemoryHeapBlocks[%s]: Out of memory!", Heap->Name);
+
+	Heap->FLBitmap = 0;
+	memset(Heap->SLBitmaps, 0, sizeof(Heap->SLBitmaps));
+
+	memory_heap_block *EntireBlock = (memory_heap_block *)Heap->Piece.Base;
 	EntireBlock->Size = Heap->Piece.Size - sizeof(memory_heap_block);
-	EntireBlock->IsFree = true;
 	EntireBlock->NextBlock = 0;
 	EntireBlock->PrevBlock = 0;
-	
+
 	Heap->Blocks = EntireBlock;
 	Heap->NumBlocks = 0;
+	Heap->NumFreeBlocks = 0;
 	Heap->UsedSize = 0;
+	Heap->HighWaterMark = Max(Heap->HighWaterMark, (uptr)sizeof(memory_heap_block));
+
+	InsertFreeHeapBlock(Heap, EntireBlock);
+}
+
+void
+CreateMemoryHeap(memory_heap *Heap, const char *Name, uptr Size) {
+	Assert(Heap);
+	Assert(Name);
+
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Heap->Mutex, Name);
+#endif
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	Size = AlignPartitionSize(Size);
+	Heap->Piece.Base = (Size > sizeof(memory_heap_block)) ? EatGameMemory(Size) : 0;
+	if (Heap->Piece.Base) {
+		Heap->Piece.Size = Size;
+		Heap->CommittedSize = 0;
+
+		strncpy(Heap->Name, Name, ArraySize(Heap->Name) - 1);
+
+		InitMemoryHeapBlocks(Heap);
+
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Heap->Telemetry, MemoryPartitionType_Heap, Name, Size, 0, 0, 0);
+#endif
+	} else {
+		GameState.PlatformAPI->Crashf("CreateMemoryHeap[%s]: Out of memory!", Name);
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+void
+ResetMemoryHeap(memory_heap *Heap, u32 Flags) {
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags);
+#endif
+
+	if (Flags & MemoryFlag_Zero) {
+		ClearPartitionMemory(&Heap->Piece, &Heap->CommittedSize, Heap->HighWaterMark);
+		Heap->HighWaterMark = 0;
+	}
+	InitMemoryHeapBlocks(Heap);
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+// NOTE(ivan): Splits off the block's tail past Size bytes if the tail has room for at least MinTailSize bytes.
+// Returns the tail, that is not in the free lists yet, or 0 if the block has not been split.
+inline memory_heap_block *
+SplitHeapBlock(memory_heap_block *Block, uptr Size, uptr MinTailSize) {
+	Assert(Block);
+
+	memory_heap_block *Result = 0;
+
+	if (Block->Size >= (Size + sizeof(memory_heap_block) + MinTailSize)) {
+		Result = (memory_heap_block *)((u8 *)Block + sizeof(memory_heap_block) + Size);
+		Result->Size = Block->Size - Size - sizeof(memory_heap_block);
+		Result->NextBlock = Block->NextBlock;
+		Result->PrevBlock = Block;
+
+		if (Block->NextBlock)
+			Block->NextBlock->PrevBlock = Result;
+		Block->NextBlock = Result;
+		Block->Size = Size;
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Absorbs the free physical neighbor that follows the block.
+inline void
+MergeNextHeapBlock(memory_heap *Heap, memory_heap_block *Block) {
+	Assert(Heap);
+	Assert(Block);
+
+	memory_heap_block *NextBlock = Block->NextBlock;
+	Assert(NextBlock && NextBlock->IsFree);
+	RemoveFreeHeapBlock(Heap, NextBlock);
+
+	Block->Size += NextBlock->Size + sizeof(memory_heap_block);
+	Block->NextBlock = NextBlock->NextBlock;
+	if (NextBlock->NextBlock)
+		NextBlock->NextBlock->PrevBlock = Block;
+}
+
+// NOTE(ivan): Finds a free block of a given size and commits the block data along with
+// the split-off tail header right past it. Returns 0 if there is no such block.
+static memory_heap_block *
+TakeFreeHeapBlock(memory_heap *Heap, uptr Size) {
+	Assert(Heap);
+
+	memory_heap_block *Result = FindFreeHeapBlock(Heap, Size);
+	if (Result) {
+		uptr DirtyEnd = (uptr)((u8 *)Result - Heap->Piece.Base) + sizeof(memory_heap_block) + Size + sizeof(memory_heap_block);
+		DirtyEnd = Min(DirtyEnd, Heap->Piece.Size);
+		if (CommitPartitionMemory(&Heap->Piece, &Heap->CommittedSize, DirtyEnd)) {
+			RemoveFreeHeapBlock(Heap, Result);
+			Heap->HighWaterMark = Max(Heap->HighWaterMark, DirtyEnd);
+		} else {
+			Result = 0;
+		}
+	}
+
+	return Result;
+}
+
+inline void *
+UseHeapBlock(memory_heap *Heap, memory_heap_block *Block, u32 Flags) {
+	Assert(Heap);
+	Assert(Block);
+
+	Block->IsFree = false;
+	Heap->NumBlocks++;
+	Heap->UsedSize += Block->Size + sizeof(memory_heap_block);
+
+	void *Result = (void *)((u8 *)Block + sizeof(memory_heap_block));
+	if (Flags & MemoryFlag_Zero)
+		memset(Result, 0, Block->Size);
+
+	return Result;
+}
+
+// NOTE(ivan): AllocFromHeap() and FreeFromHeap() without taking the mutex, and without telemetry: callers record it.
+static void *
+AllocHeapBlock(memory_heap *Heap, uptr Size, u32 Flags) {
+	Assert(Heap);
+	Assert(Size);
+
+	void *Result = 0;
+
+	// NOTE(ivan): Block data is 8-byte aligned. For a stronger alignment take a block that has room
+	// for the aligned data along with a free block split off in front of it, that might have no data at all.
+	Size = Align8(Size);
+	uptr Alignment = GetMemoryFlagsAlignment(Flags);
+	uptr SearchSize = Size;
+	if (Alignment > MEMORY_DEFAULT_ALIGNMENT)
+		SearchSize += sizeof(memory_heap_block) + Alignment - MEMORY_DEFAULT_ALIGNMENT;
+
+	memory_heap_block *Block = TakeFreeHeapBlock(Heap, SearchSize);
+	if (Block) {
+		uptr Data = (uptr)Block + sizeof(memory_heap_block);
+		if (Data & (Alignment - 1)) {
+			uptr LeadSize = AlignPow2(Data + sizeof(memory_heap_block), Alignment) - Data - sizeof(memory_heap_block);
+			memory_heap_block *AlignedBlock = SplitHeapBlock(Block, LeadSize, 0);
+			Assert(AlignedBlock);
+
+			// NOTE(ivan): The block has been free, so its previous neighbor is not, no merging is needed.
+			InsertFreeHeapBlock(Heap, Block);
+			Block = AlignedBlock;
+		}
+
+		// NOTE(ivan): Split off the tail if it is large enough to become a separate block.
+		memory_heap_block *TailBlock = SplitHeapBlock(Block, Size, sizeof(memory_heap_block));
+		if (TailBlock)
+			InsertFreeHeapBlock(Heap, TailBlock);
+
+		Result = UseHeapBlock(Heap, Block, Flags);
+	}
+
+	return Result;
+}
+
+static void
+FreeHeapBlock(memory_heap *Heap, void *Base) {
+	Assert(Heap);
+	Assert(Base);
+
+	memory_heap_block *Block = (memory_heap_block *)((u8 *)Base - sizeof(memory_heap_block));
+	Assert(!Block->IsFree);
+
+	Heap->NumBlocks--;
+	Heap->UsedSize -= Block->Size + sizeof(memory_heap_block);
+
+	// NOTE(ivan): Merge with free physical neighbors.
+	if (Block->NextBlock && Block->NextBlock->IsFree)
+		MergeNextHeapBlock(Heap, Block);
+
+	memory_heap_block *PrevBlock = Block->PrevBlock;
+	if (PrevBlock && PrevBlock->IsFree) {
+		// NOTE(ivan): The block is not in the free lists, so it is absorbed by hand.
+		RemoveFreeHeapBlock(Heap, PrevBlock);
+
+		PrevBlock->Size += Block->Size + sizeof(memory_heap_block);
+		PrevBlock->NextBlock = Block->NextBlock;
+		if (Block->NextBlock)
+			Block->NextBlock->PrevBlock = PrevBlock;
+
+		Block = PrevBlock;
+	}
+
+	InsertFreeHeapBlock(Heap, Block);
+}
+
+void *
+AllocFromHeapTagged(memory_heap *Heap, uptr Size, u32 Flags, const char *File, u32 Line) {
+	Assert(Heap);
+	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	void *Result = AllocHeapBlock(Heap, Size, Flags);
+	if (Result) {
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Heap->Telemetry, Align8(Size), Heap->UsedSize, File, Line);
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Size, Flags);
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Heap->Telemetry, File, Line);
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromHeap[%s]: Out of memory!", Heap->Name);
+	}
+	
+	LeaveTicketMutex(&Heap->Mutex);
+
+	return Result;
+}
+
+void
+FreeFromHeap(memory_heap *Heap, void *Base) {
+	Assert(Heap);
+	Assert(Base);
+
+	EnterTicketMutex(&Heap->Mutex);
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Free, (uptr)Base, 0, 0);
+	RecordMemoryFree(&Heap->Telemetry);
+#endif
+	FreeHeapBlock(Heap, Base);
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+// NOTE(ivan): Resizes an allocated block without moving its data. Shrinking splits off a free tail,
+// growing absorbs the following free neighbor if the neighbor is large enough. Returns false
+// if the block cannot be resized in place, the block is left untouched then.
+static b32
+ResizeHeapBlock(memory_heap *Heap, memory_heap_block *Block, uptr Size, u32 Flags) {
+	Assert(Heap);
+	Assert(Block);
+	Assert(!Block->IsFree);
+
+	uptr OldSize = Block->Size;
+	memory_heap_block *NextBlock = Block->NextBlock;
+	b32 IsNextFree = (NextBlock && NextBlock->IsFree);
+
+	if (Size > OldSize) {
+		if (!IsNextFree || (OldSize + sizeof(memory_heap_block) + NextBlock->Size) < Size)
+			return false;
+
+		uptr DirtyEnd = (uptr)((u8 *)Block - Heap->Piece.Base) + sizeof(memory_heap_block) + Size + sizeof(memory_heap_block);
+		DirtyEnd = Min(DirtyEnd, Heap->Piece.Size);
+		if (!CommitPartitionMemory(&Heap->Piece, &Heap->CommittedSize, DirtyEnd))
+			return false;
+		Heap->HighWaterMark = Max(Heap->HighWaterMark, DirtyEnd);
+	}
+
+	// NOTE(ivan): Let the tail that is split off coalesce with the free neighbor, if there is one.
+	if (IsNextFree)
+		MergeNextHeapBlock(Heap, Block);
+
+	memory_heap_block *TailBlock = SplitHeapBlock(Block, Size, sizeof(memory_heap_block));
+	if (TailBlock)
+		InsertFreeHeapBlock(Heap, TailBlock);
+
+	Heap->UsedSize = Heap->UsedSize - OldSize + Block->Size;
+
+	if ((Flags & MemoryFlag_Zero) && (Size > OldSize))
+		memset((u8 *)Block + sizeof(memory_heap_block) + OldSize, 0, Size - OldSize);
+
+	return true;
+}
+
+void *
+ReallocFromHeapTagged(memory_heap *Heap, void *Base, uptr Size, u32 Flags, const char *File, u32 Line) {
+	Assert(Heap);
+	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	if (!Base)
+		return AllocFromHeapTagged(Heap, Size, Flags, File, Line);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	void *Result = 0;
+
+	// NOTE(ivan): A block that lacks the asked alignment is always moved.
+	Size = Align8(Size);
+	memory_heap_block *Block = (memory_heap_block *)((u8 *)Base - sizeof(memory_heap_block));
+	if (!((uptr)Base & (GetMemoryFlagsAlignment(Flags) - 1)) && ResizeHeapBlock(Heap, Block, Size, Flags)) {
+#if MEMORY_TELEMETRY
+		RecordMemoryFree(&Heap->Telemetry);
+#endif
+		Result = Base;
+	} else {
+		// NOTE(ivan): Nowhere to grow in place, or misaligned, move the data to a new block.
+		// The new block may be smaller than the old one if the block is moved for alignment.
+		Result = AllocHeapBlock(Heap, Size, Flags);
+		if (Result) {
+			memcpy(Result, Base, Min(Block->Size, Size));
+			FreeHeapBlock(Heap, Base);
+#if MEMORY_TELEMETRY
+			RecordMemoryFree(&Heap->Telemetry);
+#endif
+		}
+	}
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTraceRealloc(&Heap->Telemetry, (uptr)Base, (uptr)Result, Size, Flags);
+#endif
+
+	if (Result) {
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Heap->Telemetry, Size, Heap->UsedSize, File, Line);
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Heap->Telemetry, File, Line);
+#endif
+		GameState.PlatformAPI->Outf("ReallocFromHeap[%s]: Out of memory!", Heap->Name);
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+
+	return Result;
+}
+
+b32
+AllocFromHeapBatchTagged(memory_heap *Heap, void **Blocks, const uptr *Sizes, u32 NumBlocks, u32 Flags,
+						 const char *File, u32 Line) {
+	Assert(Heap);
+	Assert(Blocks);
+	Assert(Sizes);
+	Assert(NumBlocks);
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	b32 Result = true;
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	// NOTE(ivan): Try to carve all the blocks out of a single free block, one after another.
+	// Blocks carved that way are 8-byte aligned only, aligned blocks are always allocated one by one.
+	uptr RunSize = 0;
+	for (u32 Index = 0; Index < NumBlocks; Index++) {
+		Assert(Sizes[Index]);
+		RunSize += Align8(Sizes[Index]) + sizeof(memory_heap_block);
+	}
+	RunSize -= sizeof(memory_heap_block);
+
+	memory_heap_block *Block = 0;
+	if (GetMemoryFlagsAlignment(Flags) == MEMORY_DEFAULT_ALIGNMENT)
+		Block = TakeFreeHeapBlock(Heap, RunSize);
+	if (Block) {
+		for (u32 Index = 0; Index < NumBlocks; Index++) {
+			// NOTE(ivan): The run always has room for the blocks left, the last one's tail is split off
+			// only if it is large enough to become a separate block.
+			b32 IsLast = (Index == (NumBlocks - 1));
+			memory_heap_block *TailBlock = SplitHeapBlock(Block, Align8(Sizes[Index]), IsLast ? sizeof(memory_heap_block) : 0);
+			Assert(TailBlock || IsLast);
+
+			Blocks[Index] = UseHeapBlock(Heap, Block, Flags);
+
+			if (IsLast) {
+				if (TailBlock)
+					InsertFreeHeapBlock(Heap, TailBlock);
+			} else {
+				Block = TailBlock;
+			}
+		}
+	} else {
+		// NOTE(ivan): No free block is large enough for the whole run, fall back to separate blocks.
+		for (u32 Index = 0; Index < NumBlocks; Index++) {
+			Blocks[Index] = AllocHeapBlock(Heap, Sizes[Index], Flags);
+			if (!Blocks[Index]) {
+				while (Index--)
+					FreeHeapBlock(Heap, Blocks[Index]);
+
+				Result = false;
+				break;
+			}
+		}
+	}
+
+	if (Result) {
+#if MEMORY_TELEMETRY
+		for (u32 Index = 0; Index < NumBlocks; Index++) {
+			RecordMemoryAlloc(&Heap->Telemetry, Align8(Sizes[Index]), Heap->UsedSize, File, Line);
+			RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, (uptr)Blocks[Index], Sizes[Index], Flags);
+		}
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Heap->Telemetry, File, Line);
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, 0, Sizes[0], Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromHeapBatch[%s]: Out of memory!", Heap->Name);
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+
+	return Result;
+}
+
+void
+FreeFromHeapBatch(memory_heap *Heap, void **Blocks, u32 NumBlocks) {
+	Assert(Heap);
+	Assert(Blocks);
+
+	EnterTicketMutex(&Heap->Mutex);
+	for (u32 Index = 0; Index < NumBlocks; Index++) {
+#if MEMORY_TELEMETRY
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Free, (uptr)Blocks[Index], 0, 0);
+		RecordMemoryFree(&Heap->Telemetry);
+#endif
+		FreeHeapBlock(Heap, Blocks[Index]);
+	}
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+inline b32
+IsBitmapBitSet(u32 *Bitmap, u32 Index) {
+	Assert(Bitmap);
+	return (Bitmap[Index >> 5] >> (Index & 31)) & 1;
+}
+
+inline void
+SetBitmapBit(u32 *Bitmap, u32 Index) {
+	Assert(Bitmap);
+	Bitmap[Index >> 5] |= (1u << (Index & 31));
+}
+
+inline void
+ClearBitmapBit(u32 *Bitmap, u32 Index) {
+	Assert(Bitmap);
+	Bitmap[Index >> 5] &= ~(1u << (Index & 31));
+}
+
+// NOTE(ivan): Buddy allocator's node addressing.
+inline u32
+GetBuddyFirstNode(u32 Level) {
+	return (1u << Level) - 1;
+}
+
+inline uptr
+GetBuddyBlockSize(memory_buddy *Buddy, u32 Level) {
+	Assert(Buddy);
+	return (uptr)1 << (Buddy->DataSizeLog2 - Level);
+}
+
+inline u8 *
+GetBuddyBlock(memory_buddy *Buddy, u32 Node, u32 Level) {
+	Assert(Buddy);
+	return Buddy->Data + ((uptr)(Node - GetBuddyFirstNode(Level)) << (Buddy->DataSizeLog2 - Level));
+}
+
+inline void
+PushFreeBuddyNode(memory_buddy *Buddy, u32 Node, u32 Level) {
+	Assert(Buddy);
+	Assert(Level < Buddy->NumLevels);
+
+	SetBitmapBit(Buddy->FreeBitmap, Node);
+
+	u32 Head = Buddy->FreeHeads[Level];
+	Buddy->NextFree[Node] = Head;
+	Buddy->PrevFree[Node] = 0;
+	if (Head)
+		Buddy->PrevFree[Head - 1] = Node + 1;
+
+	Buddy->FreeHeads[Level] = Node + 1;
+	Buddy->LevelBitmap |= ((u64)1 << Level);
+}
+
+inline void
+RemoveFreeBuddyNode(memory_buddy *Buddy, u32 Node, u32 Level) {
+	Assert(Buddy);
+	Assert(IsBitmapBitSet(Buddy->FreeBitmap, Node));
+
+	ClearBitmapBit(Buddy->FreeBitmap, Node);
+
+	u32 Next = Buddy->NextFree[Node];
+	u32 Prev = Buddy->PrevFree[Node];
+	if (Prev)
+		Buddy->NextFree[Prev - 1] = Next;
+	else
+		Buddy->FreeHeads[Level] = Next;
+	if (Next)
+		Buddy->PrevFree[Next - 1] = Prev;
+
+	if (!Buddy->FreeHeads[Level])
+		Buddy->LevelBitmap &= ~((u64)1 << Level);
+}
+
+// NOTE(ivan): Gives a block back to its level, merging it with its free buddy as far up as possible.
+static void
+ReleaseBuddyNode(memory_buddy *Buddy, u32 Node, u32 Level) {
+	Assert(Buddy);
+
+	while (Level) {
+		u32 BuddyNode = (Node & 1) ? (Node + 1) : (Node - 1);
+		if (!IsBitmapBitSet(Buddy->FreeBitmap, BuddyNode))
+			break;
+
+		RemoveFreeBuddyNode(Buddy, BuddyNode, Level);
+
+		Node = (Node - 1) / 2;
+		Level--;
+		ClearBitmapBit(Buddy->SplitBitmap, Node);
+	}
+
+	PushFreeBuddyNode(Buddy, Node, Level);
+}
+
+// NOTE(ivan): Commits block's leaves that were never committed yet. Freshly committed pages read as zeros,
+// so only the leaves that were committed before get cleared if zeroing is requested.
+static b32
+CommitBuddyBlock(memory_buddy *Buddy, u32 Node, u32 Level, b32 IsZeroing) {
+	Assert(Buddy);
+
+	u32 LeafLevel = Buddy->NumLevels - 1;
+	u32 FirstLeaf = (Node - GetBuddyFirstNode(Level)) << (LeafLevel - Level);
+	u32 NumLeaves = 1u << (LeafLevel - Level);
+
+	for (u32 Leaf = FirstLeaf; Leaf < (FirstLeaf + NumLeaves); ) {
+		u8 *LeafBase = Buddy->Data + (uptr)Leaf * Buddy->MinBlockSize;
+
+		if (IsBitmapBitSet(Buddy->CommitBitmap, Leaf)) {
+			if (IsZeroing)
+				memset(LeafBase, 0, Buddy->MinBlockSize);
+			Leaf++;
+		} else {
+			// NOTE(ivan): Commit the whole run of uncommitted leaves at once.
+			u32 RunEnd = Leaf;
+			while (RunEnd < (FirstLeaf + NumLeaves) && !IsBitmapBitSet(Buddy->CommitBitmap, RunEnd))
+				RunEnd++;
+
+			uptr RunSize = (uptr)(RunEnd - Leaf) * Buddy->MinBlockSize;
+			if (!CommitGameMemory(LeafBase, RunSize))
+				return false;
+
+			Buddy->CommittedSize += RunSize;
+			for (; Leaf < RunEnd; Leaf++)
+				SetBitmapBit(Buddy->CommitBitmap, Leaf);
+		}
+	}
+
+	return true;
+}
+
+inline uptr
+CalculateBuddyMetadataSize(u32 NumLeaves) {
+	u32 NumNodes = NumLeaves * 2 - 1;
+
+	uptr Result = 0;
+	Result += sizeof(u32) * ((NumNodes + 31) / 32) * 2; // NOTE(ivan): Free and split bitmaps.
+	Result += sizeof(u32) * ((NumLeaves + 31) / 32);    // NOTE(ivan): Commit bitmap.
+	Result += sizeof(u32) * NumNodes * 2;               // NOTE(ivan): Free lists links.
+
+	return Result;
+}
 
-	LeaveTicketMutex(&Heap->Mutex);
+static void
+InitMemoryBuddyNodes(memory_buddy *Buddy) {
+	Assert(Buddy);
+
+	u32 NumNodes = Buddy->NumLeaves * 2 - 1;
+	memset(Buddy->FreeBitmap, 0, sizeof(u32) * ((NumNodes + 31) / 32));
+	memset(Buddy->SplitBitmap, 0, sizeof(u32) * ((NumNodes + 31) / 32));
+
+	for (u32 Level = 0; Level < ArraySize(Buddy->FreeHeads); Level++)
+		Buddy->FreeHeads[Level] = 0;
+	Buddy->LevelBitmap = 0;
+
+	Buddy->NumBlocks = 0;
+	Buddy->UsedSize = 0;
+
+	PushFreeBuddyNode(Buddy, 0, 0);
+}
+
+void
+CreateMemoryBuddy(memory_buddy *Buddy, const char *Name, uptr MinBlockSize, uptr Size) {
+	Assert(Buddy);
+	Assert(Name);
+	Assert(MinBlockSize);
+
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Buddy->Mutex, Name);
+#endif
+
+	EnterTicketMutex(&Buddy->Mutex);
+
+	uptr PageSize = Max(GameState.PlatformAPI->PageSize, (uptr)1);
+	MinBlockSize = Max(MinBlockSize, PageSize);
+
+	u32 MinBlockLog2 = FindMostSignificantBit64(MinBlockSize).Index;
+	if (((uptr)1 << MinBlockLog2) < MinBlockSize)
+		MinBlockLog2++;
+
+	// NOTE(ivan): Find the largest power-of-two data region that fits the partition along with its metadata.
+	// Node indices are 32-bit, so the tree cannot be deeper than 31 levels.
+	Size = AlignPartitionSize(Size);
+	u32 DataSizeLog2 = Min(FindMostSignificantBit64(Size).Index, MinBlockLog2 + 30);
+	uptr MetadataSize = 0;
+	for (; DataSizeLog2 >= MinBlockLog2; DataSizeLog2--) {
+		MetadataSize = AlignPow2(CalculateBuddyMetadataSize(1u << (DataSizeLog2 - MinBlockLog2)), PageSize);
+		if ((MetadataSize + ((uptr)1 << DataSizeLog2)) <= Size)
+			break;
+	}
+
+	Buddy->Piece.Base = (DataSizeLog2 >= MinBlockLog2) ? EatGameMemory(MetadataSize + ((uptr)1 << DataSizeLog2)) : 0;
+	if (Buddy->Piece.Base && CommitGameMemory(Buddy->Piece.Base, MetadataSize)) {
+		strncpy(Buddy->Name, Name, ArraySize(Buddy->Name) - 1);
+
+		Buddy->Piece.Size = MetadataSize + ((uptr)1 << DataSizeLog2);
+		Buddy->Data = Buddy->Piece.Base + MetadataSize;
+		Buddy->DataSize = (uptr)1 << DataSizeLog2;
+		Buddy->DataSizeLog2 = DataSizeLog2;
+		Buddy->MinBlockSize = (uptr)1 << MinBlockLog2;
+		Buddy->NumLevels = DataSizeLog2 - MinBlockLog2 + 1;
+		Buddy->NumLeaves = 1u << (DataSizeLog2 - MinBlockLog2);
+		Buddy->CommittedSize = MetadataSize;
+
+		u32 NumNodes = Buddy->NumLeaves * 2 - 1;
+		u32 *Metadata = (u32 *)Buddy->Piece.Base;
+		Buddy->FreeBitmap = Metadata;
+		Metadata += (NumNodes + 31) / 32;
+		Buddy->SplitBitmap = Metadata;
+		Metadata += (NumNodes + 31) / 32;
+		Buddy->CommitBitmap = Metadata;
+		Metadata += (Buddy->NumLeaves + 31) / 32;
+		Buddy->NextFree = Metadata;
+		Metadata += NumNodes;
+		Buddy->PrevFree = Metadata;
+
+		InitMemoryBuddyNodes(Buddy);
+
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Buddy->Telemetry, MemoryPartitionType_Buddy, Name, Size, MinBlockSize, 0, 0);
+#endif
+	} else {
+		GameState.PlatformAPI->Crashf("CreateMemoryBuddy[%s]: Out of memory!", Name);
+	}
+
+	LeaveTicketMutex(&Buddy->Mutex);
+}
+
+void
+ResetMemoryBuddy(memory_buddy *Buddy, u32 Flags) {
+	Assert(Buddy);
+
+	EnterTicketMutex(&Buddy->Mutex);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Buddy->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags);
+#endif
+
+	// NOTE(ivan): Give all committed leaves back to the OS, they read as zeros when committed again.
+	if (Flags & MemoryFlag_Zero) {
+		for (u32 Leaf = 0; Leaf < Buddy->NumLeaves; ) {
+			if (!IsBitmapBitSet(Buddy->CommitBitmap, Leaf)) {
+				Leaf++;
+				continue;
+			}
+
+			u32 RunEnd = Leaf;
+			while (RunEnd < Buddy->NumLeaves && IsBitmapBitSet(Buddy->CommitBitmap, RunEnd))
+				ClearBitmapBit(Buddy->CommitBitmap, RunEnd++);
+
+			uptr RunSize = (uptr)(RunEnd - Leaf) * Buddy->MinBlockSize;
+			DecommitGameMemory(Buddy->Data + (uptr)Leaf * Buddy->MinBlockSize, RunSize);
+			Buddy->CommittedSize -= RunSize;
+
+			Leaf = RunEnd;
+		}
+	}
+	InitMemoryBuddyNodes(Buddy);
+
+	LeaveTicketMutex(&Buddy->Mutex);
 }
 
 void *
-AllocFromHeap(memory_heap *Heap, uptr Size) {
-	Assert(Heap);
+AllocFromBuddyTagged(memory_buddy *Buddy, uptr Size, u32 Flags, const char *File, u32 Line) {
+	Assert(Buddy);
 	Assert(Size);
+	Assert(GetMemoryFlagsAlignment(Flags) <= Buddy->MinBlockSize);
+	UnusedParam(File);
+	UnusedParam(Line);
 
 	void *Result = 0;
 
-	EnterTicketMutex(&Heap->Mutex);
+	EnterTicketMutex(&Buddy->Mutex);
+
+	uptr BlockSize = Max(Size, Buddy->MinBlockSize);
+	u32 BlockSizeLog2 = FindMostSignificantBit64(BlockSize).Index;
+	if (((uptr)1 << BlockSizeLog2) < BlockSize)
+		BlockSizeLog2++;
+
+	if (BlockSizeLog2 <= Buddy->DataSizeLog2) {
+		// NOTE(ivan): Take the smallest free block that is large enough, that is the deepest non-empty level
+		// not deeper than the wanted one, and split it down to the wanted level.
+		u32 TargetLevel = Buddy->DataSizeLog2 - BlockSizeLog2;
+		u64 Candidates = Buddy->LevelBitmap & (((u64)2 << TargetLevel) - 1);
+		if (Candidates) {
+			u32 Level = FindMostSignificantBit64(Candidates).Index;
+			u32 Node = Buddy->FreeHeads[Level] - 1;
+			RemoveFreeBuddyNode(Buddy, Node, Level);
+
+			while (Level < TargetLevel) {
+				SetBitmapBit(Buddy->SplitBitmap, Node);
+				PushFreeBuddyNode(Buddy, Node * 2 + 2, Level + 1);
+
+				Node = Node * 2 + 1;
+				Level++;
+			}
+
+			if (CommitBuddyBlock(Buddy, Node, Level, (Flags & MemoryFlag_Zero))) {
+				Buddy->NumBlocks++;
+				Buddy->UsedSize += GetBuddyBlockSize(Buddy, Level);
+
+				Result = GetBuddyBlock(Buddy, Node, Level);
+			} else {
+				ReleaseBuddyNode(Buddy, Node, Level);
+			}
+		}
+	}
+
+	if (Result) {
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Buddy->Telemetry, Size, Buddy->UsedSize, File, Line);
+		RecordMemoryTrace(&Buddy->Telemetry, MemoryTraceOp_Alloc, (uptr)Result, Size, Flags);
+#endif
+	} else {
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Buddy->Telemetry, File, Line);
+		RecordMemoryTrace(&Buddy->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocFromBuddy[%s]: Out of memory!", Buddy->Name);
+	}
+
+	LeaveTicketMutex(&Buddy->Mutex);
+
+	return Result;
+}
+
+void
+FreeFromBuddy(memory_buddy *Buddy, void *Base) {
+	Assert(Buddy);
+	Assert(Base);
+
+	EnterTicketMutex(&Buddy->Mutex);
+
+	uptr Offset = (uptr)((u8 *)Base - Buddy->Data);
+	Assert(Offset < Buddy->DataSize);
+
+	// NOTE(ivan): Walk down the split nodes to the block that contains the address.
+	u32 Node = 0, Level = 0;
+	while (IsBitmapBitSet(Buddy->SplitBitmap, Node)) {
+		Level++;
+		Node = Node * 2 + 1 + (u32)((Offset >> (Buddy->DataSizeLog2 - Level)) & 1);
+	}
+	Assert(!IsBitmapBitSet(Buddy->FreeBitmap, Node));
+	Assert(GetBuddyBlock(Buddy, Node, Level) == Base);
+
+	Buddy->NumBlocks--;
+	Buddy->UsedSize -= GetBuddyBlockSize(Buddy, Level);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFree(&Buddy->Telemetry);
+	RecordMemoryTrace(&Buddy->Telemetry, MemoryTraceOp_Free, (uptr)Base, 0, 0);
+#endif
+
+	ReleaseBuddyNode(Buddy, Node, Level);
+
+	LeaveTicketMutex(&Buddy->Mutex);
+}
+
+// NOTE(ivan): Relocatable heap's blocks are aligned to this boundary.
+#define MEMORY_HANDLE_HEAP_ALIGNMENT 16
+
+inline uptr
+GetHandleHeapHeaderSize(void) {
+	return AlignPow2((uptr)sizeof(memory_handle_block), (uptr)MEMORY_HANDLE_HEAP_ALIGNMENT);
+}
+
+inline memory_handle_block *
+GetHandleHeapBlock(memory_handle_heap *Heap, uptr Offset) {
+	Assert(Heap);
+	Assert(Offset < Heap->Top);
+	return (memory_handle_block *)(Heap->Piece.Base + Offset);
+}
+
+inline u8 *
+GetHandleHeapBlockData(memory_handle_block *Block) {
+	Assert(Block);
+	Assert(Block->HandleIndex);
+	return (u8 *)AlignPow2((uptr)Block + GetHandleHeapHeaderSize(), (uptr)Block->Alignment);
+}
+
+// NOTE(ivan): Size of the data a live block has room for wherever it is placed.
+inline uptr
+GetHandleHeapBlockCapacity(memory_handle_block *Block) {
+	Assert(Block);
+	Assert(Block->HandleIndex);
+	return Block->Size - GetHandleHeapHeaderSize() - (Block->Alignment - MEMORY_HANDLE_HEAP_ALIGNMENT);
+}
+
+inline void
+WriteFreeHandleHeapBlock(memory_handle_heap *Heap, uptr Offset, uptr Size) {
+	Assert(Heap);
+	Assert(Size >= GetHandleHeapHeaderSize());
+
+	memory_handle_block *Block = (memory_handle_block *)(Heap->Piece.Base + Offset);
+	Block->HandleIndex = 0;
+	Block->NumPins = 0;
+	Block->Alignment = 0;
+	Block->Size = Size;
+}
+
+// NOTE(ivan): Returns handle's table entry, 0 if the handle is stale or invalid.
+inline memory_handle_entry *
+GetMemoryHandleEntry(memory_handle_heap *Heap, memory_handle Handle) {
+	Assert(Heap);
+
+	u32 Index = (Handle & MAX_MEMORY_HANDLES);
+	if (!Index || Index > Heap->NumHandles)
+		return 0;
+
+	memory_handle_entry *Entry = Heap->Handles + (Index - 1);
+	if (Entry->Generation != (Handle >> 24))
+		return 0;
+
+	return Entry;
+}
+
+// NOTE(ivan): Merges a free block with all free blocks that follow it, and cuts the Top if the merged
+// block is the last one. The compaction cursor is moved to the merged block if it pointed inside it.
+static void
+CoalesceHandleHeapBlock(memory_handle_heap *Heap, uptr Offset) {
+	Assert(Heap);
+
+	memory_handle_block *Block = GetHandleHeapBlock(Heap, Offset);
+	Assert(!Block->HandleIndex);
 
-	memory_heap_block *HostBlock = 0;
-	for (HostBlock = Heap->Blocks; HostBlock; HostBlock = HostBlock->NextBlock) {
-		if (HostBlock->IsFree && HostBlock->Size >= Size)
+	while ((Offset + Block->Size) < Heap->Top) {
+		uptr NextOffset = Offset + Block->Size;
+		memory_handle_block *NextBlock = GetHandleHeapBlock(Heap, NextOffset);
+		if (NextBlock->HandleIndex)
 			break;
+
+		if (Heap->CompactCursor == NextOffset)
+			Heap->CompactCursor = Offset;
+		Block->Size += NextBlock->Size;
 	}
 
-	if (HostBlock) {
-		uptr RealSize = Size + sizeof(memory_heap_block);
+	if ((Offset + Block->Size) == Heap->Top) {
+		Heap->Top = Offset;
+		Heap->CompactCursor = Min(Heap->CompactCursor, Heap->Top);
+	}
+}
 
-		if (HostBlock->Size == RealSize) {
-			HostBlock->IsFree = false;
-			Result = (void *)((u8 *)HostBlock + sizeof(memory_heap_block));
-		} else {
-			HostBlock->Size -= RealSize;
+// NOTE(ivan): Appends the block at the Top if there is room, otherwise looks for the first free block
+// that is large enough and splits it.
+static b32
+FindHandleHeapSpace(memory_handle_heap *Heap, uptr BlockSize, uptr *Offset) {
+	Assert(Heap);
+	Assert(Offset);
+
+	for (uptr BlockOffset = 0; BlockOffset < Heap->Top; ) {
+		// NOTE(ivan): Check the Top first, the scan might have cut it.
+		if (BlockSize <= (Heap->Piece.Size - Heap->Top))
+			break;
+
+		memory_handle_block *Block = GetHandleHeapBlock(Heap, BlockOffset);
+		if (!Block->HandleIndex) {
+			CoalesceHandleHeapBlock(Heap, BlockOffset);
+			if (BlockOffset >= Heap->Top)
+				break;
+
+			if (Block->Size >= BlockSize) {
+				// NOTE(ivan): Sizes are aligned, so the remainder is always large enough for a header.
+				if (Block->Size > BlockSize)
+					WriteFreeHandleHeapBlock(Heap, BlockOffset + BlockSize, Block->Size - BlockSize);
+
+				*Offset = BlockOffset;
+				return true;
+			}
+		}
+
+		BlockOffset += Block->Size;
+	}
+
+	if (BlockSize <= (Heap->Piece.Size - Heap->Top)) {
+		if (!CommitPartitionMemory(&Heap->Piece, &Heap->CommittedSize, Heap->Top + BlockSize))
+			return false;
+
+		*Offset = Heap->Top;
+		Heap->Top += BlockSize;
+		Heap->HighWaterMark = Max(Heap->HighWaterMark, Heap->Top);
+
+		return true;
+	}
+
+	return false;
+}
+
+// NOTE(ivan): Compaction step by step: a free block at the cursor swallows the free blocks after it,
+// then the live block right after it slides down over it, and the free space ends up after the moved block.
+// A pinned block makes the cursor jump over it. Each call stops at the end of the pass, a call without
+// a budget finishes the current pass and makes one more whole pass if the current one began mid-heap.
+static void
+CompactHandleHeapBlocks(memory_handle_heap *Heap, u64 ClockBudget) {
+	Assert(Heap);
+
+	u64 StartClock = __rdtsc();
+	u32 NumPassEnds = 0;
+	u32 MaxPassEnds = (ClockBudget || !Heap->CompactCursor) ? 1 : 2;
+
+	while (Heap->Top > Heap->UsedSize) {
+		if (Heap->CompactCursor >= Heap->Top) {
+			Heap->CompactCursor = 0;
+			if (++NumPassEnds == MaxPassEnds)
+				break;
+			continue;
+		}
+
+		if (ClockBudget && (__rdtsc() - StartClock) >= ClockBudget)
+			break;
+
+		uptr Offset = Heap->CompactCursor;
+		memory_handle_block *Block = GetHandleHeapBlock(Heap, Offset);
+		if (Block->HandleIndex) {
+			Heap->CompactCursor += Block->Size;
+			continue;
+		}
+
+		CoalesceHandleHeapBlock(Heap, Offset);
+		if (Offset >= Heap->Top)
+			continue;
+
+		uptr NextOffset = Offset + Block->Size;
+		memory_handle_block *NextBlock = GetHandleHeapBlock(Heap, NextOffset);
+		if (NextBlock->NumPins) {
+			Heap->CompactCursor = NextOffset + NextBlock->Size;
+			continue;
+		}
+
+		// NOTE(ivan): The data's padding might change with the block's address, so the header and the data
+		// are moved apart. The header lands in the free space in front of the block's old header.
+		uptr FreeSize = Block->Size;
+		uptr MovedSize = NextBlock->Size;
+		u8 *OldData = GetHandleHeapBlockData(NextBlock);
+		*Block = *NextBlock;
+		memmove(GetHandleHeapBlockData(Block), OldData, GetHandleHeapBlockCapacity(Block));
+		Heap->Handles[Block->HandleIndex - 1].Offset = Offset;
+		WriteFreeHandleHeapBlock(Heap, Offset + MovedSize, FreeSize);
+
+		Heap->NumMovedBytes += MovedSize;
+		Heap->CompactCursor = Offset + MovedSize;
+	}
+}
+
+static void
+InitMemoryHandleHeapBlocks(memory_handle_heap *Heap) {
+	Assert(Heap);
+
+	// NOTE(ivan): Table entries are reused from the start, bump their generations
+	// so the handles given out before the reset get stale.
+	for (u32 Index = 0; Index < Heap->NumHandles; Index++)
+		Heap->Handles[Index].Generation = (Heap->Handles[Index].Generation + 1) & 0xFF;
+
+	Heap->Top = 0;
+	Heap->UsedSize = 0;
+	Heap->NumBlocks = 0;
+	Heap->NumPinnedBlocks = 0;
+	Heap->NumHandles = 0;
+	Heap->FreeHandles = 0;
+	Heap->CompactCursor = 0;
+}
+
+void
+CreateMemoryHandleHeap(memory_handle_heap *Heap, const char *Name, u32 MaxHandles, uptr Size) {
+	Assert(Heap);
+	Assert(Name);
+	Assert(MaxHandles && MaxHandles <= MAX_MEMORY_HANDLES);
+
+#if MUTEX_PROFILING
+	GameState.PlatformAPI->ProfileMutex(&Heap->Mutex, Name);
+#endif
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	Size = AlignPartitionSize(Size);
+	uptr TableSize = AlignPow2((uptr)(sizeof(memory_handle_entry) * MaxHandles), GameState.PlatformAPI->PageSize);
+
+	Heap->TablePiece.Base = (TableSize < Size) ? EatGameMemory(TableSize) : 0;
+	Heap->Piece.Base = Heap->TablePiece.Base ? EatGameMemory(Size - TableSize) : 0;
+	if (Heap->Piece.Base) {
+		Heap->TablePiece.Size = TableSize;
+		Heap->TableCommittedSize = 0;
+		Heap->Handles = (memory_handle_entry *)Heap->TablePiece.Base;
+		Heap->MaxHandles = MaxHandles;
+
+		Heap->Piece.Size = Size - TableSize;
+		Heap->CommittedSize = 0;
+
+		strncpy(Heap->Name, Name, ArraySize(Heap->Name) - 1);
+
+		InitMemoryHandleHeapBlocks(Heap);
+
+#if MEMORY_TELEMETRY
+		RegisterMemoryTraceContainer(&Heap->Telemetry, MemoryPartitionType_HandleHeap, Name, Size, 0, MaxHandles, 0);
+#endif
+	} else {
+		GameState.PlatformAPI->Crashf("CreateMemoryHandleHeap[%s]: Out of memory!", Name);
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+void
+ResetMemoryHandleHeap(memory_handle_heap *Heap, u32 Flags) {
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Reset, 0, 0, Flags);
+#endif
+
+	// NOTE(ivan): The handle table is never cleared, its generations must survive the reset.
+	if (Flags & MemoryFlag_Zero) {
+		ClearPartitionMemory(&Heap->Piece, &Heap->CommittedSize, Heap->HighWaterMark);
+		Heap->HighWaterMark = 0;
+	}
+	InitMemoryHandleHeapBlocks(Heap);
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+memory_handle
+AllocHandleFromHeapTagged(memory_handle_heap *Heap, uptr Size, u32 Flags, const char *File, u32 Line) {
+	Assert(Heap);
+	Assert(Size);
+	UnusedParam(File);
+	UnusedParam(Line);
+
+	memory_handle Result = 0;
 
-			memory_heap_block *NewBlock = (memory_heap_block *)((u8 *)HostBlock
-																+ sizeof(memory_heap_block) + HostBlock->Size);
-			NewBlock->Size = Size;
-			NewBlock->IsFree = false;
-			NewBlock->NextBlock = HostBlock->NextBlock;
-			NewBlock->PrevBlock = HostBlock;
+	EnterTicketMutex(&Heap->Mutex);
+
+	u32 Index = 0;
+	if (Heap->FreeHandles) {
+		Index = Heap->FreeHandles;
+		Heap->FreeHandles = Heap->Handles[Index - 1].NextFree;
+	} else if (Heap->NumHandles < Heap->MaxHandles &&
+			   CommitPartitionMemory(&Heap->TablePiece, &Heap->TableCommittedSize,
+									 sizeof(memory_handle_entry) * (Heap->NumHandles + 1))) {
+		Index = ++Heap->NumHandles;
+	}
+
+	if (Index) {
+		memory_handle_entry *Entry = Heap->Handles + (Index - 1);
+		uptr Alignment = Max(GetMemoryFlagsAlignment(Flags), (uptr)MEMORY_HANDLE_HEAP_ALIGNMENT);
+		uptr BlockSize = AlignPow2(GetHandleHeapHeaderSize() + Size + (Alignment - MEMORY_HANDLE_HEAP_ALIGNMENT),
+								   (uptr)MEMORY_HANDLE_HEAP_ALIGNMENT);
+
+		// NOTE(ivan): No room even for first-fit, compact the whole heap and try once more.
+		uptr Offset = 0;
+		b32 IsFound = FindHandleHeapSpace(Heap, BlockSize, &Offset);
+		if (!IsFound) {
+			CompactHandleHeapBlocks(Heap, 0);
+			IsFound = FindHandleHeapSpace(Heap, BlockSize, &Offset);
+		}
+
+		if (IsFound) {
+			memory_handle_block *Block = GetHandleHeapBlock(Heap, Offset);
+			Block->HandleIndex = Index;
+			Block->NumPins = 0;
+			Block->Alignment = (u16)Alignment;
+			Block->Size = BlockSize;
+			Entry->Offset = Offset;
 
-			if (HostBlock->NextBlock)
-				HostBlock->NextBlock->PrevBlock = NewBlock;
-			HostBlock->NextBlock = NewBlock;
+			if (Flags & MemoryFlag_Zero)
+				memset(GetHandleHeapBlockData(Block), 0, GetHandleHeapBlockCapacity(Block));
 
 			Heap->NumBlocks++;
-			Heap->UsedSize += RealSize;
-			
-			Result = (void *)((u8 *)NewBlock + sizeof(memory_heap_block));
-			memset(Result, 0, Size);
+			Heap->UsedSize += BlockSize;
+
+			Result = (Entry->Generation << 24) | Index;
+		} else {
+			Entry->NextFree = Heap->FreeHandles;
+			Heap->FreeHandles = Index;
 		}
+	}
+
+	if (Result) {
+#if MEMORY_TELEMETRY
+		RecordMemoryAlloc(&Heap->Telemetry, Size, Heap->UsedSize, File, Line);
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, Result, Size, Flags);
+#endif
 	} else {
-		GameState.PlatformAPI->Outf("AllocFromHeap[%s]: Out of memory!", Heap->Name);
+#if MEMORY_TELEMETRY
+		RecordMemoryFailedAlloc(&Heap->Telemetry, File, Line);
+		RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Alloc, 0, Size, Flags);
+#endif
+		GameState.PlatformAPI->Outf("AllocHandleFromHeap[%s]: Out of memory!", Heap->Name);
 	}
-	
+
 	LeaveTicketMutex(&Heap->Mutex);
 
 	return Result;
 }
 
 void
-FreeFromHeap(memory_heap *Heap, void *Base) {
+FreeHandleFromHeap(memory_handle_heap *Heap, memory_handle Handle) {
 	Assert(Heap);
-	Assert(Base);
 
 	EnterTicketMutex(&Heap->Mutex);
 
-	memory_heap_block *Block = (memory_heap_block *)((u8 *)Base - sizeof(memory_heap_block));
-	uptr RealSize = Block->Size + sizeof(memory_heap_block);
+	memory_handle_entry *Entry = GetMemoryHandleEntry(Heap, Handle);
+	Assert(Entry);
+
+	memory_handle_block *Block = GetHandleHeapBlock(Heap, Entry->Offset);
+	Assert(!Block->NumPins);
+
+	Heap->NumBlocks--;
+	Heap->UsedSize -= Block->Size;
+
+	Block->HandleIndex = 0;
+	CoalesceHandleHeapBlock(Heap, Entry->Offset);
+
+	Entry->Generation = (Entry->Generation + 1) & 0xFF;
+	Entry->NextFree = Heap->FreeHandles;
+	Heap->FreeHandles = (Handle & MAX_MEMORY_HANDLES);
+
+#if MEMORY_TELEMETRY
+	RecordMemoryFree(&Heap->Telemetry);
+	RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Free, Handle, 0, 0);
+#endif
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+void *
+ResolveMemoryHandle(memory_handle_heap *Heap, memory_handle Handle) {
+	Assert(Heap);
+
+	void *Result = 0;
+
+	EnterTicketMutex(&Heap->Mutex);
 
-	memory_heap_block *HostBlock = 0;
-	memory_heap_block *NeighborBlock = 0;
-	if (Block->NextBlock && Block->NextBlock->IsFree) {
-		HostBlock = Block;
-		NeighborBlock = Block->NextBlock;
+	memory_handle_entry *Entry = GetMemoryHandleEntry(Heap, Handle);
+	if (Entry)
+		Result = GetHandleHeapBlockData(GetHandleHeapBlock(Heap, Entry->Offset));
+
+	LeaveTicketMutex(&Heap->Mutex);
+
+	return Result;
+}
+
+void *
+PinMemoryHandle(memory_handle_heap *Heap, memory_handle Handle) {
+	Assert(Heap);
+
+	void *Result = 0;
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	memory_handle_entry *Entry = GetMemoryHandleEntry(Heap, Handle);
+	if (Entry) {
+		memory_handle_block *Block = GetHandleHeapBlock(Heap, Entry->Offset);
+		Assert(Block->NumPins < 0xFFFF);
+		if (!Block->NumPins++)
+			Heap->NumPinnedBlocks++;
+
+		Result = GetHandleHeapBlockData(Block);
+	}
+
+	LeaveTicketMutex(&Heap->Mutex);
+
+	return Result;
+}
+
+void
+UnpinMemoryHandle(memory_handle_heap *Heap, memory_handle Handle) {
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+
+	memory_handle_entry *Entry = GetMemoryHandleEntry(Heap, Handle);
+	Assert(Entry);
+
+	memory_handle_block *Block = GetHandleHeapBlock(Heap, Entry->Offset);
+	Assert(Block->NumPins);
+	if (!--Block->NumPins)
+		Heap->NumPinnedBlocks--;
+
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+void
+CompactMemoryHandleHeap(memory_handle_heap *Heap, u64 ClockBudget) {
+	Assert(Heap);
+
+	EnterTicketMutex(&Heap->Mutex);
+#if MEMORY_TELEMETRY
+	RecordMemoryTrace(&Heap->Telemetry, MemoryTraceOp_Compact, 0, ClockBudget, 0);
+#endif
+	CompactHandleHeapBlocks(Heap, ClockBudget);
+	LeaveTicketMutex(&Heap->Mutex);
+}
+
+// NOTE(ivan): Size of an entry that does not depend on the other entries, 0 for weighted entries.
+static uptr
+GetMemoryPlanEntryFixedSize(memory_plan_entry *Entry) {
+	Assert(Entry);
+
+	uptr Result = 0;
+
+	switch (Entry->Unit) {
+	case MemoryPlanUnit_Bytes: {
+		Result = AlignPow2(Entry->Amount, Max(GameState.PlatformAPI->PageSize, (uptr)1));
+	} break;
+
+	case MemoryPlanUnit_Count: {
+		if (Entry->Type == MemoryPartitionType_Pool) {
+			Result = CalculateMemoryPoolSize(Entry->BlockSize, (u32)Entry->Amount, Entry->Param, Entry->PoolFlags, 0);
+		} else if (Entry->Type == MemoryPartitionType_GrowablePool) {
+			Result = CalculateMemoryPoolSize(Entry->BlockSize, (u32)Entry->Amount, 0,
+											 MemoryPoolFlag_Bitmap | MemoryPoolFlag_Growable, Entry->Param);
+		} else {
+			GameState.PlatformAPI->Crashf("ApplyMemoryPlan[%s]: Only pools can be sized by count!", Entry->Name);
+		}
+	} break;
+
+	case MemoryPlanUnit_Weight: {
+	} break;
+	}
+
+	return Result;
+}
+
+static void
+CreateMemoryPlanEntry(memory_plan_entry *Entry) {
+	Assert(Entry);
+	Assert(Entry->Partition || Entry->Type == MemoryPartitionType_Spare);
+
+	switch (Entry->Type) {
+	case MemoryPartitionType_Stack: {
+		CreateMemoryStack((memory_stack *)Entry->Partition, Entry->Name, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_DoubleStack: {
+		CreateMemoryDoubleStack((memory_double_stack *)Entry->Partition, Entry->Name, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_FrameArena: {
+		CreateMemoryFrameArena((memory_frame_arena *)Entry->Partition, Entry->Name, Entry->Param, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_Heap: {
+		CreateMemoryHeap((memory_heap *)Entry->Partition, Entry->Name, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_Pool: {
+		CreateMemoryPool((memory_pool *)Entry->Partition, Entry->Name, Entry->BlockSize, Entry->Size,
+						 Entry->Param, Entry->PoolFlags);
+	} break;
+
+	case MemoryPartitionType_GrowablePool: {
+		CreateGrowableMemoryPool((memory_pool *)Entry->Partition, Entry->Name, Entry->BlockSize, Entry->Size,
+								 Entry->ParentHeap, Entry->Param);
+	} break;
+
+	case MemoryPartitionType_Buddy: {
+		CreateMemoryBuddy((memory_buddy *)Entry->Partition, Entry->Name, Entry->BlockSize, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_HandleHeap: {
+		CreateMemoryHandleHeap((memory_handle_heap *)Entry->Partition, Entry->Name, Entry->Param, Entry->Size);
+	} break;
+
+	case MemoryPartitionType_Spare: {
+		// NOTE(ivan): Spare space is just left free.
+	} break;
+	}
+}
+
+uptr
+ApplyMemoryPlan(memory_plan_entry *Entries, u32 NumEntries) {
+	Assert(Entries);
+	Assert(NumEntries);
+
+	const f64 Mb = (f64)(1024 * 1024);
+
+	EnterTicketMutex(&GameState.GameMemory->Mutex);
+	uptr FreeSize = GameState.GameMemory->FreeStorage.Size;
+	LeaveTicketMutex(&GameState.GameMemory->Mutex);
+
+	// NOTE(ivan): Absolute sizes and counts go first, weighted entries share the rest.
+	uptr FixedSize = 0;
+	uptr TotalWeight = 0;
+	for (u32 Index = 0; Index < NumEntries; Index++) {
+		memory_plan_entry *Entry = &Entries[Index];
+
+		Entry->Size = GetMemoryPlanEntryFixedSize(Entry);
+		FixedSize += Entry->Size;
+		if (Entry->Unit == MemoryPlanUnit_Weight)
+			TotalWeight += Entry->Amount;
 	}
-	if (Block->PrevBlock && Block->PrevBlock->IsFree) {
-		HostBlock = Block->PrevBlock;
-		NeighborBlock = Block;
+	if (FixedSize > FreeSize)
+		GameState.PlatformAPI->Crashf("ApplyMemoryPlan: Partitions need %.3f Mb, but only %.3f Mb are free!",
+									  (f64)FixedSize / Mb, (f64)FreeSize / Mb);
+
+	uptr WeightSize = TotalWeight ? ((FreeSize - FixedSize) / TotalWeight) : 0;
+	for (u32 Index = 0; Index < NumEntries; Index++) {
+		memory_plan_entry *Entry = &Entries[Index];
+		if (Entry->Unit == MemoryPlanUnit_Weight)
+			Entry->Size = AlignPartitionSize(WeightSize * Entry->Amount);
 	}
 
-	if (HostBlock && NeighborBlock) {
-		HostBlock->Size += NeighborBlock->Size + sizeof(memory_heap_block);
-		HostBlock->IsFree = true;
-		HostBlock->NextBlock = NeighborBlock->NextBlock;
-		if (NeighborBlock->NextBlock)
-			NeighborBlock->NextBlock->PrevBlock = HostBlock;
-	} else {
-		Block->IsFree = true;
+	for (u32 Index = 0; Index < NumEntries; Index++) {
+		memory_plan_entry *Entry = &Entries[Index];
+
+		SetPartitionsNUMANode(Entry->IsNUMABound ? (s32)Entry->NUMANode : NOTFOUND);
+		CreateMemoryPlanEntry(Entry);
 	}
+	SetPartitionsNUMANode(NOTFOUND);
 
-	Heap->UsedSize -= RealSize;
+	EnterTicketMutex(&GameState.GameMemory->Mutex);
+	uptr Result = GameState.GameMemory->FreeStorage.Size;
+	LeaveTicketMutex(&GameState.GameMemory->Mutex);
 
-	LeaveTicketMutex(&Heap->Mutex);
+	return Result;
 }
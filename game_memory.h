@@ -6,116 +6,678 @@
 // NOTE(ivan): Memory management partitions/containers.
 //
 // Each container (stack, pool, etc...) is a limited partition of a primary storage provided in game_memory structure.
-// Each container's initialization function (CreateMemoryStack, CreateMemoryPool, etc...) takes a percentage value that
-// tells how much space should be eated from primary storage, and returns percentage value of how much space is left
-// in there, and this percentage value should be used to initialize next partition. It is important,
-// because some specialized containers (f.e. memory pool) does not allocate an exact given percentage of required memory,
-// sometimes it allocates more or less, because it is almost impossible to manually calculate wanted memory space for all
-// pool blocks in a form of percentage, especially when a primary storage total size is always various.
+// Each container's initialization function (CreateMemoryStack, CreateMemoryPool, etc...) takes a size in bytes
+// that tells how much space should be eated from primary storage. The size covers everything the container eats,
+// its bookkeeping included, and is rounded down to the page size, so a container never eats more than it is given.
 //
 // All memory partitions are living in game_state structure, and all initial memory partitionnig is done in
-// GameTrigger() function's initialization stage. Typical partition strategy: creating first partition with some percentage
-// of wanted memory and getting left free space as a percent. After that, creating next partition with a percent of
-// wanted memory calculated using previously owned percentage of left free space. And so on...
+// GameTrigger() function's initialization stage. Partition sizes are not hardcoded at the call sites,
+// instead they are described by a partition plan (see memory_plan_entry below): a table that lists each container
+// with an absolute size, a count of elements, or a weight of the space left by the other entries.
+// The plan is resolved to exact sizes in one pass, and can be overridden per deployment with a plan file.
 //
 // None of the containers declared below can/should ever be released, freed, deallocated, whatever you call it.
-// The entire primary storage gets allocated and deallocated in platform abstraction layer at program's initialization
+// The entire primary storage gets reserved and released in platform abstraction layer at program's initialization
 // and deinitialization respectively. However, it is possible to *reset* the partition, which means complete partition
 // cleanup, zeroing included.
+//
+// The primary storage is reserved address space only. A partition's size is a hard cap, not memory taken up front:
+// each container commits the partition's pages on demand, as its mark or high-water mark advances.
+//
+// Container structures are laid out by cache lines: the mutex takes the first line, the fields used by every allocation
+// follow it, and the fields that are rarely touched (name, telemetry) start on a line of their own. Containers are
+// thus cache line aligned, and threads working with neighbor containers never fight over a shared line.
+
+// NOTE(ivan): Partitions created after SetPartitionsNUMANode() are bound to a given NUMA node: their pages
+// are placed on the node's memory when committed, so they are cheap to access by threads running on that node.
+// Pass NOTFOUND to create unbound partitions again, which is the default.
+void SetPartitionsNUMANode(s32 Node);
+
+// NOTE(ivan): Memory allocation and reset flags.
+enum memory_flags {
+	MemoryFlag_Zero = (1 << 0), // NOTE(ivan): Allocation - clear the returned memory, reset - clear all dirty memory.
+
+	// NOTE(ivan): Allocation - align the returned memory to 16, 32 or 64 bytes instead of the default 8 bytes.
+	MemoryFlag_Align16 = (1 << 1),
+	MemoryFlag_Align32 = (1 << 2),
+	MemoryFlag_Align64 = (1 << 3)
+};
+
+#define MEMORY_DEFAULT_ALIGNMENT 8
 
+// NOTE(ivan): Alignment requested by allocation flags, the strongest one wins.
 inline uptr
-PercentageToSize(u32 SizePercentage, uptr TotalSize) {
-	Assert(SizePercentage);
-	Assert(TotalSize);
+GetMemoryFlagsAlignment(u32 Flags) {
+	if (Flags & MemoryFlag_Align64)
+		return 64;
+	if (Flags & MemoryFlag_Align32)
+		return 32;
+	if (Flags & MemoryFlag_Align16)
+		return 16;
 
-	return (uptr)(((f64)TotalSize / 100.0) * SizePercentage);
+	return MEMORY_DEFAULT_ALIGNMENT;
 }
-inline u32
-SizeToPercentage(uptr Size, uptr TotalSize) {
-	Assert(Size);
-	Assert(TotalSize);
 
-	return (u32)(((f64)Size / (f64)TotalSize) * 100.0);
-}
+// NOTE(ivan): Dirty memory ranges at least this large are not cleared by writing zeros,
+// instead their pages are given back to the OS which hands out zeroed pages on next touch.
+#define MEMORY_PURGE_THRESHOLD Kilobytes(256)
+
+// NOTE(ivan): Partitions commit their pages in steps of this size.
+#define MEMORY_COMMIT_GRANULARITY Kilobytes(64)
+
+// NOTE(ivan): Memory telemetry, compiled in internal builds only.
+// Every container counts its allocations, frees and failed allocations, keeps the peak of its used size
+// (never lowered by resets, so it tells how big the partition really has to be), a log2 histogram
+// of requested sizes, and a table of call sites that allocated from it. The Alloc* macros below
+// capture the call site's file and line, all counters are updated with atomics.
+#if INTERNAL
+#    define MEMORY_TELEMETRY 1
+#else
+#    define MEMORY_TELEMETRY 0
+#endif
+
+// NOTE(ivan): Histogram bucket N counts requested sizes in [2^N, 2^(N+1)).
+#define MEMORY_TELEMETRY_HISTOGRAM_SIZE 32
+#define MAX_MEMORY_TELEMETRY_CALL_SITES 64
+
+// NOTE(ivan): Call site table slot. Slots are claimed with AtomicCompareExchangeU64() on Key,
+// so File/Line might be not yet visible to a reader for a moment after the slot has been claimed.
+struct memory_call_site {
+	volatile u64 Key; // NOTE(ivan): 0 if the slot is free.
+	const char *File;
+	u32 Line;
+
+	volatile u64 NumAllocs;
+	volatile u64 NumFailedAllocs;
+	volatile u64 TotalSize;
+};
+
+struct memory_telemetry {
+	volatile u64 NumAllocs;
+	volatile u64 NumFrees;
+	volatile u64 NumFailedAllocs;
+
+	volatile u64 UsedSize; // NOTE(ivan): Maintained by the telemetry itself only for the containers that do not track it.
+	volatile u64 PeakUsedSize;
+
+	volatile u64 SizeHistogram[MEMORY_TELEMETRY_HISTOGRAM_SIZE];
+
+	memory_call_site CallSites[MAX_MEMORY_TELEMETRY_CALL_SITES];
+	volatile u64 NumLostCallSites; // NOTE(ivan): Allocations whose call site did not fit into the table.
+
+	u32 TraceId; // NOTE(ivan): Container's id in memory trace, 0 if the container is not registered.
+};
+
+// NOTE(ivan): Call site tag passed by the Alloc* macros to the *Tagged() functions.
+#if MEMORY_TELEMETRY
+#    define MEMORY_CALL_SITE __FILE__, __LINE__
+#else
+#    define MEMORY_CALL_SITE 0, 0
+#endif
 
 // NOTE(ivan): Single-sided memory stack.
 struct memory_stack {
-	char Name[128];
+	ticket_mutex Mutex;
 
 	piece Piece;
 	uptr Mark;
+	uptr HighWaterMark; // NOTE(ivan): Highest mark since the last zeroing reset, everything below is dirty.
+	uptr CommittedSize;
+
+	u32 NumTemporaryScopes; // NOTE(ivan): Count of currently open temporary memory scopes.
+	u64 NumAllocations;     // NOTE(ivan): Live allocations, the ones a scope end or a reset releases are recorded as frees.
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
+};
+
+void CreateMemoryStack(memory_stack *Stack, const char *Name, uptr Size);
+void ResetMemoryStack(memory_stack *Stack, u32 Flags);
+
+// NOTE(ivan): Each allocation is followed by a size footer PopStack() reads, except for the allocations made
+// while a temporary memory scope is open: those are only released by EndTemporaryMemory(), so they go without.
+void *AllocFromStackTagged(memory_stack *Stack, uptr Size, u32 Flags, const char *File, u32 Line);
+#define AllocFromStack(Stack, Size, Flags) AllocFromStackTagged(Stack, Size, Flags, MEMORY_CALL_SITE)
+void PopStack(memory_stack *Stack); // NOTE(ivan): Must not be called while a temporary memory scope is open.
+
+// NOTE(ivan): Temporary memory scope. Remembers the stack mark at BeginTemporaryMemory() and rolls
+// the stack back to it at EndTemporaryMemory(), releasing everything allocated inside the scope at once.
+// Scopes can be nested, but must be closed in reverse order of opening.
+struct temporary_memory {
+	memory_stack *Stack;
+	uptr Mark;
+	u64 NumAllocations;
+	u32 Depth;
+};
+
+temporary_memory BeginTemporaryMemory(memory_stack *Stack);
+void EndTemporaryMemory(temporary_memory TempMemory);
+
+// NOTE(ivan): Double-ended memory stack ends.
+enum memory_stack_end {
+	MemoryStackEnd_Low = 0, // NOTE(ivan): Grows up from the partition's base.
+	MemoryStackEnd_High,    // NOTE(ivan): Grows down from the partition's end.
 
+	MemoryStackEnd_MaxCount
+};
+
+// NOTE(ivan): Double-ended memory stack. Both ends share one partition and grow towards each other,
+// each end has its own mark, temporary scopes, and reset, so the data on one end is released
+// without touching the other one (f.e. level data on the low end, and load-time scratch on the high end
+// that is thrown away in one reset once the level is loaded). Allocations have
+// no headers, so there is no popping of a single allocation, use temporary scopes instead.
+// Each end commits pages from its side, never into the pages already committed by the other end.
+struct memory_double_stack {
 	ticket_mutex Mutex;
+
+	piece Piece;
+	uptr Marks[MemoryStackEnd_MaxCount];          // NOTE(ivan): Used size at each end.
+	uptr HighWaterMarks[MemoryStackEnd_MaxCount]; // NOTE(ivan): Highest mark since the end's last zeroing reset.
+	uptr CommittedSizes[MemoryStackEnd_MaxCount]; // NOTE(ivan): Committed size at each end.
+
+	u32 NumTemporaryScopes[MemoryStackEnd_MaxCount];
+	u64 NumAllocations[MemoryStackEnd_MaxCount]; // NOTE(ivan): Live allocations at each end.
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
 };
 
-// NOTE(ivan): CreateMemoryStack() returns a percentage of left free space of primary storage.
-// It never eats more memory than the caller defined in SizePercentage.
-u32 CreateMemoryStack(memory_stack *Stack, const char *Name, u32 SizePercentage);
-void ResetMemoryStack(memory_stack *Stack);
+void CreateMemoryDoubleStack(memory_double_stack *Stack, const char *Name, uptr Size);
+void ResetMemoryDoubleStack(memory_double_stack *Stack, memory_stack_end End, u32 Flags); // NOTE(ivan): Resets one end only.
 
-void *AllocFromStack(memory_stack *Stack, uptr Size);
-void PopStack(memory_stack *Stack);
+void *AllocFromDoubleStackTagged(memory_double_stack *Stack, memory_stack_end End, uptr Size, u32 Flags,
+								 const char *File, u32 Line);
+#define AllocFromDoubleStack(Stack, End, Size, Flags) AllocFromDoubleStackTagged(Stack, End, Size, Flags, MEMORY_CALL_SITE)
 
-// NOTE(ivan): Memory pool block. This structure lives in the beginning of allocated block space,
-// before the actual data memory. Total memory size for each block is sizeof(memory_pool_block) + BlockSize.
-struct memory_pool_block {
-	memory_pool_block *NextBlock;
-	memory_pool_block *PrevBlock;
+// NOTE(ivan): Temporary memory scope on one end of a double-ended stack, works like temporary_memory.
+struct double_stack_temporary_memory {
+	memory_double_stack *Stack;
+	memory_stack_end End;
+	uptr Mark;
+	u64 NumAllocations;
+	u32 Depth;
 };
 
+double_stack_temporary_memory BeginDoubleStackTemporaryMemory(memory_double_stack *Stack, memory_stack_end End);
+void EndDoubleStackTemporaryMemory(double_stack_temporary_memory TempMemory);
+
+// NOTE(ivan): Maximum count of buffers in a frame arena.
+#define MAX_MEMORY_FRAME_ARENA_BUFFERS 4
+
+// NOTE(ivan): Frame arena, a linear allocator for data that lives for a fixed number of frames.
+// The partition is split into NumBuffers equal buffers, only one of them is current at a time.
+// Allocation is a lock-free bump of the current buffer's mark, with no headers and no free lists.
+// AdvanceFrameArena() makes the next buffer current and rewinds its mark, so everything allocated
+// in frame N stays valid until frame N + NumBuffers starts (f.e. simulation output of frame N
+// can still be read by rendering in frame N + 1 with two buffers).
+struct memory_frame_arena {
+	ticket_mutex Mutex; // NOTE(ivan): Taken by CreateMemoryFrameArena() and when committing more pages.
+
+	piece Piece;
+	uptr BufferSize;
+	u32 NumBuffers;
+	u32 CurrentBuffer;
+
+	volatile uptr CommittedSizes[MAX_MEMORY_FRAME_ARENA_BUFFERS]; // NOTE(ivan): Grow under the mutex.
+	uptr DirtySizes[MAX_MEMORY_FRAME_ARENA_BUFFERS]; // NOTE(ivan): Used size of each buffer since its last zeroing.
+
+	// NOTE(ivan): Bumped by every allocation, so it lives on its own line and does not
+	// keep throwing the fields above out of the other threads' caches.
+	CacheAligned volatile u64 Mark; // NOTE(ivan): Bump offset within the current buffer.
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
+};
+
+// NOTE(ivan): The size is split evenly between the buffers.
+void CreateMemoryFrameArena(memory_frame_arena *Arena, const char *Name, u32 NumBuffers, uptr Size);
+void AdvanceFrameArena(memory_frame_arena *Arena, u32 Flags); // NOTE(ivan): Must not run concurrently with AllocFromFrameArena().
+
+void *AllocFromFrameArenaTagged(memory_frame_arena *Arena, uptr Size, u32 Flags, const char *File, u32 Line);
+#define AllocFromFrameArena(Arena, Size, Flags) AllocFromFrameArenaTagged(Arena, Size, Flags, MEMORY_CALL_SITE)
+
+// NOTE(ivan): Maximum count of threads that can have their own memory pool magazines at once.
+// Threads beyond this limit work with the shared free stack directly. A thread keeps its slot
+// and the blocks in its magazines until it calls ReleaseMemoryThread(). Must not be more than 64.
+#define MAX_MEMORY_POOL_THREADS 64
+
+// NOTE(ivan): Maximum count of pools with magazines.
+#define MAX_MEMORY_MAGAZINE_POOLS 64
+
+// NOTE(ivan): Memory pool magazine, a small per-thread cache of free blocks. It is followed in memory
+// by an array of MagazineSize block pointers. Only the owning thread ever touches its magazine,
+// except for statistics output.
+struct memory_pool_magazine {
+	u32 NumBlocks;
+
+	u64 NumHits;   // NOTE(ivan): Allocations served straight from the magazine.
+	u64 NumMisses; // NOTE(ivan): Allocations that had to refill the magazine from the shared free stack.
+};
+
+// NOTE(ivan): Memory pool layout flags.
+enum memory_pool_flags {
+	MemoryPoolFlag_Bitmap = (1 << 0),  // NOTE(ivan): Track blocks occupancy in a bitmap instead of a free stack.
+	MemoryPoolFlag_Growable = (1 << 1) // NOTE(ivan): Set by CreateGrowableMemoryPool() only.
+};
+
+// NOTE(ivan): Maximum count of chunks a growable memory pool can link beyond its own partition.
+#define MAX_MEMORY_POOL_CHUNKS 64
+
+struct memory_heap;
+
 // NOTE(ivan): Memory pool.
+// The pool is lock-free: free blocks form a Treiber stack, each free block stores the index of the next
+// free block in its first bytes, so there are no per-block headers. The stack head is a tagged index
+// (high 32 bits - tag bumped on every change to defeat ABA, low 32 bits - block index + 1, 0 means empty)
+// that is swapped with AtomicCompareExchangeU64(), so allocating and freeing never take the mutex.
+//
+// If the pool is created with non-zero MagazineSize, each thread keeps its own magazine of free blocks
+// in front of the shared stack, refilling and draining it by MagazineSize / 2 blocks at once,
+// so most of the allocations touch thread-private memory only.
+//
+// Blocks are carved from the partition lazily in address order when the free stack runs dry,
+// so creating the pool costs nothing and a zeroing reset clears only the blocks ever used.
+//
+// If the pool is created with MemoryPoolFlag_Bitmap, there is no free stack: each block has a bit in
+// an occupancy bitmap that is committed up front, and allocation claims the lowest free bit
+// with AtomicCompareExchangeU64(). Live blocks stay packed towards the partition's base, they can be
+// walked in address order with GetNextPoolBlock(), and a reset only clears the bitmap words ever touched.
+// Such pools have no magazines.
+//
+// A growable pool is a bitmap pool that links extra chunks of BlocksPerChunk blocks allocated from
+// a parent heap when its own partition runs dry, existing blocks never move. Chunk blocks are numbered
+// past the partition's bitmap words, and bitmap words of the chunks not linked at the moment are
+// kept full, so nothing can be claimed from them. Once the tail chunk gets empty and the rest
+// of the pool has at least half a chunk of free blocks, the chunk is given back to the parent heap.
+//
+// Blocks are aligned to the largest power of two the block size is a multiple of, but not more than CACHE_LINE_SIZE,
+// so the block size has to be rounded up to get allocations of a stronger alignment out of a pool.
 struct memory_pool {
-	char Name[128];
+	ticket_mutex Mutex; // NOTE(ivan): Taken by CreateMemoryPool(), ResetMemoryPool(), when committing more pages, and when linking or releasing chunks.
 
+	// NOTE(ivan): Fields that rarely change after the pool has been created.
 	piece Piece;
-	memory_pool_block *AllocBlocks; // NOTE(ivan): Linked list of all allocated blocks.
-	memory_pool_block *FreeBlocks;  // NOTE(ivan): Linked list of all free blocks.
-	u32 NumAllocBlocks;
-	u32 NumFreeBlocks;
+	volatile uptr CommittedSize; // NOTE(ivan): Grows under the mutex.
 
 	uptr BlockSize;
 	u32 MaxBlocks;
+	u32 PoolFlags;
 
-	ticket_mutex Mutex;
+	volatile u64 *Bitmap;      // NOTE(ivan): Bit set means the block is allocated, 0 if the pool has no bitmap.
+	uptr BitmapSize;
+	u32 NumPrimaryBitmapWords; // NOTE(ivan): Words that cover the pool's own partition.
+	volatile u32 NumBitmapWords; // NOTE(ivan): Words that cover the partition and linked chunks.
+
+	memory_heap *ParentHeap;   // NOTE(ivan): Growable pools only.
+	u32 BlocksPerChunk;
+	u8 * volatile Chunks[MAX_MEMORY_POOL_CHUNKS];
+	volatile u32 NumChunks;
+
+	u8 *Magazines;       // NOTE(ivan): MAX_MEMORY_POOL_THREADS magazines, each one is cache-line aligned.
+	uptr MagazineStride; // NOTE(ivan): Distance in bytes between two neighbor magazines.
+	u32 MagazineSize;    // NOTE(ivan): 0 if the pool has no magazines.
+
+	// NOTE(ivan): Fields that are swapped by allocations and frees, kept away from the ones above
+	// that are read by every allocation.
+	CacheAligned volatile u64 FreeHead;
+	volatile u32 NumCarvedBlocks; // NOTE(ivan): Blocks below this index have been handed out at least once.
+	volatile u32 NumAllocBlocks; // NOTE(ivan): Blocks out of the shared stack, magazines included. Statistics only.
+	volatile u32 BitmapHint;   // NOTE(ivan): No free bits below this word, except for a rare race with FreeFromPool().
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
 };
 
-// NOTE(ivan): CreateMemoryPool() returns percentage of left free space of game primary storage.
-// It might be larger that the caller expects, because memory pool allocates more space
-// if a given SizePercentage converted to a wanted size of bytes is too small for all blocks
-// with a given BlockSize.
-u32 CreateMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, u32 SizePercentage);
-void ResetMemoryPool(memory_pool *Pool);
+// NOTE(ivan): CreateMemoryPool() fits as many blocks as it can into a given size, along with the magazines
+// and the bitmap. Set MagazineSize to 0 to disable per-thread magazines. PoolFlags is a combination of memory_pool_flags.
+// CalculateMemoryPoolSize() tells the size a pool needs to hold NumBlocks blocks.
+void CreateMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, uptr Size, u32 MagazineSize, u32 PoolFlags);
+uptr CalculateMemoryPoolSize(uptr BlockSize, u32 NumBlocks, u32 MagazineSize, u32 PoolFlags, u32 BlocksPerChunk);
+// NOTE(ivan): Creates a bitmap pool that grows by chunks of BlocksPerChunk blocks (rounded up to 64)
+// allocated from a given heap when its partition runs dry. ResetMemoryPool() gives all chunks back.
+void CreateGrowableMemoryPool(memory_pool *Pool, const char *Name, uptr BlockSize, uptr Size,
+							  memory_heap *ParentHeap, u32 BlocksPerChunk);
+void ResetMemoryPool(memory_pool *Pool, u32 Flags); // NOTE(ivan): Must not run concurrently with AllocFromPool()/FreeFromPool().
 
-void * AllocFromPool(memory_pool *Pool);
+inline memory_pool_magazine *
+GetPoolMagazine(memory_pool *Pool, u32 ThreadIndex) {
+	Assert(Pool);
+	Assert(Pool->Magazines);
+	Assert(ThreadIndex < MAX_MEMORY_POOL_THREADS);
+
+	return (memory_pool_magazine *)(Pool->Magazines + (Pool->MagazineStride * ThreadIndex));
+}
+
+void * AllocFromPoolTagged(memory_pool *Pool, u32 Flags, const char *File, u32 Line);
+#define AllocFromPool(Pool, Flags) AllocFromPoolTagged(Pool, Flags, MEMORY_CALL_SITE)
 void FreeFromPool(memory_pool *Pool, void *Base);
 
-// NOTE(ivan): Memory heap block.
+// NOTE(ivan): Gives the calling thread's magazine blocks back to the pools' shared free stacks and its
+// magazine slot back for reuse. Must be called by each thread that has used the pools before it exits.
+void ReleaseMemoryThread(void);
+
+// NOTE(ivan): Batch versions hand out or give back NumBlocks blocks at once, with one exchange per free stack
+// or bitmap word instead of one per block. They bypass the magazines. Allocation is all or nothing.
+b32 AllocFromPoolBatchTagged(memory_pool *Pool, void **Blocks, u32 NumBlocks, u32 Flags, const char *File, u32 Line);
+#define AllocFromPoolBatch(Pool, Blocks, NumBlocks, Flags) AllocFromPoolBatchTagged(Pool, Blocks, NumBlocks, Flags, MEMORY_CALL_SITE)
+void FreeFromPoolBatch(memory_pool *Pool, void **Blocks, u32 NumBlocks);
+
+// NOTE(ivan): Bitmap pools only. Returns the first allocated block after a given one in address order,
+// or the very first allocated block if Block is 0. Returns 0 when there are no more allocated blocks.
+void * GetNextPoolBlock(memory_pool *Pool, void *Block);
+
+// NOTE(ivan): Memory heap size classes.
+// Free blocks are kept in segregated lists (two-level segregated fit): the first level splits sizes by
+// power of two, the second level splits each power-of-two range into MEMORY_HEAP_SL_COUNT linear classes.
+// Sizes below MEMORY_HEAP_SMALL_SIZE all go to the first-level class 0 with 8-byte granularity.
+// A bitmap of non-empty classes is kept for each level, so finding a suitable free block
+// takes a couple of bit scans no matter how many blocks the heap consists of.
+#define MEMORY_HEAP_SL_LOG2 4
+#define MEMORY_HEAP_SL_COUNT (1 << MEMORY_HEAP_SL_LOG2)
+#define MEMORY_HEAP_SMALL_LOG2 (MEMORY_HEAP_SL_LOG2 + 3)
+#define MEMORY_HEAP_SMALL_SIZE (1 << MEMORY_HEAP_SMALL_LOG2)
+#define MEMORY_HEAP_FL_COUNT (sizeof(uptr) * 8 - MEMORY_HEAP_SMALL_LOG2 + 1)
+
+// NOTE(ivan): Memory heap block. This structure lives in the beginning of each block space,
+// before the actual data memory. NextBlock/PrevBlock link physically adjacent blocks,
+// NextFreeBlock/PrevFreeBlock link free blocks of the same size class and are valid only when IsFree is set.
 struct memory_heap_block {
 	memory_heap_block *NextBlock;
 	memory_heap_block *PrevBlock;
 
+	memory_heap_block *NextFreeBlock;
+	memory_heap_block *PrevFreeBlock;
+
 	uptr Size;
 	b32 IsFree;
 };
 
 // NOTE(ivan): Memory heap.
 struct memory_heap {
-	char Name[128];
-	
+	ticket_mutex Mutex;
+
 	piece Piece;
 	memory_heap_block *Blocks;
-	u32 NumBlocks;
+	u32 NumBlocks;     // NOTE(ivan): Number of allocated blocks.
+	u32 NumFreeBlocks; // NOTE(ivan): Number of free blocks, tells how much the heap is fragmented.
 	uptr UsedSize;
+	uptr HighWaterMark; // NOTE(ivan): Highest offset ever written since the last zeroing reset.
+	uptr CommittedSize;
 
-	ticket_mutex Mutex;
+	// NOTE(ivan): Segregated free lists. A list head is valid only while its bit is set in SLBitmaps,
+	// so resetting the heap does not require clearing all the heads.
+	u64 FLBitmap;
+	u32 SLBitmaps[MEMORY_HEAP_FL_COUNT];
+	memory_heap_block *FreeBlocks[MEMORY_HEAP_FL_COUNT][MEMORY_HEAP_SL_COUNT];
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
 };
 
-// NOTE(ivan): CreateMemoryHeap() returns percentage of left free space of game primary storage.
-// It never eats more memory than the caller defined in SizePercentage.
-u32 CreateMemoryHeap(memory_heap *Heap, const char *Name, u32 SizePercentage);
-void ResetMemoryHeap(memory_heap *Heap);
+void CreateMemoryHeap(memory_heap *Heap, const char *Name, uptr Size);
+void ResetMemoryHeap(memory_heap *Heap, u32 Flags);
 
-void * AllocFromHeap(memory_heap *Heap, uptr Size);
+void * AllocFromHeapTagged(memory_heap *Heap, uptr Size, u32 Flags, const char *File, u32 Line);
+#define AllocFromHeap(Heap, Size, Flags) AllocFromHeapTagged(Heap, Size, Flags, MEMORY_CALL_SITE)
 void FreeFromHeap(memory_heap *Heap, void *Base);
 
+// NOTE(ivan): Resizes the block keeping its contents, returns the block's possibly new address or 0 if out of memory,
+// the old block stays valid then. The block is resized in place if it shrinks or the following block is free and
+// large enough, otherwise the data is moved to a new block. MemoryFlag_Zero zeroes the grown part only.
+// Base can be 0, the function works like AllocFromHeap() then.
+void * ReallocFromHeapTagged(memory_heap *Heap, void *Base, uptr Size, u32 Flags, const char *File, u32 Line);
+#define ReallocFromHeap(Heap, Base, Size, Flags) ReallocFromHeapTagged(Heap, Base, Size, Flags, MEMORY_CALL_SITE)
+
+// NOTE(ivan): Batch versions take the mutex once for all the blocks. Allocation carves the blocks one after another
+// out of a single free block if there is one large enough, each block can still be freed on its own.
+// Allocation is all or nothing.
+b32 AllocFromHeapBatchTagged(memory_heap *Heap, void **Blocks, const uptr *Sizes, u32 NumBlocks, u32 Flags,
+							 const char *File, u32 Line);
+#define AllocFromHeapBatch(Heap, Blocks, Sizes, NumBlocks, Flags) AllocFromHeapBatchTagged(Heap, Blocks, Sizes, NumBlocks, Flags, MEMORY_CALL_SITE)
+void FreeFromHeapBatch(memory_heap *Heap, void **Blocks, u32 NumBlocks);
+
+// NOTE(ivan): Maximum count of levels of a buddy allocator's tree.
+#define MAX_MEMORY_BUDDY_LEVELS 64
+
+// NOTE(ivan): Buddy allocator, for large power-of-two sized resources (textures, sounds, meshes).
+// The data region is a power-of-two sized block that is recursively halved into buddies down to MinBlockSize.
+// Every block is a node of a complete binary tree numbered heap-style: node 0 is the whole region,
+// children of node N are 2N+1 and 2N+2, so the buddy of a node and its parent are found with plain arithmetic.
+//
+// All bookkeeping lives in a metadata region in front of the data: a bitmap of free nodes, a bitmap of split nodes,
+// per-level free lists linked by node indices, and a bitmap of committed leaves. Blocks themselves have no headers,
+// allocated block's size is found by walking down the split nodes. Allocation and free split and merge at most
+// once per level, so both are O(log n), and the region never fragments worse than the power-of-two rounding.
+// Blocks are always aligned to the page size at least, so alignment flags are met by any block.
+struct memory_buddy {
+	ticket_mutex Mutex;
+
+	piece Piece; // NOTE(ivan): Whole partition, metadata included.
+	u8 *Data;
+	uptr DataSize;
+	uptr MinBlockSize;
+	u32 DataSizeLog2;
+	u32 NumLevels; // NOTE(ivan): Level 0 is the whole data region, level NumLevels - 1 consists of MinBlockSize blocks.
+	u32 NumLeaves;
+
+	u32 *FreeBitmap;   // NOTE(ivan): Bit per node, set if the node is a free block.
+	u32 *SplitBitmap;  // NOTE(ivan): Bit per node, set if the node is split into its children.
+	u32 *CommitBitmap; // NOTE(ivan): Bit per leaf, set if the leaf's pages are committed.
+	u32 *NextFree;     // NOTE(ivan): Per node, next free node of the same level + 1, 0 terminates the list.
+	u32 *PrevFree;
+
+	u64 LevelBitmap; // NOTE(ivan): Bit per level, set if the level's free list is not empty.
+	u32 FreeHeads[MAX_MEMORY_BUDDY_LEVELS]; // NOTE(ivan): First free node of the level + 1.
+
+	u32 NumBlocks; // NOTE(ivan): Number of allocated blocks.
+	uptr UsedSize;
+	uptr CommittedSize;
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
+};
+
+// NOTE(ivan): CreateMemoryBuddy() usually eats less than a given size, because the data region is rounded down
+// to a power of two. MinBlockSize is rounded up to a power of two and to the page size.
+void CreateMemoryBuddy(memory_buddy *Buddy, const char *Name, uptr MinBlockSize, uptr Size);
+void ResetMemoryBuddy(memory_buddy *Buddy, u32 Flags);
+
+void * AllocFromBuddyTagged(memory_buddy *Buddy, uptr Size, u32 Flags, const char *File, u32 Line);
+#define AllocFromBuddy(Buddy, Size, Flags) AllocFromBuddyTagged(Buddy, Size, Flags, MEMORY_CALL_SITE)
+void FreeFromBuddy(memory_buddy *Buddy, void *Base);
+
+// NOTE(ivan): Memory handle, 0 is invalid. Low 24 bits - handle table index + 1, high 8 bits - generation
+// of the table entry that is bumped each time the entry gets reused, so stale handles can be caught.
+typedef u32 memory_handle;
+
+#define MAX_MEMORY_HANDLES ((1 << 24) - 1)
+
+// NOTE(ivan): Relocatable heap's block header. Blocks follow each other without gaps up to heap's Top.
+// Block's data starts at the first address past the header that is aligned to the block's alignment, the block
+// has room for the largest padding this might take, so the data stays aligned wherever the block is moved.
+struct memory_handle_block {
+	u32 HandleIndex; // NOTE(ivan): Handle table index + 1, 0 if the block is free.
+	u16 NumPins;
+	u16 Alignment;   // NOTE(ivan): Data alignment, live blocks only.
+	uptr Size;       // NOTE(ivan): Header included.
+};
+
+struct memory_handle_entry {
+	uptr Offset;     // NOTE(ivan): Block's offset from the partition's base.
+	u32 Generation;
+	u32 NextFree;    // NOTE(ivan): Free entries list link, table index + 1.
+};
+
+// NOTE(ivan): Relocatable heap.
+// Allocations are referenced by handles that resolve through a handle table, so the heap is free to move
+// the blocks. Blocks are appended at the Top, and the space of freed blocks is reused first-fit only
+// when the Top reaches the partition's end. CompactMemoryHandleHeap() walks the blocks with a cursor
+// that survives between calls, sliding each live block down over the free space in front of it,
+// so calling it every frame with a small budget keeps the heap fit for long sessions.
+// Pinned blocks never move, the free space in front of them is left for first-fit allocations.
+//
+// A pointer returned by ResolveMemoryHandle() stays valid until the next compaction call,
+// pin the handle to keep its pointer valid for longer.
+struct memory_handle_heap {
+	ticket_mutex Mutex;
+
+	piece Piece;
+	volatile uptr CommittedSize;
+	uptr Top;           // NOTE(ivan): End of the last block.
+	uptr HighWaterMark; // NOTE(ivan): Highest Top since the last zeroing reset.
+	uptr UsedSize;      // NOTE(ivan): Live blocks, headers included.
+	u32 NumBlocks;
+	u32 NumPinnedBlocks;
+
+	piece TablePiece;
+	volatile uptr TableCommittedSize;
+	memory_handle_entry *Handles;
+	u32 MaxHandles;
+	u32 NumHandles;     // NOTE(ivan): Table entries ever used since the last reset.
+	u32 FreeHandles;    // NOTE(ivan): Free entries list head, table index + 1.
+
+	uptr CompactCursor; // NOTE(ivan): Offset of the block the compaction resumes from.
+	u64 NumMovedBytes;  // NOTE(ivan): Statistics only.
+
+	CacheAligned char Name[128];
+
+#if MEMORY_TELEMETRY
+	memory_telemetry Telemetry;
+#endif
+};
+
+// NOTE(ivan): The size covers the handle table too.
+void CreateMemoryHandleHeap(memory_handle_heap *Heap, const char *Name, u32 MaxHandles, uptr Size);
+void ResetMemoryHandleHeap(memory_handle_heap *Heap, u32 Flags);
+
+memory_handle AllocHandleFromHeapTagged(memory_handle_heap *Heap, uptr Size, u32 Flags, const char *File, u32 Line);
+#define AllocHandleFromHeap(Heap, Size, Flags) AllocHandleFromHeapTagged(Heap, Size, Flags, MEMORY_CALL_SITE)
+void FreeHandleFromHeap(memory_handle_heap *Heap, memory_handle Handle); // NOTE(ivan): The handle must not be pinned.
+
+void * ResolveMemoryHandle(memory_handle_heap *Heap, memory_handle Handle);
+void * PinMemoryHandle(memory_handle_heap *Heap, memory_handle Handle);
+void UnpinMemoryHandle(memory_handle_heap *Heap, memory_handle Handle);
+
+// NOTE(ivan): Slides live blocks together until ClockBudget CPU clocks pass, 0 means until the heap is fully compact.
+void CompactMemoryHandleHeap(memory_handle_heap *Heap, u64 ClockBudget);
+
+// NOTE(ivan): Memory partition plan. Each entry describes one container to create and how much space it gets:
+// an absolute size in bytes, a count of elements (pools only, count of blocks), or a weight. Weighted entries share
+// the space left by the other entries in proportion to their weights, a spare entry is weighted space kept free.
+// Resolved sizes are multiples of the page size, so every partition starts at a page, and thus cache line, boundary.
+enum memory_partition_type {
+	MemoryPartitionType_Stack,
+	MemoryPartitionType_DoubleStack,
+	MemoryPartitionType_FrameArena,
+	MemoryPartitionType_Heap,
+	MemoryPartitionType_Pool,
+	MemoryPartitionType_GrowablePool,
+	MemoryPartitionType_Buddy,
+	MemoryPartitionType_HandleHeap,
+	MemoryPartitionType_Spare
+};
+
+enum memory_plan_unit {
+	MemoryPlanUnit_Bytes,
+	MemoryPlanUnit_Count,
+	MemoryPlanUnit_Weight
+};
+
+struct memory_plan_entry {
+	const char *Name;
+	memory_partition_type Type;
+	void *Partition; // NOTE(ivan): Container of the type's structure, 0 for spare entries.
+
+	memory_plan_unit Unit;
+	uptr Amount;
+
+	// NOTE(ivan): Type-specific parameters.
+	uptr BlockSize;          // NOTE(ivan): Pool's block size, buddy's minimal block size.
+	u32 Param;               // NOTE(ivan): Frame arena's buffers count, pool's magazine size, growable pool's blocks per chunk, handle heap's max handles.
+	u32 PoolFlags;           // NOTE(ivan): Pools only.
+	memory_heap *ParentHeap; // NOTE(ivan): Growable pools only.
+
+	b32 IsNUMABound;
+	u32 NUMANode;
+
+	uptr Size; // NOTE(ivan): Resolved size in bytes, filled by ApplyMemoryPlan().
+};
+
+// NOTE(ivan): Resolves the entries' sizes and creates the containers in the entries' order. Crashes if the entries
+// with absolute sizes and counts do not fit the free space of primary storage. Returns the size of free space left.
+uptr ApplyMemoryPlan(memory_plan_entry *Entries, u32 NumEntries);
+
+// NOTE(ivan): Memory trace, a binary log of all calls made to the containers, captured in internal builds
+// and replayed offline by memreplay tool (game_memreplay.cpp) against any container type.
+// The file is a memory_trace_header followed by memory_trace_event records in the order the calls were made.
+// Every container is introduced by a MemoryTraceOp_Create event followed by a memory_trace_container record,
+// the containers created before the trace has started are introduced right at its beginning.
+// Allocations are logged after the memory is taken and frees before it is given back, so even for lock-free
+// containers an address is never seen allocated twice without a free in between.
+#define MEMORY_TRACE_MAGIC FourCC("QMTR")
+#define MEMORY_TRACE_VERSION 1
+
+enum memory_trace_op {
+	MemoryTraceOp_Create,     // NOTE(ivan): Size - container's size, Address - block size, Param - same as memory_plan_entry's Param.
+	MemoryTraceOp_Alloc,      // NOTE(ivan): Address - taken address or handle (0 if failed), Size - requested size, Param - flags.
+	MemoryTraceOp_Free,       // NOTE(ivan): Address - freed address or handle.
+	MemoryTraceOp_Realloc,    // NOTE(ivan): Address - old address, Size - new size, Param - flags. Followed by an event whose Address is the new address (0 if failed).
+	MemoryTraceOp_Pop,
+	MemoryTraceOp_Reset,      // NOTE(ivan): Param - flags.
+	MemoryTraceOp_BeginScope, // NOTE(ivan): Temporary memory.
+	MemoryTraceOp_EndScope,
+	MemoryTraceOp_Advance,    // NOTE(ivan): Param - flags.
+	MemoryTraceOp_Compact     // NOTE(ivan): Size - clock budget.
+};
+
+// NOTE(ivan): Double-ended stacks put the end into Param's high bits.
+#define MEMORY_TRACE_END_SHIFT 16
+
+struct memory_trace_header {
+	u32 Magic;
+	u32 Version;
+	u32 EventSize;
+	u32 Reserved;
+};
+
+struct memory_trace_event {
+	u64 Clock; // NOTE(ivan): CPU clocks since the trace has started.
+	u64 Address;
+	u64 Size;
+	u32 Param;
+	u16 ContainerId;
+	u8 Op;     // NOTE(ivan): memory_trace_op.
+	u8 Thread; // NOTE(ivan): Index of the calling thread, the same as pool magazines use.
+};
+
+// NOTE(ivan): Has the size of an event, so the file can be read as an array of events.
+struct memory_trace_container {
+	char Name[24];
+	u32 Type; // NOTE(ivan): memory_partition_type.
+	u32 PoolFlags;
+};
+
+#if MEMORY_TELEMETRY
+b32 StartMemoryTrace(const char *FileName);
+void StopMemoryTrace(void);
+#endif
+
 #endif // #ifndef GAME_MEMORY_H
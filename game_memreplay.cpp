@@ -0,0 +1,1052 @@
+// NOTE(ivan): Memory trace replay tool.
+// Replays a memory trace captured by an internal build (see "-memtrace" parameter and "memtrace" command)
+// on a single thread in the order the calls were made, either against the containers it has been captured from
+// or against another container type, and reports throughput, peak usage and fragmentation of each container.
+//
+// Usage: memreplay <trace-file> [-as stack|heap|pool|buddy|handleheap] [-only container-name] [-verbose]
+//
+// With "-as" stacks, heaps, pools, buddies and relocatable heaps are replayed against the given type,
+// double-ended stacks and frame arenas always keep their own type. A stack can only give back its top
+// allocation, so frees of the other allocations are deferred until everything above them is freed,
+// and are counted as skipped. Temporary memory scopes replayed against other types free everything
+// allocated within them. Pools get blocks of the largest size the container has ever been asked for.
+#include "game.h"
+#include "game_memory.cpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+
+game_state GameState = {};
+
+// NOTE(ivan): Live blocks are looked up by container id and traced address.
+#define REPLAY_HASH_SIZE (1 << 20)
+#define MAX_REPLAY_SCOPES 64
+#define MAX_REPLAY_CONTAINERS 0x10000
+
+// NOTE(ivan): Fragmentation is sampled after this many events of a container, and once more at the end.
+#define REPLAY_FRAGMENTATION_PERIOD 4096
+
+struct replay_block {
+	u64 TracedAddress;
+	u64 Address; // NOTE(ivan): Replayed address or handle.
+	u64 Size;
+	u64 Seq;     // NOTE(ivan): Allocation order, temporary memory scopes free the blocks past their mark.
+	u16 ContainerId;
+	u8 End;
+	u8 IsFreed;  // NOTE(ivan): Stack targets only, the free is deferred until the blocks above are freed.
+
+	replay_block *NextInBucket;
+
+	// NOTE(ivan): Container's live blocks in allocation order.
+	replay_block *Prev;
+	replay_block *Next;
+};
+
+struct replay_scope {
+	u64 Seq;
+	temporary_memory TempMemory;
+	double_stack_temporary_memory DoubleStackTempMemory;
+};
+
+struct replay_container {
+	// NOTE(ivan): Only the target type's container is created.
+	memory_stack Stack;
+	memory_double_stack DoubleStack;
+	memory_frame_arena FrameArena;
+	memory_pool Pool;
+	memory_heap Heap;
+	memory_heap ParentHeap; // NOTE(ivan): Growable pools only, takes the place of the heap the chunks came from.
+	memory_buddy Buddy;
+	memory_handle_heap HandleHeap;
+
+	u16 Id;
+	b32 IsCreated;
+	b32 IsReplayed; // NOTE(ivan): False if filtered out by "-only".
+	memory_trace_container Info;
+	memory_partition_type SourceType;
+	memory_partition_type Type;
+
+	// NOTE(ivan): Creation parameters, see MemoryTraceOp_Create.
+	uptr Size;
+	uptr BlockSize;
+	u32 Param;
+	uptr MaxAllocSize;
+	u64 NumTracedAllocs;
+
+	replay_block *FirstBlock;
+	replay_block *LastBlock;
+	u64 NextSeq;
+
+	replay_scope Scopes[MemoryStackEnd_MaxCount][MAX_REPLAY_SCOPES];
+	u32 NumScopes[MemoryStackEnd_MaxCount];
+
+	// NOTE(ivan): Frame arenas only, live size of each buffer.
+	u64 NumFrames;
+	u64 FrameSizes[MAX_MEMORY_FRAME_ARENA_BUFFERS];
+
+	// NOTE(ivan): Statistics.
+	u64 NumEvents;
+	u64 NumCalls;
+	u64 Clocks;
+	u64 NumAllocs;
+	u64 NumFrees;
+	u64 NumFailedAllocs;
+	u64 NumSkippedFrees;  // NOTE(ivan): Deferred by stack targets, or of blocks allocated before the trace has started.
+	u64 NumTraceFailures; // NOTE(ivan): Allocations failed when captured, they are not replayed.
+	u64 LiveSize;
+	u64 PeakLiveSize;
+	u64 PeakUsedSize;
+	u64 CommittedSize;
+	u64 PeakCommittedSize;
+	f64 Fragmentation;
+	f64 PeakFragmentation;
+};
+
+static struct replay_state {
+	platform_api PlatformAPI;
+	game_memory GameMemory;
+	b32 IsVerbose;
+
+	replay_container *Containers[MAX_REPLAY_CONTAINERS];
+	replay_block *Buckets[REPLAY_HASH_SIZE];
+	replay_block *FreeBlocks;
+} ReplayState;
+
+static PLATFORM_OUTF(ReplayOutf) {
+	Assert(Format);
+
+	// NOTE(ivan): Containers complain about every failed allocation, those are counted anyway.
+	if (!ReplayState.IsVerbose)
+		return;
+
+	char Buffer[2048] = {};
+	CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+
+	fprintf(stdout, "%s\n", Buffer);
+}
+
+static PLATFORM_CRASHF(ReplayCrashf) {
+	Assert(Format);
+
+	char Buffer[2048] = {};
+	CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+
+	fprintf(stderr, "memreplay: %s\n", Buffer);
+	exit(1);
+}
+
+static PLATFORM_COMMIT_MEMORY(ReplayCommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	return (mprotect(Base, Size, PROT_READ | PROT_WRITE) == 0);
+}
+
+static PLATFORM_DECOMMIT_MEMORY(ReplayDecommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	if (madvise(Base, Size, MADV_DONTNEED) != 0)
+		memset(Base, 0, Size);
+	mprotect(Base, Size, PROT_NONE);
+}
+
+static PLATFORM_BIND_MEMORY_TO_NUMA_NODE(ReplayBindMemoryToNUMANode) {
+	UnusedParam(Base);
+	UnusedParam(Size);
+	UnusedParam(Node);
+
+	return true;
+}
+
+static PLATFORM_GET_CURRENT_NUMA_NODE(ReplayGetCurrentNUMANode) {
+	return 0;
+}
+
+#if MUTEX_PROFILING
+// NOTE(ivan): Replayed containers are never entered by several threads, so their mutexes are not profiled.
+static PLATFORM_PROFILE_MUTEX(ReplayProfileMutex) {
+	UnusedParam(Mutex);
+	UnusedParam(MutexName);
+}
+#endif
+
+inline u64
+GetWallClockNanoseconds(void) {
+	timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (u64)Time.tv_sec * 1000000000ull + (u64)Time.tv_nsec;
+}
+
+static const char *
+GetPartitionTypeName(memory_partition_type Type) {
+	switch (Type) {
+	case MemoryPartitionType_Stack: return "stack";
+	case MemoryPartitionType_DoubleStack: return "doublestack";
+	case MemoryPartitionType_FrameArena: return "framearena";
+	case MemoryPartitionType_Heap: return "heap";
+	case MemoryPartitionType_Pool: return "pool";
+	case MemoryPartitionType_GrowablePool: return "growablepool";
+	case MemoryPartitionType_Buddy: return "buddy";
+	case MemoryPartitionType_HandleHeap: return "handleheap";
+	default: return "unknown";
+	}
+}
+
+// NOTE(ivan): Only the types whose allocations are freed one by one can stand in for each other.
+inline b32
+IsPartitionTypeRetargetable(memory_partition_type Type) {
+	return (Type == MemoryPartitionType_Stack || Type == MemoryPartitionType_Heap ||
+			Type == MemoryPartitionType_Pool || Type == MemoryPartitionType_GrowablePool ||
+			Type == MemoryPartitionType_Buddy || Type == MemoryPartitionType_HandleHeap);
+}
+
+inline u32
+GetReplayBucket(u16 ContainerId, u64 TracedAddress) {
+	u64 Key = (TracedAddress ^ ((u64)ContainerId << 48)) * 0x9E3779B97F4A7C15ull;
+	return (u32)(Key >> 44) & (REPLAY_HASH_SIZE - 1);
+}
+
+static replay_block *
+FindReplayBlock(replay_container *Container, u64 TracedAddress) {
+	Assert(Container);
+
+	for (replay_block *Block = ReplayState.Buckets[GetReplayBucket(Container->Id, TracedAddress)];
+		 Block; Block = Block->NextInBucket) {
+		if (Block->ContainerId == Container->Id && Block->TracedAddress == TracedAddress)
+			return Block;
+	}
+
+	return 0;
+}
+
+static void
+HashReplayBlock(replay_block *Block) {
+	Assert(Block);
+
+	u32 Bucket = GetReplayBucket(Block->ContainerId, Block->TracedAddress);
+	Block->NextInBucket = ReplayState.Buckets[Bucket];
+	ReplayState.Buckets[Bucket] = Block;
+}
+
+static void
+UnhashReplayBlock(replay_block *Block) {
+	Assert(Block);
+
+	replay_block **Link = &ReplayState.Buckets[GetReplayBucket(Block->ContainerId, Block->TracedAddress)];
+	while (*Link != Block)
+		Link = &(*Link)->NextInBucket;
+	*Link = Block->NextInBucket;
+}
+
+static replay_block *
+AddReplayBlock(replay_container *Container, u64 TracedAddress, u64 Address, u64 Size, u8 End) {
+	Assert(Container);
+
+	if (!ReplayState.FreeBlocks) {
+		const u32 NumNewBlocks = 4096;
+		replay_block *NewBlocks = (replay_block *)malloc(sizeof(replay_block) * NumNewBlocks);
+		if (!NewBlocks)
+			ReplayCrashf("Out of memory!");
+
+		for (u32 Index = 0; Index < NumNewBlocks; Index++) {
+			NewBlocks[Index].Next = ReplayState.FreeBlocks;
+			ReplayState.FreeBlocks = &NewBlocks[Index];
+		}
+	}
+
+	replay_block *Block = ReplayState.FreeBlocks;
+	ReplayState.FreeBlocks = Block->Next;
+
+	memset(Block, 0, sizeof(*Block));
+	Block->TracedAddress = TracedAddress;
+	Block->Address = Address;
+	Block->Size = Size;
+	Block->Seq = Container->NextSeq++;
+	Block->ContainerId = Container->Id;
+	Block->End = End;
+
+	Block->Prev = Container->LastBlock;
+	if (Container->LastBlock)
+		Container->LastBlock->Next = Block;
+	else
+		Container->FirstBlock = Block;
+	Container->LastBlock = Block;
+
+	HashReplayBlock(Block);
+
+	Container->LiveSize += Size;
+	Container->PeakLiveSize = Max(Container->PeakLiveSize, Container->LiveSize);
+
+	return Block;
+}
+
+static void
+RemoveReplayBlock(replay_container *Container, replay_block *Block) {
+	Assert(Container);
+	Assert(Block);
+
+	UnhashReplayBlock(Block);
+
+	if (Block->Prev)
+		Block->Prev->Next = Block->Next;
+	else
+		Container->FirstBlock = Block->Next;
+	if (Block->Next)
+		Block->Next->Prev = Block->Prev;
+	else
+		Container->LastBlock = Block->Prev;
+
+	Container->LiveSize -= Block->Size;
+
+	Block->Next = ReplayState.FreeBlocks;
+	ReplayState.FreeBlocks = Block;
+}
+
+static void
+RemoveAllReplayBlocks(replay_container *Container) {
+	Assert(Container);
+
+	while (Container->LastBlock)
+		RemoveReplayBlock(Container, Container->LastBlock);
+}
+
+// NOTE(ivan): Container calls are timed one by one, and so is their effect on the committed size.
+struct replay_call {
+	u64 StartClock;
+	uptr StartCommittedSize;
+};
+
+inline replay_call
+BeginReplayCall(void) {
+	replay_call Result;
+	Result.StartCommittedSize = ReplayState.GameMemory.CommittedSize;
+	Result.StartClock = __rdtsc();
+
+	return Result;
+}
+
+inline void
+EndReplayCall(replay_container *Container, replay_call Call) {
+	Assert(Container);
+
+	Container->Clocks += __rdtsc() - Call.StartClock;
+	Container->NumCalls++;
+
+	Container->CommittedSize += ReplayState.GameMemory.CommittedSize - Call.StartCommittedSize;
+	Container->PeakCommittedSize = Max(Container->PeakCommittedSize, Container->CommittedSize);
+}
+
+static uptr
+GetReplayUsedSize(replay_container *Container) {
+	Assert(Container);
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Stack: return Container->Stack.Mark;
+	case MemoryPartitionType_DoubleStack: return Container->DoubleStack.Marks[MemoryStackEnd_Low] + Container->DoubleStack.Marks[MemoryStackEnd_High];
+	case MemoryPartitionType_Pool:
+	case MemoryPartitionType_GrowablePool: return Container->Pool.NumAllocBlocks * Container->Pool.BlockSize;
+	case MemoryPartitionType_Heap: return Container->Heap.UsedSize;
+	case MemoryPartitionType_Buddy: return Container->Buddy.UsedSize;
+	case MemoryPartitionType_HandleHeap: return Container->HandleHeap.UsedSize;
+	default: return Container->LiveSize;
+	}
+}
+
+// NOTE(ivan): External fragmentation, 1 - largest free block / all free space. Negative for the types
+// that have none: stacks and arenas have only one free range, pool blocks are all the same.
+static f64
+GetReplayFragmentation(replay_container *Container) {
+	Assert(Container);
+
+	uptr FreeSize = 0, LargestFreeSize = 0;
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Heap: {
+		for (memory_heap_block *Block = Container->Heap.Blocks; Block; Block = Block->NextBlock) {
+			if (Block->IsFree) {
+				FreeSize += Block->Size;
+				LargestFreeSize = Max(LargestFreeSize, Block->Size);
+			}
+		}
+	} break;
+
+	case MemoryPartitionType_HandleHeap: {
+		// NOTE(ivan): Neighbor free blocks are not always coalesced yet, so runs of them are summed up.
+		memory_handle_heap *Heap = &Container->HandleHeap;
+		uptr RunSize = 0;
+		for (uptr Offset = 0; Offset < Heap->Top; ) {
+			memory_handle_block *Block = GetHandleHeapBlock(Heap, Offset);
+			if (Block->HandleIndex) {
+				RunSize = 0;
+			} else {
+				RunSize += Block->Size;
+				FreeSize += Block->Size;
+				LargestFreeSize = Max(LargestFreeSize, RunSize);
+			}
+
+			Offset += Block->Size;
+		}
+
+		RunSize += Heap->Piece.Size - Heap->Top;
+		FreeSize += Heap->Piece.Size - Heap->Top;
+		LargestFreeSize = Max(LargestFreeSize, RunSize);
+	} break;
+
+	case MemoryPartitionType_Buddy: {
+		memory_buddy *Buddy = &Container->Buddy;
+		FreeSize = Buddy->DataSize - Buddy->UsedSize;
+		for (u32 Level = 0; Level < Buddy->NumLevels; Level++) {
+			if (Buddy->LevelBitmap & ((u64)1 << Level)) {
+				LargestFreeSize = GetBuddyBlockSize(Buddy, Level);
+				break;
+			}
+		}
+	} break;
+
+	default: {
+		return -1.0;
+	}
+	}
+
+	return FreeSize ? (1.0 - (f64)LargestFreeSize / (f64)FreeSize) : 0.0;
+}
+
+static void
+SampleReplayFragmentation(replay_container *Container) {
+	Assert(Container);
+
+	Container->Fragmentation = GetReplayFragmentation(Container);
+	Container->PeakFragmentation = Max(Container->PeakFragmentation, Container->Fragmentation);
+}
+
+static void
+CreateReplayContainer(replay_container *Container) {
+	Assert(Container);
+
+	const char *Name = Container->Info.Name;
+	uptr Size = Container->Size;
+
+	replay_call Call = BeginReplayCall();
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Stack: {
+		CreateMemoryStack(&Container->Stack, Name, Size);
+	} break;
+
+	case MemoryPartitionType_DoubleStack: {
+		CreateMemoryDoubleStack(&Container->DoubleStack, Name, Size);
+	} break;
+
+	case MemoryPartitionType_FrameArena: {
+		CreateMemoryFrameArena(&Container->FrameArena, Name, Container->Param, Size);
+	} break;
+
+	case MemoryPartitionType_Pool: {
+		if (Container->SourceType == MemoryPartitionType_Pool)
+			CreateMemoryPool(&Container->Pool, Name, Container->BlockSize, Size, Container->Param, Container->Info.PoolFlags);
+		else
+			CreateMemoryPool(&Container->Pool, Name, Max(Container->MaxAllocSize, (uptr)sizeof(u64)), Size, 0, 0);
+	} break;
+
+	case MemoryPartitionType_GrowablePool: {
+		uptr ParentSize = AlignPow2(MAX_MEMORY_POOL_CHUNKS * (Container->BlockSize * Container->Param + Kilobytes(4)),
+									ReplayState.PlatformAPI.PageSize);
+		CreateMemoryHeap(&Container->ParentHeap, Name, ParentSize);
+		CreateGrowableMemoryPool(&Container->Pool, Name, Container->BlockSize, Size, &Container->ParentHeap, Container->Param);
+	} break;
+
+	case MemoryPartitionType_Heap: {
+		CreateMemoryHeap(&Container->Heap, Name, Size);
+	} break;
+
+	case MemoryPartitionType_Buddy: {
+		CreateMemoryBuddy(&Container->Buddy, Name, Max(Container->BlockSize, ReplayState.PlatformAPI.PageSize), Size);
+	} break;
+
+	case MemoryPartitionType_HandleHeap: {
+		u32 MaxHandles = Container->Param;
+		if (Container->SourceType != MemoryPartitionType_HandleHeap) {
+			// NOTE(ivan): The table must leave most of the partition to the blocks.
+			u64 MaxTableHandles = Size / (sizeof(memory_handle_entry) * 4);
+			MaxHandles = (u32)Min(Min(Max(Container->NumTracedAllocs, (u64)16), MaxTableHandles), (u64)MAX_MEMORY_HANDLES);
+		}
+		CreateMemoryHandleHeap(&Container->HandleHeap, Name, MaxHandles, Size);
+	} break;
+
+	default: {
+		ReplayCrashf("Container '%s' has unknown type %u!", Name, Container->Info.Type);
+	}
+	}
+
+	EndReplayCall(Container, Call);
+	Container->IsCreated = true;
+}
+
+static void
+ResetReplayContainer(replay_container *Container, u32 Flags) {
+	Assert(Container);
+
+	replay_call Call = BeginReplayCall();
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Stack: ResetMemoryStack(&Container->Stack, Flags); break;
+	case MemoryPartitionType_Pool:
+	case MemoryPartitionType_GrowablePool: ResetMemoryPool(&Container->Pool, Flags); break;
+	case MemoryPartitionType_Heap: ResetMemoryHeap(&Container->Heap, Flags); break;
+	case MemoryPartitionType_Buddy: ResetMemoryBuddy(&Container->Buddy, Flags); break;
+	case MemoryPartitionType_HandleHeap: ResetMemoryHandleHeap(&Container->HandleHeap, Flags); break;
+	default: break;
+	}
+
+	EndReplayCall(Container, Call);
+
+	// NOTE(ivan): Stack resets release all the blocks, like the stack telemetry does.
+	if (Container->Type == MemoryPartitionType_Stack) {
+		for (replay_block *Block = Container->LastBlock; Block; Block = Block->Prev) {
+			if (!Block->IsFreed)
+				Container->NumFrees++;
+		}
+	}
+
+	RemoveAllReplayBlocks(Container);
+	for (u32 End = 0; End < MemoryStackEnd_MaxCount; End++)
+		Container->NumScopes[End] = 0;
+}
+
+static u64
+AllocFromReplayContainer(replay_container *Container, uptr Size, u32 Flags, memory_stack_end End) {
+	Assert(Container);
+
+	u64 Result = 0;
+
+	replay_call Call = BeginReplayCall();
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Stack: {
+		Result = (uptr)AllocFromStack(&Container->Stack, Size, Flags);
+	} break;
+
+	case MemoryPartitionType_DoubleStack: {
+		Result = (uptr)AllocFromDoubleStack(&Container->DoubleStack, End, Size, Flags);
+	} break;
+
+	case MemoryPartitionType_FrameArena: {
+		Result = (uptr)AllocFromFrameArena(&Container->FrameArena, Size, Flags);
+	} break;
+
+	case MemoryPartitionType_Pool:
+	case MemoryPartitionType_GrowablePool: {
+		// NOTE(ivan): Alignment the blocks cannot give is dropped rather than failed, it is not the pool's fault.
+		if (GetMemoryFlagsAlignment(Flags) > GetPoolBlockAlignment(&Container->Pool))
+			Flags &= ~(MemoryFlag_Align16 | MemoryFlag_Align32 | MemoryFlag_Align64);
+		if (Size <= Container->Pool.BlockSize)
+			Result = (uptr)AllocFromPool(&Container->Pool, Flags);
+	} break;
+
+	case MemoryPartitionType_Heap: {
+		Result = (uptr)AllocFromHeap(&Container->Heap, Size, Flags);
+	} break;
+
+	case MemoryPartitionType_Buddy: {
+		Result = (uptr)AllocFromBuddy(&Container->Buddy, Size, Flags);
+	} break;
+
+	case MemoryPartitionType_HandleHeap: {
+		Result = AllocHandleFromHeap(&Container->HandleHeap, Size, Flags);
+	} break;
+
+	default: {
+		InvalidCodePath();
+	}
+	}
+
+	EndReplayCall(Container, Call);
+
+	if (Result)
+		Container->NumAllocs++;
+	else
+		Container->NumFailedAllocs++;
+
+	return Result;
+}
+
+// NOTE(ivan): Gives the block back to the container, except for stack targets which pop the blocks
+// from the top once they are all freed.
+static void
+FreeFromReplayContainer(replay_container *Container, replay_block *Block) {
+	Assert(Container);
+	Assert(Block);
+
+	Container->NumFrees++;
+
+	if (Container->Type == MemoryPartitionType_Stack) {
+		if (Block != Container->LastBlock)
+			Container->NumSkippedFrees++;
+
+		// NOTE(ivan): Nothing can be popped while a scope is open, the scope's end releases its blocks,
+		// the ones below are popped with the next free.
+		Block->IsFreed = true;
+		while (!Container->Stack.NumTemporaryScopes && Container->LastBlock && Container->LastBlock->IsFreed) {
+			replay_call Call = BeginReplayCall();
+			PopStack(&Container->Stack);
+			EndReplayCall(Container, Call);
+
+			RemoveReplayBlock(Container, Container->LastBlock);
+		}
+
+		return;
+	}
+
+	replay_call Call = BeginReplayCall();
+
+	switch (Container->Type) {
+	case MemoryPartitionType_Pool:
+	case MemoryPartitionType_GrowablePool: FreeFromPool(&Container->Pool, (void *)(uptr)Block->Address); break;
+	case MemoryPartitionType_Heap: FreeFromHeap(&Container->Heap, (void *)(uptr)Block->Address); break;
+	case MemoryPartitionType_Buddy: FreeFromBuddy(&Container->Buddy, (void *)(uptr)Block->Address); break;
+	case MemoryPartitionType_HandleHeap: FreeHandleFromHeap(&Container->HandleHeap, (memory_handle)Block->Address); break;
+	default: InvalidCodePath();
+	}
+
+	EndReplayCall(Container, Call);
+
+	RemoveReplayBlock(Container, Block);
+}
+
+inline u8 *
+GetReplayBlockData(replay_container *Container, u64 Address) {
+	Assert(Container);
+
+	if (Container->Type == MemoryPartitionType_HandleHeap)
+		return (u8 *)ResolveMemoryHandle(&Container->HandleHeap, (memory_handle)Address);
+	return (u8 *)(uptr)Address;
+}
+
+static void
+ReallocFromReplayContainer(replay_container *Container, replay_block *Block, u64 NewTracedAddress, uptr Size, u32 Flags) {
+	Assert(Container);
+	Assert(Block);
+
+	if (Container->Type == MemoryPartitionType_Heap) {
+		replay_call Call = BeginReplayCall();
+		void *Result = ReallocFromHeap(&Container->Heap, (void *)(uptr)Block->Address, Size, Flags);
+		EndReplayCall(Container, Call);
+
+		if (Result) {
+			Container->NumAllocs++;
+
+			UnhashReplayBlock(Block);
+			Container->LiveSize = Container->LiveSize - Block->Size + Size;
+			Container->PeakLiveSize = Max(Container->PeakLiveSize, Container->LiveSize);
+
+			Block->TracedAddress = NewTracedAddress;
+			Block->Address = (uptr)Result;
+			Block->Size = Size;
+			HashReplayBlock(Block);
+		} else {
+			Container->NumFailedAllocs++;
+		}
+	} else {
+		// NOTE(ivan): The other types move the data to a new block.
+		u64 Address = AllocFromReplayContainer(Container, Size, Flags, MemoryStackEnd_Low);
+		if (Address) {
+			replay_call Call = BeginReplayCall();
+			memcpy(GetReplayBlockData(Container, Address), GetReplayBlockData(Container, Block->Address), Min(Block->Size, (u64)Size));
+			EndReplayCall(Container, Call);
+
+			FreeFromReplayContainer(Container, Block);
+			AddReplayBlock(Container, NewTracedAddress, Address, Size, MemoryStackEnd_Low);
+		}
+	}
+}
+
+static void
+BeginReplayScope(replay_container *Container, memory_stack_end End) {
+	Assert(Container);
+
+	u32 Depth = Container->NumScopes[End];
+	if (Depth == MAX_REPLAY_SCOPES)
+		ReplayCrashf("Container '%s' has too many nested scopes!", Container->Info.Name);
+
+	replay_scope *Scope = &Container->Scopes[End][Depth];
+	Scope->Seq = Container->NextSeq;
+
+	replay_call Call = BeginReplayCall();
+	if (Container->Type == MemoryPartitionType_Stack)
+		Scope->TempMemory = BeginTemporaryMemory(&Container->Stack);
+	else if (Container->Type == MemoryPartitionType_DoubleStack)
+		Scope->DoubleStackTempMemory = BeginDoubleStackTemporaryMemory(&Container->DoubleStack, End);
+	EndReplayCall(Container, Call);
+
+	Container->NumScopes[End]++;
+}
+
+static void
+EndReplayScope(replay_container *Container, memory_stack_end End) {
+	Assert(Container);
+
+	// NOTE(ivan): Scope opened before the trace has started.
+	if (!Container->NumScopes[End])
+		return;
+
+	replay_scope *Scope = &Container->Scopes[End][--Container->NumScopes[End]];
+	b32 IsStackTarget = (Container->Type == MemoryPartitionType_Stack || Container->Type == MemoryPartitionType_DoubleStack);
+
+	replay_call Call = BeginReplayCall();
+	if (Container->Type == MemoryPartitionType_Stack)
+		EndTemporaryMemory(Scope->TempMemory);
+	else if (Container->Type == MemoryPartitionType_DoubleStack)
+		EndDoubleStackTemporaryMemory(Scope->DoubleStackTempMemory);
+	EndReplayCall(Container, Call);
+
+	// NOTE(ivan): Stack targets release the scope's blocks with the scope, the ones not freed yet are counted as freed here.
+	replay_block *Block = Container->LastBlock;
+	while (Block && Block->Seq >= Scope->Seq) {
+		replay_block *PrevBlock = Block->Prev;
+		if (Block->End == End) {
+			if (IsStackTarget) {
+				if (!Block->IsFreed)
+					Container->NumFrees++;
+				RemoveReplayBlock(Container, Block);
+			} else {
+				FreeFromReplayContainer(Container, Block);
+			}
+		}
+		Block = PrevBlock;
+	}
+}
+
+static void
+ReplayEvent(replay_container *Container, memory_trace_event *Event, memory_trace_event *NextEvent) {
+	Assert(Container);
+	Assert(Event);
+
+	u32 Flags = Event->Param & ((1 << MEMORY_TRACE_END_SHIFT) - 1);
+	memory_stack_end End = (memory_stack_end)Min(Event->Param >> MEMORY_TRACE_END_SHIFT, (u32)MemoryStackEnd_High);
+
+	switch (Event->Op) {
+	case MemoryTraceOp_Alloc: {
+		if (Event->Address) {
+			// NOTE(ivan): The address might be still taken if its free has not been traced.
+			replay_block *StaleBlock = FindReplayBlock(Container, Event->Address);
+			if (StaleBlock)
+				RemoveReplayBlock(Container, StaleBlock);
+
+			u64 Address = AllocFromReplayContainer(Container, (uptr)Event->Size, Flags, End);
+			if (Container->Type == MemoryPartitionType_FrameArena) {
+				if (Address) {
+					Container->FrameSizes[Container->NumFrames % Container->Param] += Event->Size;
+					Container->LiveSize += Event->Size;
+					Container->PeakLiveSize = Max(Container->PeakLiveSize, Container->LiveSize);
+				}
+			} else if (Address) {
+				AddReplayBlock(Container, Event->Address, Address, Event->Size, (u8)End);
+			}
+		} else {
+			Container->NumTraceFailures++;
+		}
+	} break;
+
+	case MemoryTraceOp_Free: {
+		replay_block *Block = FindReplayBlock(Container, Event->Address);
+		if (Block)
+			FreeFromReplayContainer(Container, Block);
+		else
+			Container->NumSkippedFrees++;
+	} break;
+
+	case MemoryTraceOp_Realloc: {
+		Assert(NextEvent);
+
+		replay_block *Block = FindReplayBlock(Container, Event->Address);
+		if (Block && NextEvent->Address)
+			ReallocFromReplayContainer(Container, Block, NextEvent->Address, (uptr)Event->Size, Flags);
+		else if (!NextEvent->Address)
+			Container->NumTraceFailures++;
+	} break;
+
+	case MemoryTraceOp_Pop: {
+		// NOTE(ivan): Stack's top block is popped, even if it had been freed and deferred by the stack target.
+		if (Container->LastBlock) {
+			replay_block *Block = Container->LastBlock;
+			while (Block && Block->IsFreed)
+				Block = Block->Prev;
+			if (Block)
+				FreeFromReplayContainer(Container, Block);
+		} else {
+			Container->NumSkippedFrees++;
+		}
+	} break;
+
+	case MemoryTraceOp_Reset: {
+		if (Container->Type == MemoryPartitionType_DoubleStack) {
+			replay_call Call = BeginReplayCall();
+			ResetMemoryDoubleStack(&Container->DoubleStack, End, Flags);
+			EndReplayCall(Container, Call);
+
+			replay_block *Block = Container->LastBlock;
+			while (Block) {
+				replay_block *PrevBlock = Block->Prev;
+				if (Block->End == End) {
+					if (!Block->IsFreed)
+						Container->NumFrees++;
+					RemoveReplayBlock(Container, Block);
+				}
+				Block = PrevBlock;
+			}
+			Container->NumScopes[End] = 0;
+		} else {
+			ResetReplayContainer(Container, Flags);
+		}
+	} break;
+
+	case MemoryTraceOp_BeginScope: {
+		BeginReplayScope(Container, End);
+	} break;
+
+	case MemoryTraceOp_EndScope: {
+		EndReplayScope(Container, End);
+	} break;
+
+	case MemoryTraceOp_Advance: {
+		if (Container->Type == MemoryPartitionType_FrameArena) {
+			replay_call Call = BeginReplayCall();
+			AdvanceFrameArena(&Container->FrameArena, Flags);
+			EndReplayCall(Container, Call);
+
+			Container->NumFrames++;
+			u64 *FrameSize = &Container->FrameSizes[Container->NumFrames % Container->Param];
+			Container->LiveSize -= *FrameSize;
+			*FrameSize = 0;
+		}
+	} break;
+
+	case MemoryTraceOp_Compact: {
+		if (Container->Type == MemoryPartitionType_HandleHeap) {
+			replay_call Call = BeginReplayCall();
+			CompactMemoryHandleHeap(&Container->HandleHeap, Event->Size);
+			EndReplayCall(Container, Call);
+		}
+	} break;
+	}
+
+	Container->PeakUsedSize = Max(Container->PeakUsedSize, (u64)GetReplayUsedSize(Container));
+
+	if ((++Container->NumEvents % REPLAY_FRAGMENTATION_PERIOD) == 0)
+		SampleReplayFragmentation(Container);
+}
+
+static void
+PrintUsage(void) {
+	printf("Memory trace replay tool.\n");
+	printf("memreplay <trace-file> [-as stack|heap|pool|buddy|handleheap] [-only container-name] [-verbose]\n");
+	printf("\n");
+	printf("-as              - replay stacks, heaps, pools, buddies and relocatable heaps against a given type.\n");
+	printf("-only            - replay a single container.\n");
+	printf("-verbose         - output what the containers complain about.\n");
+}
+
+int
+main(int ArgC, char **ArgV) {
+	const char *FileName = 0;
+	const char *OnlyName = 0;
+	s32 TargetType = NOTFOUND;
+
+	for (s32 Index = 1; Index < ArgC; Index++) {
+		if (strcmp(ArgV[Index], "-as") == 0 && (Index + 1) < ArgC) {
+			const char *TypeName = ArgV[++Index];
+			for (u32 Type = 0; Type < MemoryPartitionType_Spare; Type++) {
+				if (IsPartitionTypeRetargetable((memory_partition_type)Type) &&
+					Type != MemoryPartitionType_GrowablePool &&
+					strcmp(TypeName, GetPartitionTypeName((memory_partition_type)Type)) == 0)
+					TargetType = (s32)Type;
+			}
+			if (TargetType == NOTFOUND) {
+				PrintUsage();
+				return 1;
+			}
+		} else if (strcmp(ArgV[Index], "-only") == 0 && (Index + 1) < ArgC) {
+			OnlyName = ArgV[++Index];
+		} else if (strcmp(ArgV[Index], "-verbose") == 0) {
+			ReplayState.IsVerbose = true;
+		} else if (!FileName && ArgV[Index][0] != '-') {
+			FileName = ArgV[Index];
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (!FileName) {
+		PrintUsage();
+		return 1;
+	}
+
+	// NOTE(ivan): Read the whole trace.
+	FILE *File = fopen(FileName, "rb");
+	if (!File)
+		ReplayCrashf("Cannot open '%s'!", FileName);
+
+	memory_trace_header Header = {};
+	if (fread(&Header, sizeof(Header), 1, File) != 1 || Header.Magic != MEMORY_TRACE_MAGIC ||
+		Header.Version != MEMORY_TRACE_VERSION || Header.EventSize != sizeof(memory_trace_event))
+		ReplayCrashf("'%s' is not a memory trace of version %u!", FileName, MEMORY_TRACE_VERSION);
+
+	fseek(File, 0, SEEK_END);
+	uptr NumEvents = ((uptr)ftell(File) - sizeof(Header)) / sizeof(memory_trace_event);
+	fseek(File, sizeof(Header), SEEK_SET);
+
+	memory_trace_event *Events = (memory_trace_event *)malloc(Max(NumEvents, (uptr)1) * sizeof(memory_trace_event));
+	if (!Events || fread(Events, sizeof(memory_trace_event), NumEvents, File) != NumEvents)
+		ReplayCrashf("Cannot read '%s'!", FileName);
+	fclose(File);
+
+	// NOTE(ivan): Set up the platform and the game memory the containers are carved from.
+	platform_api *PlatformAPI = &ReplayState.PlatformAPI;
+	PlatformAPI->Outf = ReplayOutf;
+	PlatformAPI->Crashf = ReplayCrashf;
+	PlatformAPI->CommitMemory = ReplayCommitMemory;
+	PlatformAPI->DecommitMemory = ReplayDecommitMemory;
+	PlatformAPI->BindMemoryToNUMANode = ReplayBindMemoryToNUMANode;
+	PlatformAPI->GetCurrentNUMANode = ReplayGetCurrentNUMANode;
+#if MUTEX_PROFILING
+	PlatformAPI->ProfileMutex = ReplayProfileMutex;
+#endif
+	PlatformAPI->PageSize = (uptr)sysconf(_SC_PAGESIZE);
+	PlatformAPI->CPUInfo.NumNUMA = 1;
+
+	GameState.PlatformAPI = PlatformAPI;
+	GameState.GameMemory = &ReplayState.GameMemory;
+
+	// NOTE(ivan): Learn the containers first, their sizes tell how much address space to reserve.
+	uptr StorageSize = 0;
+	for (uptr Index = 0; Index < NumEvents; Index++) {
+		memory_trace_event *Event = &Events[Index];
+		replay_container *Container = ReplayState.Containers[Event->ContainerId];
+
+		if (Event->Op == MemoryTraceOp_Create && (Index + 1) < NumEvents) {
+			if (!Container) {
+				if (posix_memalign((void **)&Container, CACHE_LINE_SIZE, sizeof(replay_container)) != 0)
+					ReplayCrashf("Out of memory!");
+				memset(Container, 0, sizeof(replay_container));
+				ReplayState.Containers[Event->ContainerId] = Container;
+
+				Container->Id = Event->ContainerId;
+				memcpy(&Container->Info, &Events[Index + 1], sizeof(Container->Info));
+				Container->Info.Name[ArraySize(Container->Info.Name) - 1] = 0;
+				Container->SourceType = (memory_partition_type)Container->Info.Type;
+				Container->Type = Container->SourceType;
+				if (TargetType != NOTFOUND && IsPartitionTypeRetargetable(Container->SourceType))
+					Container->Type = (memory_partition_type)TargetType;
+				Container->IsReplayed = (!OnlyName || strcmp(OnlyName, Container->Info.Name) == 0);
+			}
+
+			Container->Size = Max(Container->Size, (uptr)Event->Size);
+			Container->BlockSize = (uptr)Event->Address;
+			Container->Param = Event->Param;
+
+			Index++;
+			continue;
+		}
+
+		if (Container && (Event->Op == MemoryTraceOp_Alloc || Event->Op == MemoryTraceOp_Realloc)) {
+			Container->MaxAllocSize = Max(Container->MaxAllocSize, (uptr)Event->Size);
+			Container->NumTracedAllocs++;
+		}
+		if (Event->Op == MemoryTraceOp_Realloc)
+			Index++;
+	}
+
+	for (u32 Id = 0; Id < MAX_REPLAY_CONTAINERS; Id++) {
+		replay_container *Container = ReplayState.Containers[Id];
+		if (Container && Container->IsReplayed) {
+			StorageSize += AlignPow2(Container->Size, PlatformAPI->PageSize) + PlatformAPI->PageSize * 4;
+			if (Container->Type == MemoryPartitionType_GrowablePool)
+				StorageSize += MAX_MEMORY_POOL_CHUNKS * (Container->BlockSize * Container->Param + Kilobytes(4)) + PlatformAPI->PageSize;
+		}
+	}
+	StorageSize = AlignPow2(StorageSize + Megabytes(1), PlatformAPI->PageSize);
+
+	u8 *Storage = (u8 *)mmap(0, StorageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (Storage == (u8 *)MAP_FAILED)
+		ReplayCrashf("Cannot reserve %.3f Mb!", (f64)StorageSize / (f64)Megabytes(1));
+
+	ReplayState.GameMemory.FreeStorage.Base = Storage;
+	ReplayState.GameMemory.FreeStorage.Size = StorageSize;
+	ReplayState.GameMemory.StorageTotalSize = StorageSize;
+
+	// NOTE(ivan): Replay.
+	u64 StartClock = __rdtsc();
+	u64 StartTime = GetWallClockNanoseconds();
+
+	for (uptr Index = 0; Index < NumEvents; Index++) {
+		memory_trace_event *Event = &Events[Index];
+		replay_container *Container = ReplayState.Containers[Event->ContainerId];
+		if (Event->Op == MemoryTraceOp_Create || Event->Op == MemoryTraceOp_Realloc)
+			Index++;
+
+		if (!Container || !Container->IsReplayed || Index >= NumEvents)
+			continue;
+
+		if (Event->Op == MemoryTraceOp_Create) {
+			if (Container->IsCreated)
+				ResetReplayContainer(Container, 0);
+			else
+				CreateReplayContainer(Container);
+		} else if (Container->IsCreated) {
+			ReplayEvent(Container, Event, (Event->Op == MemoryTraceOp_Realloc) ? &Events[Index] : 0);
+		}
+	}
+
+	u64 EndClock = __rdtsc();
+	u64 EndTime = GetWallClockNanoseconds();
+	f64 ClocksPerSecond = (EndTime > StartTime) ? ((f64)(EndClock - StartClock) * 1.0e9 / (f64)(EndTime - StartTime)) : 1.0e9;
+
+	// NOTE(ivan): Report.
+	printf("Replayed %llu events of '%s'%s%s.\n", (u64)NumEvents, FileName,
+		   (TargetType != NOTFOUND) ? " as " : "", (TargetType != NOTFOUND) ? GetPartitionTypeName((memory_partition_type)TargetType) : "");
+	printf("%-24s %-24s %10s %10s %8s %8s %9s %12s %12s %9s %12s %11s\n",
+		   "container", "type", "allocs", "frees", "failed", "skipped", "Mops/s",
+		   "peak live Kb", "peak used Kb", "overhead", "committed Kb", "frag peak/end");
+
+	u64 TotalCalls = 0, TotalClocks = 0;
+	for (u32 Id = 0; Id < MAX_REPLAY_CONTAINERS; Id++) {
+		replay_container *Container = ReplayState.Containers[Id];
+		if (!Container || !Container->IsCreated)
+			continue;
+
+		SampleReplayFragmentation(Container);
+
+		char TypeName[64] = {};
+		if (Container->Type == Container->SourceType)
+			snprintf(TypeName, sizeof(TypeName), "%s", GetPartitionTypeName(Container->Type));
+		else
+			snprintf(TypeName, sizeof(TypeName), "%s->%s", GetPartitionTypeName(Container->SourceType), GetPartitionTypeName(Container->Type));
+
+		f64 Seconds = (f64)Container->Clocks / ClocksPerSecond;
+		f64 MopsPerSecond = (Seconds > 0.0) ? ((f64)Container->NumCalls / Seconds / 1.0e6) : 0.0;
+		f64 Overhead = Container->PeakLiveSize ? (100.0 * ((f64)Container->PeakUsedSize / (f64)Container->PeakLiveSize - 1.0)) : 0.0;
+
+		char Fragmentation[32] = "n/a";
+		if (Container->Fragmentation >= 0.0)
+			snprintf(Fragmentation, sizeof(Fragmentation), "%.2f/%.2f", Container->PeakFragmentation, Container->Fragmentation);
+
+		printf("%-24s %-24s %10llu %10llu %8llu %8llu %9.2f %12.1f %12.1f %8.1f%% %12.1f %11s\n",
+			   Container->Info.Name, TypeName, Container->NumAllocs, Container->NumFrees, Container->NumFailedAllocs,
+			   Container->NumSkippedFrees, MopsPerSecond, (f64)Container->PeakLiveSize / 1024.0,
+			   (f64)Container->PeakUsedSize / 1024.0, Overhead, (f64)Container->PeakCommittedSize / 1024.0, Fragmentation);
+		if (Container->NumTraceFailures)
+			printf("%-24s %llu allocations failed when captured, not replayed.\n", "", Container->NumTraceFailures);
+
+		TotalCalls += Container->NumCalls;
+		TotalClocks += Container->Clocks;
+	}
+
+	f64 TotalSeconds = (f64)TotalClocks / ClocksPerSecond;
+	printf("Total: %llu calls, %.3f ms in containers, %.2f Mops/s.\n", TotalCalls, TotalSeconds * 1000.0,
+		   (TotalSeconds > 0.0) ? ((f64)TotalCalls / TotalSeconds / 1.0e6) : 0.0);
+
+	return 0;
+}
@@ -1,25 +1,28 @@
 #include "game_misc.h"
 
-char **
-TokenizeString(memory_heap *Heap, const char *String, u32 *NumTokens, const char *Delims) {
-	Assert(Heap);
+// NOTE(ivan): Maximum count of blocks TokenizeString() allocates with one heap batch.
+#define TOKENIZE_BATCH_SIZE 32
+
+// NOTE(ivan): Counts the tokens of a given string, and the size of all the tokens' characters.
+static u32
+CountTokens(const char *String, const char *Delims, uptr *CharsSize) {
 	Assert(String);
-	Assert(NumTokens);
 	Assert(Delims);
 
-	const char *Ptr = String;
-	*NumTokens = 0;
+	u32 Result = 0;
+	uptr Size = 0;
 
-	// NOTE(ivan): Iterate to count tokens.
+	const char *Ptr = String;
 	b32 WasDelim = true;
 	while (true) {
 		if (strchr(Delims, *Ptr) || *Ptr == 0) {
 			if (!WasDelim)
-				(*NumTokens)++;
+				Result++;
 
 			WasDelim = true;
 		} else {
 			WasDelim = false;
+			Size++;
 		}
 
 		if (*Ptr == 0)
@@ -28,47 +31,84 @@ TokenizeString(memory_heap *Heap, const char *String, u32 *NumTokens, const char
 		Ptr++;
 	}
 
+	if (CharsSize)
+		*CharsSize = Size;
+	return Result;
+}
+
+char **
+TokenizeString(memory_heap *Heap, const char *String, u32 *NumTokens, const char *Delims) {
+	Assert(Heap);
+	Assert(String);
+	Assert(NumTokens);
+	Assert(Delims);
+
+	// NOTE(ivan): Iterate to count tokens.
+	*NumTokens = CountTokens(String, Delims, 0);
 	if ((*NumTokens) == 0)
 		return 0;
 
-	// NOTE(ivan): Allocate needed space.
-	char **Result = (char **)AllocFromHeap(Heap, sizeof(char *) * (*NumTokens));
-	if (Result) {
-		// NOTE(ivan): Iterate all over again to capture tokens.
-		u32 It = 0;
-		const char *Last = Ptr = String;
-
-		WasDelim = true;
-		while (true) {
-			if (strchr(Delims, *Ptr) || *Ptr == 0) {
-				if (!WasDelim) {
-					u32 Diff = (u32)(Ptr - Last);
-
-					Result[It] = (char *)AllocFromHeap(Heap, sizeof(char) * (Diff + 1));
-					if (Result[It]) {
-						strncpy(Result[It], Last, Diff);
-						Result[It][Diff] = 0;
+	// NOTE(ivan): Allocate the tokens in batches, so the heap mutex is taken once per batch
+	// instead of once per token. The pointers array goes along with the first batch.
+	char **Result = 0;
 
-						Last = Ptr + 1;
-						It++;
-					} else {
-						for (u32 Index = 0; Index < It; Index++)
-							FreeFromHeap(Heap, Result[Index]);
-						FreeFromHeap(Heap, Result);
+	const char *BatchTokens[TOKENIZE_BATCH_SIZE];
+	uptr BatchSizes[TOKENIZE_BATCH_SIZE];
+	void *BatchBlocks[TOKENIZE_BATCH_SIZE];
+	u32 NumBatched = 0;
+	BatchTokens[NumBatched] = 0;
+	BatchSizes[NumBatched++] = sizeof(char *) * (*NumTokens);
+
+	// NOTE(ivan): Iterate all over again to capture tokens.
+	u32 It = 0, NumCaptured = 0;
+	const char *Ptr = String;
+	const char *Last = String;
+
+	b32 WasDelim = true;
+	while (true) {
+		if (strchr(Delims, *Ptr) || *Ptr == 0) {
+			if (!WasDelim) {
+				BatchTokens[NumBatched] = Last;
+				BatchSizes[NumBatched++] = sizeof(char) * ((Ptr - Last) + 1);
+				NumCaptured++;
+
+				if (NumBatched == TOKENIZE_BATCH_SIZE || NumCaptured == (*NumTokens)) {
+					if (!AllocFromHeapBatch(Heap, BatchBlocks, BatchSizes, NumBatched, 0)) {
+						if (Result) {
+							FreeFromHeapBatch(Heap, (void **)Result, It);
+							FreeFromHeap(Heap, Result);
+							Result = 0;
+						}
 						break;
 					}
-				}
 
-				WasDelim = true;
-			} else {
-				WasDelim = false;
-			}
+					for (u32 Index = 0; Index < NumBatched; Index++) {
+						if (!BatchTokens[Index]) {
+							Result = (char **)BatchBlocks[Index];
+							continue;
+						}
 
-			if (*Ptr == 0)
-				break;
+						u32 Diff = (u32)(BatchSizes[Index] - 1);
+						Result[It] = (char *)BatchBlocks[Index];
+						strncpy(Result[It], BatchTokens[Index], Diff);
+						Result[It][Diff] = 0;
+						It++;
+					}
+					NumBatched = 0;
+				}
+			}
 
-			Ptr++;
+			WasDelim = true;
+		} else {
+			if (WasDelim)
+				Last = Ptr;
+			WasDelim = false;
 		}
+
+		if (*Ptr == 0)
+			break;
+
+		Ptr++;
 	}
 
 	return Result;
@@ -80,27 +120,62 @@ FreeTokenizedString(memory_heap *Heap, char **Tokens, u32 NumTokens) {
 	Assert(Tokens);
 	Assert(NumTokens);
 
-	for (u32 Index = 0; Index < NumTokens; Index++)
-		FreeFromHeap(Heap, Tokens[Index]);
+	FreeFromHeapBatch(Heap, (void **)Tokens, NumTokens);
 	FreeFromHeap(Heap, Tokens);
 }
 
+char **
+TokenizeStringOnStack(memory_stack *Stack, const char *String, u32 *NumTokens, const char *Delims) {
+	Assert(Stack);
+	Assert(Stack->NumTemporaryScopes);
+	Assert(String);
+	Assert(NumTokens);
+	Assert(Delims);
+
+	uptr CharsSize;
+	*NumTokens = CountTokens(String, Delims, &CharsSize);
+	if ((*NumTokens) == 0)
+		return 0;
+
+	// NOTE(ivan): The pointers array and all the tokens go in one allocation.
+	char **Result = (char **)AllocFromStack(Stack, sizeof(char *) * (*NumTokens) + CharsSize + (*NumTokens), 0);
+	if (!Result)
+		return 0;
+
+	char *Chars = (char *)(Result + (*NumTokens));
+	u32 It = 0;
+	const char *Ptr = String;
+	while (It < (*NumTokens)) {
+		while (strchr(Delims, *Ptr))
+			Ptr++;
+
+		Result[It++] = Chars;
+		while (*Ptr && !strchr(Delims, *Ptr))
+			*Chars++ = *Ptr++;
+		*Chars++ = 0;
+	}
+
+	return Result;
+}
+
 piece
 ReadEntireFile(memory_stack *Stack, const char *FileName) {
 	Assert(Stack);
+	Assert(Stack->NumTemporaryScopes);
 	Assert(FileName);
 
 	piece Result = {};
 
 	file_handle FileHandle = GameState.PlatformAPI->FOpen(FileName, FileAccessType_OpenForReading);
 	if (FileHandle != NOTFOUND) {
+		// NOTE(ivan): Zero past the data lets text files be parsed in place. On failure the data
+		// is left to the scope, it cannot be popped.
 		Result.Size = SafeTruncateU64(GetFileSizeByHandle(FileHandle));
-		Result.Base = (u8 *)AllocFromStack(Stack, Result.Size);
+		Result.Base = (u8 *)AllocFromStack(Stack, Result.Size + 1, 0);
 		if (Result.Base) {
-			if (GameState.PlatformAPI->FRead(FileHandle, Result.Base, (u32)Result.Size) == Result.Size) {
-				// NOTE(ivan): Success.
+			if (!Result.Size || GameState.PlatformAPI->FRead(FileHandle, Result.Base, (u32)Result.Size) == Result.Size) {
+				Result.Base[Result.Size] = 0;
 			} else {
-				PopStack(Stack);
 				Result.Base = 0;
 				Result.Size = 0;
 			}
@@ -157,7 +232,8 @@ GetFileSizeByHandle(file_handle FileHandle) {
 
 	if (GameState.PlatformAPI->FSeek(FileHandle, 0, FileSeekOrigin_Current, &PrevPos)) {
 		if (GameState.PlatformAPI->FSeek(FileHandle, 0, FileSeekOrigin_End, &Result)) {
-			GameState.PlatformAPI->FSeek(FileHandle, PrevPos, FileSeekOrigin_Begin, 0);
+			uptr Unused;
+			GameState.PlatformAPI->FSeek(FileHandle, PrevPos, FileSeekOrigin_Begin, &Unused);
 		}
 	}
 
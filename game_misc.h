@@ -4,11 +4,13 @@
 #include "game_platform.h"
 
 // NOTE(ivan): String tokenizer, splits a given string to a seperate tokens using a specified delimiters array.
+// TokenizeStringOnStack() must be called inside a temporary memory scope of the stack, the tokens are released with the scope.
 char ** TokenizeString(memory_heap *Heap, const char *String, u32 *NumTokens, const char *Delims);
 void FreeTokenizedString(memory_heap *Heap, char **Tokens, u32 NumTokens);
+char ** TokenizeStringOnStack(memory_stack *Stack, const char *String, u32 *NumTokens, const char *Delims);
 
 // NOTE(ivan): File I/O utilities.
-piece ReadEntireFile(memory_stack *Stack, const char *FileName); // NOTE(ivan): Should be released by PopStack().
+piece ReadEntireFile(memory_stack *Stack, const char *FileName); // NOTE(ivan): Must be called inside a temporary memory scope of the stack, the data is zero-terminated and released with the scope.
 b32 WriteEntireFile(const char *FileName, void *Buffer, uptr Size);
 uptr GetFileSizeByName(const char *FileName);
 uptr GetFileSizeByHandle(file_handle FileHandle);
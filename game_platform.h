@@ -4,6 +4,10 @@
 // NOTE(ivan): Compiler detection.
 #if defined(_MSC_VER)
 #    define MSVC 1
+#    define GCC 0
+#elif defined(__GNUC__) // NOTE(ivan): Clang goes here too.
+#    define MSVC 0
+#    define GCC 1
 #else
 #    error Unsupported compiler!
 #endif
@@ -24,6 +28,21 @@
 #    else
 #        error Unsupported target CPU architecture!
 #    endif
+#elif GCC
+#    if defined(__i386__) || defined(__x86_64__)
+#        define INTEL86 1
+#        define INTELORDER 1
+#        define AMIGAORDER 0
+#        if defined(__x86_64__)
+#            define X32CPU 0
+#            define X64CPU 1
+#        else
+#            define X32CPU 1
+#            define X64CPU 0
+#        endif
+#    else
+#        error Unsupported target CPU architecture!
+#    endif
 #endif
 
 #if X32CPU
@@ -56,17 +75,49 @@
 // NOTE(ivan): C intrinsics.
 #if MSVC
 #    include <intrin.h>
+#elif GCC
+#    include <x86intrin.h>
+#endif
+
+// NOTE(ivan): OS interfaces the ticket-mutex puts its waiting threads to sleep with.
+// Game module does not include windows.h, synchapi.h alone brings WaitOnAddress() and friends in.
+// Without windows.h the Windows headers have to be told the target CPU, the same way windows.h does it.
+// WaitOnAddress() is declared for Windows 8 and later targets only, so this comes before
+// game_platform_win32.h lowers the target version.
+#if MSVC
+#    if X64CPU && !defined(_AMD64_)
+#        define _AMD64_
+#    elif X32CPU && !defined(_X86_)
+#        define _X86_
+#    endif
+#    ifndef NOMINMAX
+#        define NOMINMAX
+#    endif
+#    include <synchapi.h>
+#    pragma comment(lib, "Synchronization.lib")
+#elif GCC
+#    include <unistd.h>
+#    include <sys/syscall.h>
 #endif
 
 // NOTE(ivan): General types.
+// NOTE(ivan): Long is 64-bit wide on LP64 targets, so 32-bit types are based on int there.
 typedef unsigned char u8;
 typedef unsigned short int u16;
+#if MSVC
 typedef unsigned long int u32;
+#else
+typedef unsigned int u32;
+#endif
 typedef unsigned long long u64;
 
 typedef signed char s8;
 typedef signed short int s16;
+#if MSVC
 typedef signed long int s32;
+#else
+typedef signed int s32;
+#endif
 typedef signed long long s64;
 
 #if X32CPU
@@ -136,7 +187,11 @@ Swap(T *A, T *B) {
 #define NOTFOUND ((s32)-1)
 
 // NOTE(ivan): Causes access violation exception which allows to break into the debugger if any.
-#define BreakDebugger() do {*((s32 *)0) = 1;} while(0)
+#if GCC
+#    define BreakDebugger() __builtin_trap()
+#else
+#    define BreakDebugger() do {*((s32 *)0) = 1;} while(0)
+#endif
 
 // NOTE(ivan): Debug assertions.
 #if SLOWCODE
@@ -188,6 +243,17 @@ SafeTruncateU16(u16 Value) {
 #define Gigabytes(Value) (Megabytes(Value) * 1024LL)
 #define Terabytes(Value) (Gigabytes(Value) * 1024LL)
 
+// NOTE(ivan): Assumed CPU cache line size.
+#define CACHE_LINE_SIZE 64
+
+// NOTE(ivan): Cache line alignment specifier, for structures and structure members that are written by one thread
+// and must not share a cache line with data used by the other threads (false sharing).
+#if MSVC
+#    define CacheAligned __declspec(align(CACHE_LINE_SIZE))
+#elif GCC
+#    define CacheAligned __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
 // NOTE(ivan): Is power of two?
 template <typename T> inline b32
 IsPow2(T Value) {
@@ -218,6 +284,11 @@ FindLeastSignificantBit(u32 Value)
 	
 #if MSVC
 	Result.IsFound = _BitScanForward((unsigned long *)&Result.Index, Value);
+#elif GCC
+	if (Value) {
+		Result.IsFound = true;
+		Result.Index = __builtin_ctz(Value);
+	}
 #else
 	for (u32 Test = 0; Test < 32; Test++) {
 		if (Value & (1 << Test)) {
@@ -237,8 +308,13 @@ FindMostSignificantBit(u32 Value)
 
 #if MSVC
 	Result.IsFound = _BitScanReverse((unsigned long *)&Result.Index, Value);
+#elif GCC
+	if (Value) {
+		Result.IsFound = true;
+		Result.Index = 31 - __builtin_clz(Value);
+	}
 #else
-	for (s32 Test = 31; Test >= 0; Test++) {
+	for (s32 Test = 31; Test >= 0; Test--) {
 		if (Value & (1 << Test)) {
 			Result.IsFound = true;
 			Result.Index = Test;
@@ -250,16 +326,52 @@ FindMostSignificantBit(u32 Value)
 	return Result;
 }
 
+// NOTE(ivan): 64-bit bit scan.
+inline bit_scan_result
+FindLeastSignificantBit64(u64 Value)
+{
+	bit_scan_result Result = {};
+
+#if MSVC && X64CPU
+	Result.IsFound = _BitScanForward64((unsigned long *)&Result.Index, Value);
+#else
+	Result = FindLeastSignificantBit((u32)Value);
+	if (!Result.IsFound) {
+		Result = FindLeastSignificantBit((u32)(Value >> 32));
+		Result.Index += 32;
+	}
+#endif
+
+	return Result;
+}
+inline bit_scan_result
+FindMostSignificantBit64(u64 Value)
+{
+	bit_scan_result Result = {};
+
+#if MSVC && X64CPU
+	Result.IsFound = _BitScanReverse64((unsigned long *)&Result.Index, Value);
+#else
+	Result = FindMostSignificantBit((u32)(Value >> 32));
+	if (Result.IsFound)
+		Result.Index += 32;
+	else
+		Result = FindMostSignificantBit((u32)Value);
+#endif
+
+	return Result;
+}
+
 // NOTE(ivan): Counts set bits in a mask.
 inline u32
 CountSetBits(uptr Mask) {
 	u32 Result = 0;
 	u32 LeftShift = sizeof(uptr) * 8 - 1;
-	uptr BitTest = ((uptr)1 << LeftShift);
+	uptr TestBit = ((uptr)1 << LeftShift);
 
 	for (u32 Index = 0; Index <= LeftShift; Index++) {
-		Result += ((Mask & BitTest) ? 1 : 0);
-		BitTest /= 2;
+		Result += ((Mask & TestBit) ? 1 : 0);
+		TestBit /= 2;
 	}
 
 	return Result;
@@ -293,6 +405,8 @@ SwapEndianU32(u32 *Value) {
 
 #if MSVC
 	*Value = _byteswap_ulong(*Value);
+#elif GCC
+	*Value = __builtin_bswap32(*Value);
 #else	
 	u32 V = *Value;
 	*Value = ((V << 24) | ((V & 0xFF00) << 8) | ((V >> 8) & 0xFF00) | (V >> 24));
@@ -304,9 +418,11 @@ SwapEndianU16(u16 *Value) {
 
 #if MSVC
 	*Value = _byteswap_ushort(*Value);
+#elif GCC
+	*Value = __builtin_bswap16(*Value);
 #else
 	u16 V = *Value;
-	*Value = ((V << 8) || (V  >> 8));
+	*Value = (u16)((V << 8) | (V  >> 8));
 #endif
 }
 
@@ -314,10 +430,20 @@ SwapEndianU16(u16 *Value) {
 #define FourCC(String) ((u32)((String[3] << 0) | (String[2] << 8) | (String[1] << 16) | (String[0] << 24)))
 #define FastFourCC(String) (*(u32 *)(String)) // NOTE(ivan): Does not work with switch/case.
 
+// NOTE(ivan): Thread-local storage specifier.
+#if MSVC
+#    define ThreadLocal __declspec(thread)
+#elif GCC
+#    define ThreadLocal __thread
+#endif
+
 // NOTE(ivan): Memory barriers.
 #if MSVC
 inline void CompleteWritesBeforeFutureWrites(void) {_WriteBarrier(); _mm_sfence();}
 inline void CompleteReadsBeforeFutureReads(void) {_ReadBarrier(); _mm_lfence();}
+#elif GCC
+inline void CompleteWritesBeforeFutureWrites(void) {__asm__ __volatile__("" ::: "memory"); _mm_sfence();}
+inline void CompleteReadsBeforeFutureReads(void) {__asm__ __volatile__("" ::: "memory"); _mm_lfence();}
 #endif
 
 // NOTE(ivan): Interlocked operations.
@@ -326,39 +452,268 @@ inline u32 AtomicIncrementU32(volatile u32 *Value) {return _InterlockedIncrement
 inline u64 AtomicIncrementU64(volatile u64 *Value) {return _InterlockedIncrement64((volatile __int64 *)Value);}
 inline u32 AtomicDecrementU32(volatile u32 *Value) {return _InterlockedDecrement((volatile long *)Value);}
 inline u64 AtomicDecrementU64(volatile u64 *Value) {return _InterlockedDecrement64((volatile __int64 *)Value);}
+inline u32 AtomicAddU32(volatile u32 *Value, u32 Addend) {return _InterlockedExchangeAdd((volatile long *)Value, Addend) + Addend;}
+inline u64 AtomicAddU64(volatile u64 *Value, u64 Addend) {return _InterlockedExchangeAdd64((volatile __int64 *)Value, Addend) + Addend;}
 inline u32 AtomicExchangeU32(volatile u32 *Target, u32 Value) {return _InterlockedExchange((volatile long *)Target, Value);}
 inline u64 AtomicExchangeU64(volatile u64 *Target, u64 Value) {return _InterlockedExchange64((volatile __int64 *)Target, Value);}
 inline u32 AtomicCompareExchangeU32(volatile u32 *Value, u32 NewValue, u32 Exp) {return _InterlockedCompareExchange((volatile long *)Value, NewValue, Exp);}
 inline u64 AtomicCompareExchangeU64(volatile u64 *Value, u64 NewValue, u64 Exp) {return _InterlockedCompareExchange64((volatile __int64 *)Value, NewValue, Exp);}
+#elif GCC
+inline u32 AtomicIncrementU32(volatile u32 *Value) {return __sync_add_and_fetch(Value, 1);}
+inline u64 AtomicIncrementU64(volatile u64 *Value) {return __sync_add_and_fetch(Value, 1);}
+inline u32 AtomicDecrementU32(volatile u32 *Value) {return __sync_sub_and_fetch(Value, 1);}
+inline u64 AtomicDecrementU64(volatile u64 *Value) {return __sync_sub_and_fetch(Value, 1);}
+inline u32 AtomicAddU32(volatile u32 *Value, u32 Addend) {return __sync_add_and_fetch(Value, Addend);}
+inline u64 AtomicAddU64(volatile u64 *Value, u64 Addend) {return __sync_add_and_fetch(Value, Addend);}
+inline u32 AtomicExchangeU32(volatile u32 *Target, u32 Value) {return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);}
+inline u64 AtomicExchangeU64(volatile u64 *Target, u64 Value) {return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);}
+inline u32 AtomicCompareExchangeU32(volatile u32 *Value, u32 NewValue, u32 Exp) {return __sync_val_compare_and_swap(Value, Exp, NewValue);}
+inline u64 AtomicCompareExchangeU64(volatile u64 *Value, u64 NewValue, u64 Exp) {return __sync_val_compare_and_swap(Value, Exp, NewValue);}
 #endif
 
 // NOTE(ivan): Yield processor, give its time to other threads.
-#if MSVC
+// NOTE(ivan): On Windows winnt.h defines it already, brought in by synchapi.h.
+#if GCC
 inline void YieldProcessor(void) {_mm_pause();}
 #endif
 
+// NOTE(ivan): Sleeping on a 32-bit word until it is woken up, if the word still holds the expected value.
+// Waking up is not guaranteed to be precise, the sleeping thread must check its condition again.
+#if MSVC
+inline void SleepOnAddress(volatile u32 *Address, u32 Expected) {WaitOnAddress(Address, &Expected, sizeof(Expected), 0xFFFFFFFF);} // NOTE(ivan): INFINITE.
+inline void WakeAllOnAddress(volatile u32 *Address) {WakeByAddressAll((void *)Address);}
+#elif GCC
+// NOTE(ivan): futex() operations, the values are from linux/futex.h which is not always installed.
+#    define LINUX_FUTEX_WAIT_PRIVATE 128
+#    define LINUX_FUTEX_WAKE_PRIVATE 129
+
+inline void SleepOnAddress(volatile u32 *Address, u32 Expected) {syscall(SYS_futex, Address, LINUX_FUTEX_WAIT_PRIVATE, Expected, 0, 0, 0);}
+inline void WakeAllOnAddress(volatile u32 *Address) {syscall(SYS_futex, Address, LINUX_FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);}
+#endif
+
 // NOTE(ivan): Cross-platform ticket-mutex.
 // NOTE(ivan): Any instance of this structure MUST be ZERO-initialized for proper
 // functioning of EnterTicketMutex()/LeaveTicketMutex() functions.
-struct ticket_mutex {
+// NOTE(ivan): The mutex takes a whole cache line, so spinning on it never slows down
+// the threads that work with the data next to it.
+// NOTE(ivan): Waiting thread spins with exponential backoff for a while, then goes to sleep until the mutex
+// is left, so a descheduled holder does not make the waiters burn their cores. Threads still enter
+// in the order they have taken their tickets.
+// NOTE(ivan): Sleeping threads are spread between the wake-up slots by their tickets, leaving the mutex
+// wakes up only the threads sleeping on the next ticket's slot instead of all of them.
+#define TICKET_MUTEX_NUM_SLOTS 8
+
+// NOTE(ivan): Mutex profiling, internal builds only. A mutex that has been given a profile with the platform's
+// ProfileMutex() counts its entering, waiting and holding in it. All the profile's counters are updated
+// by the thread holding the mutex, so they need no atomics.
+#if INTERNAL
+#    define MUTEX_PROFILING 1
+#else
+#    define MUTEX_PROFILING 0
+#endif
+
+#if MUTEX_PROFILING
+struct mutex_profile {
+	char Name[32];
+
+	u64 NumEnters;
+	u64 NumContendedEnters; // NOTE(ivan): Enters that had to wait for another thread to leave.
+	u64 WaitClocks;
+	u64 MaxWaitClocks;
+	u64 HoldClocks;
+	u64 MaxHoldClocks;
+
+	u64 EnterClock; // NOTE(ivan): When the current holder has entered.
+};
+#    define TICKET_MUTEX_PROFILE_SIZE sizeof(mutex_profile *)
+#else
+#    define TICKET_MUTEX_PROFILE_SIZE 0
+#endif
+
+struct CacheAligned ticket_mutex {
 	volatile u64 Ticket;
 	volatile u64 Serving;
+#if MUTEX_PROFILING
+	mutex_profile *Profile;
+#endif
+	volatile u32 NumSleeping;
+	volatile u32 Slots[TICKET_MUTEX_NUM_SLOTS]; // NOTE(ivan): Bumped each time the slot's sleepers are woken up.
+
+	u8 Padding[CACHE_LINE_SIZE - sizeof(u64) * 2 - TICKET_MUTEX_PROFILE_SIZE - sizeof(u32) * (TICKET_MUTEX_NUM_SLOTS + 1)];
 };
 
+// NOTE(ivan): Ticket-mutex spinning limits: pauses between two checks double each round up to the maximum,
+// the waiting thread goes to sleep after the given count of rounds.
+#define TICKET_MUTEX_MAX_BACKOFF 64
+#define TICKET_MUTEX_SPIN_ROUNDS 10
+
+// NOTE(ivan): Waits for a given ticket to be served.
+inline void
+WaitForTicket(ticket_mutex *Mutex, u64 Ticket) {
+	Assert(Mutex);
+
+	u32 Backoff = 1;
+	for (u32 Round = 0; Round < TICKET_MUTEX_SPIN_ROUNDS; Round++) {
+		for (u32 Pause = 0; Pause < Backoff; Pause++)
+			YieldProcessor();
+		if (Ticket == Mutex->Serving)
+			return;
+
+		Backoff = Min(Backoff * 2, (u32)TICKET_MUTEX_MAX_BACKOFF);
+	}
+
+	// NOTE(ivan): Atomic increment is a full barrier which pairs with the one in LeaveTicketMutex(): either
+	// the leaving thread sees us sleeping and wakes us up, or we see the new serving value and do not sleep.
+	// The slot is read before the serving value, and the OS only puts us to sleep if the slot has not been
+	// bumped since, so a wake-up cannot be missed between the check and the sleep.
+	volatile u32 *Slot = &Mutex->Slots[Ticket % TICKET_MUTEX_NUM_SLOTS];
+	AtomicIncrementU32(&Mutex->NumSleeping);
+	for (;;) {
+		u32 SlotValue = *Slot;
+		CompleteReadsBeforeFutureReads();
+		if (Ticket == Mutex->Serving)
+			break;
+
+		SleepOnAddress(Slot, SlotValue);
+	}
+	AtomicDecrementU32(&Mutex->NumSleeping);
+}
+
 // NOTE(ivan): Ticket-mutex locking/unlocking.
 inline void
 EnterTicketMutex(ticket_mutex *Mutex) {
 	Assert(Mutex);
-	AtomicIncrementU64(&Mutex->Ticket);
-	
-	u64 Ticket = Mutex->Ticket - 1;
-	while (Ticket != Mutex->Serving)
-		YieldProcessor();
+
+#if MUTEX_PROFILING
+	// NOTE(ivan): Mutexes that are not profiled do not pay for the timestamps.
+	mutex_profile *Profile = Mutex->Profile;
+	u64 WaitStartClock = (Profile ? __rdtsc() : 0);
+#endif
+
+	// NOTE(ivan): The ticket must be the incremented value itself, another thread might take the next ticket
+	// before the counter is read again.
+	u64 Ticket = AtomicIncrementU64(&Mutex->Ticket) - 1;
+	b32 IsContended = (Ticket != Mutex->Serving);
+	if (IsContended)
+		WaitForTicket(Mutex, Ticket);
+
+#if MUTEX_PROFILING
+	if (Profile) {
+		u64 EnterClock = __rdtsc();
+		Profile->NumEnters++;
+		if (IsContended) {
+			u64 WaitClocks = EnterClock - WaitStartClock;
+			Profile->NumContendedEnters++;
+			Profile->WaitClocks += WaitClocks;
+			Profile->MaxWaitClocks = Max(Profile->MaxWaitClocks, WaitClocks);
+		}
+		Profile->EnterClock = EnterClock;
+	}
+#endif
 }
 inline void
 LeaveTicketMutex(ticket_mutex *Mutex) {
 	Assert(Mutex);
-	AtomicIncrementU64(&Mutex->Serving);
+
+#if MUTEX_PROFILING
+	mutex_profile *Profile = Mutex->Profile;
+	if (Profile) {
+		u64 HoldClocks = __rdtsc() - Profile->EnterClock;
+		Profile->HoldClocks += HoldClocks;
+		Profile->MaxHoldClocks = Max(Profile->MaxHoldClocks, HoldClocks);
+	}
+#endif
+
+	u64 Serving = AtomicIncrementU64(&Mutex->Serving);
+
+	// NOTE(ivan): The thread with the next ticket cannot be woken up alone, the others sharing its slot
+	// go back to sleep.
+	if (Mutex->NumSleeping) {
+		volatile u32 *Slot = &Mutex->Slots[Serving % TICKET_MUTEX_NUM_SLOTS];
+		AtomicIncrementU32(Slot);
+		WakeAllOnAddress(Slot);
+	}
+}
+
+// NOTE(ivan): Cross-platform reader-writer mutex, for data that is read much more often than written.
+// NOTE(ivan): Any instance of this structure MUST be ZERO-initialized, same as ticket-mutex.
+// NOTE(ivan): Any count of readers can hold the mutex at once, a writer holds it alone. Writers go in the order
+// they came, and a waiting writer keeps new readers out, so writers are not starved by a stream of readers.
+// Waiting threads spin and then sleep the same way they do on ticket-mutex.
+#define RW_MUTEX_WRITER_BIT 0x80000000
+
+struct CacheAligned rw_mutex {
+	ticket_mutex WriterMutex; // NOTE(ivan): Orders the writers.
+	volatile u32 State; // NOTE(ivan): Count of readers inside, plus the writer bit once a writer is in or waiting.
+	volatile u32 NumSleeping;
+
+	u8 Padding[CACHE_LINE_SIZE - sizeof(u32) * 2];
+};
+
+// NOTE(ivan): Waits until the mutex state differs from a given one, spinning first and sleeping afterwards.
+inline void
+WaitForRWMutexState(rw_mutex *Mutex, u32 State) {
+	Assert(Mutex);
+
+	u32 Backoff = 1;
+	for (u32 Round = 0; Round < TICKET_MUTEX_SPIN_ROUNDS; Round++) {
+		for (u32 Pause = 0; Pause < Backoff; Pause++)
+			YieldProcessor();
+		if (Mutex->State != State)
+			return;
+
+		Backoff = Min(Backoff * 2, (u32)TICKET_MUTEX_MAX_BACKOFF);
+	}
+
+	// NOTE(ivan): Atomic increment pairs with the atomic state changes of the leaving threads, same as in
+	// EnterTicketMutex(). The OS does not put us to sleep if the state has changed meanwhile.
+	AtomicIncrementU32(&Mutex->NumSleeping);
+	SleepOnAddress(&Mutex->State, State);
+	AtomicDecrementU32(&Mutex->NumSleeping);
+}
+
+// NOTE(ivan): Reader-writer mutex locking/unlocking.
+inline void
+EnterRWMutexRead(rw_mutex *Mutex) {
+	Assert(Mutex);
+
+	for (;;) {
+		u32 State = Mutex->State;
+		if (State & RW_MUTEX_WRITER_BIT)
+			WaitForRWMutexState(Mutex, State);
+		else if (AtomicCompareExchangeU32(&Mutex->State, State + 1, State) == State)
+			break;
+	}
+}
+inline void
+LeaveRWMutexRead(rw_mutex *Mutex) {
+	Assert(Mutex);
+
+	// NOTE(ivan): The last reader out wakes up the writer waiting for the readers to leave.
+	if (AtomicDecrementU32(&Mutex->State) == RW_MUTEX_WRITER_BIT && Mutex->NumSleeping)
+		WakeAllOnAddress(&Mutex->State);
+}
+inline void
+EnterRWMutexWrite(rw_mutex *Mutex) {
+	Assert(Mutex);
+
+	// NOTE(ivan): New readers stay out once the bit is set, the ones inside only decrease the count.
+	EnterTicketMutex(&Mutex->WriterMutex);
+	u32 State = AtomicAddU32(&Mutex->State, RW_MUTEX_WRITER_BIT);
+	while (State != RW_MUTEX_WRITER_BIT) {
+		WaitForRWMutexState(Mutex, State);
+		State = Mutex->State;
+	}
+}
+inline void
+LeaveRWMutexWrite(rw_mutex *Mutex) {
+	Assert(Mutex);
+	Assert(Mutex->State == RW_MUTEX_WRITER_BIT);
+
+	AtomicExchangeU32(&Mutex->State, 0);
+	if (Mutex->NumSleeping)
+		WakeAllOnAddress(&Mutex->State);
+	LeaveTicketMutex(&Mutex->WriterMutex);
 }
 
 // NOTE(ivan): CPU information.
@@ -396,6 +751,7 @@ struct cpu_info {
 	u32 NumL3;
 
 	u32 NumNUMA;
+	b32 IsNUMASimulated; // NOTE(ivan): True if NumNUMA is overridden by "-numa" parameter.
 };
 
 // NOTE(ivan): File handle.
@@ -445,6 +801,66 @@ typedef PLATFORM_FSEEK(platform_fseek);
 #define PLATFORM_FFLUSH(Name) void Name(file_handle FileHandle)
 typedef PLATFORM_FFLUSH(platform_fflush);
 
+#define PLATFORM_COMMIT_MEMORY(Name) b32 Name(void *Base, uptr Size)
+typedef PLATFORM_COMMIT_MEMORY(platform_commit_memory);
+
+#define PLATFORM_DECOMMIT_MEMORY(Name) void Name(void *Base, uptr Size)
+typedef PLATFORM_DECOMMIT_MEMORY(platform_decommit_memory);
+
+#define PLATFORM_BIND_MEMORY_TO_NUMA_NODE(Name) b32 Name(void *Base, uptr Size, u32 Node)
+typedef PLATFORM_BIND_MEMORY_TO_NUMA_NODE(platform_bind_memory_to_numa_node);
+
+#define PLATFORM_GET_CURRENT_NUMA_NODE(Name) u32 Name(void)
+typedef PLATFORM_GET_CURRENT_NUMA_NODE(platform_get_current_numa_node);
+
+// NOTE(ivan): Procedure run by RunThreads(), ThreadIndex goes from 0 to NumThreads - 1.
+#define PLATFORM_THREAD_PROC(Name) void Name(void *Param, u32 ThreadIndex)
+typedef PLATFORM_THREAD_PROC(platform_thread_proc);
+
+#define PLATFORM_RUN_THREADS(Name) b32 Name(platform_thread_proc *Proc, void *Param, u32 NumThreads)
+typedef PLATFORM_RUN_THREADS(platform_run_threads);
+
+// NOTE(ivan): Maximum count of threads RunThreads() can run at once.
+#define MAX_PLATFORM_THREADS 64
+
+// NOTE(ivan): Job system's counter: count of the jobs that have been added with it and are not finished yet.
+// Must be zero-initialized, and must stay alive until WaitForJobCounter() has returned.
+struct platform_job_counter {
+	volatile u32 NumJobs;
+};
+
+// NOTE(ivan): Procedure run by the job system, WorkerIndex goes from 0 to NumJobWorkers - 1.
+#define PLATFORM_JOB_PROC(Name) void Name(void *Param, u32 WorkerIndex)
+typedef PLATFORM_JOB_PROC(platform_job_proc);
+
+struct platform_job {
+	platform_job_proc *Proc;
+	void *Param;
+};
+
+// NOTE(ivan): Job workers are stopped before the game is released, jobs added while releasing are only run
+// by the primary thread when it waits for their counter.
+#define PLATFORM_ADD_JOBS(Name) void Name(platform_job *Jobs, u32 NumJobs, platform_job_counter *Counter)
+typedef PLATFORM_ADD_JOBS(platform_add_jobs);
+
+#define PLATFORM_WAIT_FOR_JOB_COUNTER(Name) void Name(platform_job_counter *Counter)
+typedef PLATFORM_WAIT_FOR_JOB_COUNTER(platform_wait_for_job_counter);
+
+// NOTE(ivan): Maximum count of job workers, including the primary thread.
+#define MAX_PLATFORM_JOB_WORKERS MAX_PLATFORM_THREADS
+
+#if MUTEX_PROFILING
+// NOTE(ivan): Must not be called while the mutex is held. A mutex that has a profile already keeps it, renamed.
+#define PLATFORM_PROFILE_MUTEX(Name) void Name(ticket_mutex *Mutex, const char *MutexName)
+typedef PLATFORM_PROFILE_MUTEX(platform_profile_mutex);
+
+#define PLATFORM_GET_MUTEX_PROFILES(Name) mutex_profile *Name(u32 *NumProfiles)
+typedef PLATFORM_GET_MUTEX_PROFILES(platform_get_mutex_profiles);
+
+// NOTE(ivan): Maximum count of mutex profiles, mutexes past it are not profiled.
+#define MAX_PLATFORM_MUTEX_PROFILES 256
+#endif
+
 // NOTE(ivan): Platform-specific interface.
 struct platform_api {
 	// NOTE(ivan): Generic-purpose methods.
@@ -461,6 +877,44 @@ struct platform_api {
 	platform_fseek *FSeek;
 	platform_fflush *FFlush;
 
+	// NOTE(ivan): Virtual memory methods. Base and Size must be page-aligned.
+	// Decommitted pages are given back to the OS, and read as zeros after they are committed again.
+	platform_commit_memory *CommitMemory;
+	platform_decommit_memory *DecommitMemory;
+	uptr PageSize;     // NOTE(ivan): Page size of the primary storage, large page size if large pages are in use.
+	b32 IsLargePages;  // NOTE(ivan): True if the primary storage is backed by large pages (see "-hugepages" parameter).
+
+	// NOTE(ivan): NUMA methods. Nodes are numbered from 0 to CPUInfo.NumNUMA - 1.
+	// BindMemoryToNUMANode() takes a reserved range that is not committed yet, the range's pages are placed
+	// on the node's memory when they get committed. GetCurrentNUMANode() tells the node of the processor
+	// the calling thread runs on at the moment. With a simulated topology the logical processors are split
+	// evenly between the simulated nodes, which are all backed by the real ones.
+	platform_bind_memory_to_numa_node *BindMemoryToNUMANode;
+	platform_get_current_numa_node *GetCurrentNUMANode;
+
+	// NOTE(ivan): Threading methods. RunThreads() runs a given procedure on NumThreads new threads and waits
+	// for all of them to finish. Returns false if not all of the threads could be started, the ones that
+	// have been started are still waited for.
+	platform_run_threads *RunThreads;
+
+	// NOTE(ivan): Job system methods. There is one job worker per logical processor (see "-workers" parameter),
+	// the primary thread is worker 0 and the others run on their own threads for the whole program lifetime.
+	// AddJobs() schedules the jobs and returns immediately, the jobs may run in any order on any worker.
+	// Counter is optional, if given, it is increased by NumJobs and decreased as each job finishes.
+	// WaitForJobCounter() returns once the counter gets to zero, a worker waiting runs the pending jobs
+	// meanwhile, so jobs can add more jobs and wait for them without deadlocking the workers.
+	// With a single worker the jobs only ever run while the primary thread waits for a counter.
+	platform_add_jobs *AddJobs;
+	platform_wait_for_job_counter *WaitForJobCounter;
+	u32 NumJobWorkers;
+
+#if MUTEX_PROFILING
+	// NOTE(ivan): Mutex profiling methods. ProfileMutex() gives a mutex a named profile, the profiles are kept
+	// by the platform layer for the whole program lifetime, so mutexes of all the modules are in one list.
+	platform_profile_mutex *ProfileMutex;
+	platform_get_mutex_profiles *GetMutexProfiles;
+#endif
+
 	// NOTE(ivan): Quit flags (corresponding functions QuitGame() and RestartGame() are located in game.h header file).
 	b32 QuitRequested; // NOTE(ivan): Set to true to quit from primary loop at the end of current frame.
 	s32 QuitReturnCode;
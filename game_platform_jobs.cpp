@@ -0,0 +1,314 @@
+// NOTE(ivan): Job system, shared by the platform layers which include this file.
+// Each job worker owns a Chase-Lev deque: the owner pushes and pops its jobs at the bottom of the deque
+// without locking, and idle workers steal the oldest jobs from the top of the others' deques.
+// Worker 0 is the primary thread, it runs jobs only while it waits for a counter. Jobs added by threads that
+// are not workers go to the injection queue which is guarded by a mutex.
+//
+// The platform layer including this file must provide the OS-specific parts before the include:
+//     static void WakeJobWorkers(u32 NumWorkers) - wakes up to NumWorkers sleeping workers.
+//     static void SleepJobWorker(void)           - puts the calling worker to sleep until it is woken up.
+//     static void YieldThread(void)              - gives the rest of the calling thread's time slice away.
+// and run RunJobWorker() on its own thread for each of the workers 1 to NumWorkers - 1.
+
+// NOTE(ivan): Capacities, both must be powers of two. A worker which has its deque full runs the jobs it adds
+// right away, a thread which has the injection queue full waits for the workers to take some jobs out.
+#define JOB_DEQUE_SIZE 2048
+#define JOB_INJECTION_QUEUE_SIZE 1024
+
+// NOTE(ivan): Rounds of looking for a job an idle worker spins before going to sleep, or before giving
+// its time slice away while waiting for a counter.
+#define JOB_SPIN_COUNT 512
+
+struct job_entry {
+	platform_job_proc *Proc;
+	void *Param;
+	platform_job_counter *Counter;
+};
+
+// NOTE(ivan): Top and Bottom grow forever, the entries are indexed modulo deque size.
+// They are on separate cache lines since the thieves write the top while the owner writes the bottom.
+struct job_deque {
+	CacheAligned volatile u64 Top;
+	CacheAligned volatile u64 Bottom;
+	CacheAligned job_entry Entries[JOB_DEQUE_SIZE];
+};
+
+static struct {
+	u32 NumWorkers;
+	volatile b32 IsStopping;
+
+	CacheAligned volatile u32 NumSleepingWorkers;
+
+	// NOTE(ivan): Injection queue. NumInjectedJobs lets the workers skip taking the mutex when it is empty.
+	ticket_mutex InjectionMutex;
+	volatile u32 NumInjectedJobs;
+	u32 InjectionHead;
+	job_entry Injection[JOB_INJECTION_QUEUE_SIZE];
+
+	job_deque Deques[MAX_PLATFORM_JOB_WORKERS];
+} JobSystem;
+
+// NOTE(ivan): Calling thread's worker index plus one, zero if the thread is not a worker.
+static ThreadLocal u32 JobWorkerSlot;
+
+// NOTE(ivan): Calling thread's state of the generator picking the victims to steal from.
+static ThreadLocal u32 JobStealSeed;
+
+static b32
+PushJob(job_deque *Deque, job_entry *Job) {
+	Assert(Deque);
+	Assert(Job);
+
+	u64 Bottom = Deque->Bottom;
+	u64 Top = Deque->Top;
+	if (Bottom - Top >= JOB_DEQUE_SIZE)
+		return false;
+
+	Deque->Entries[Bottom & (JOB_DEQUE_SIZE - 1)] = *Job;
+
+	// NOTE(ivan): The entry must be visible before the thieves see the new bottom.
+	CompleteWritesBeforeFutureWrites();
+	Deque->Bottom = Bottom + 1;
+
+	return true;
+}
+
+static b32
+PopJob(job_deque *Deque, job_entry *Job) {
+	Assert(Deque);
+	Assert(Job);
+
+	// NOTE(ivan): Exchange is a full barrier: the new bottom must be visible to the thieves before the top is read,
+	// otherwise the owner and a thief might both take the last job.
+	u64 Bottom = Deque->Bottom - 1;
+	AtomicExchangeU64(&Deque->Bottom, Bottom);
+	u64 Top = Deque->Top;
+
+	if ((s64)(Bottom - Top) < 0) {
+		// NOTE(ivan): Deque is empty, restore the bottom.
+		Deque->Bottom = Top;
+		return false;
+	}
+
+	*Job = Deque->Entries[Bottom & (JOB_DEQUE_SIZE - 1)];
+	if (Bottom != Top)
+		return true;
+
+	// NOTE(ivan): The last job, race the thieves for it.
+	b32 Result = (AtomicCompareExchangeU64(&Deque->Top, Top + 1, Top) == Top);
+	Deque->Bottom = Top + 1;
+
+	return Result;
+}
+
+static b32
+StealJob(job_deque *Deque, job_entry *Job) {
+	Assert(Deque);
+	Assert(Job);
+
+	u64 Top = Deque->Top;
+	CompleteReadsBeforeFutureReads();
+	u64 Bottom = Deque->Bottom;
+	if ((s64)(Bottom - Top) <= 0)
+		return false;
+
+	// NOTE(ivan): The entry is copied before the top is claimed, once claimed the owner may overwrite it.
+	job_entry Entry = Deque->Entries[Top & (JOB_DEQUE_SIZE - 1)];
+	if (AtomicCompareExchangeU64(&Deque->Top, Top + 1, Top) != Top)
+		return false;
+
+	*Job = Entry;
+	return true;
+}
+
+static b32
+InjectJob(job_entry *Job) {
+	Assert(Job);
+
+	b32 Result = false;
+
+	EnterTicketMutex(&JobSystem.InjectionMutex);
+	if (JobSystem.NumInjectedJobs < JOB_INJECTION_QUEUE_SIZE) {
+		u32 Tail = (JobSystem.InjectionHead + JobSystem.NumInjectedJobs) & (JOB_INJECTION_QUEUE_SIZE - 1);
+		JobSystem.Injection[Tail] = *Job;
+		AtomicIncrementU32(&JobSystem.NumInjectedJobs);
+		Result = true;
+	}
+	LeaveTicketMutex(&JobSystem.InjectionMutex);
+
+	return Result;
+}
+
+static b32
+TakeInjectedJob(job_entry *Job) {
+	Assert(Job);
+
+	if (!JobSystem.NumInjectedJobs)
+		return false;
+
+	b32 Result = false;
+
+	EnterTicketMutex(&JobSystem.InjectionMutex);
+	if (JobSystem.NumInjectedJobs) {
+		*Job = JobSystem.Injection[JobSystem.InjectionHead];
+		JobSystem.InjectionHead = (JobSystem.InjectionHead + 1) & (JOB_INJECTION_QUEUE_SIZE - 1);
+		AtomicDecrementU32(&JobSystem.NumInjectedJobs);
+		Result = true;
+	}
+	LeaveTicketMutex(&JobSystem.InjectionMutex);
+
+	return Result;
+}
+
+// NOTE(ivan): Looks for a job in the worker's own deque first, then in the injection queue,
+// then in the other workers' deques starting from a random one.
+static b32
+FindJob(u32 WorkerIndex, job_entry *Job) {
+	Assert(WorkerIndex < JobSystem.NumWorkers);
+	Assert(Job);
+
+	if (PopJob(&JobSystem.Deques[WorkerIndex], Job))
+		return true;
+
+	if (TakeInjectedJob(Job))
+		return true;
+
+	u32 NumWorkers = JobSystem.NumWorkers;
+	if (NumWorkers > 1) {
+		// NOTE(ivan): Xorshift, the seed must not be zero.
+		u32 Seed = JobStealSeed ? JobStealSeed : (WorkerIndex + 1) * 0x9E3779B9;
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		JobStealSeed = Seed;
+
+		u32 Victim = Seed % NumWorkers;
+		for (u32 Index = 0; Index < NumWorkers; Index++) {
+			if (Victim != WorkerIndex && StealJob(&JobSystem.Deques[Victim], Job))
+				return true;
+
+			if (++Victim == NumWorkers)
+				Victim = 0;
+		}
+	}
+
+	return false;
+}
+
+static void
+RunJob(job_entry *Job, u32 WorkerIndex) {
+	Assert(Job);
+	Assert(Job->Proc);
+
+	Job->Proc(Job->Param, WorkerIndex);
+
+	// NOTE(ivan): Job's results must be visible before the waiting thread sees the counter drop.
+	if (Job->Counter) {
+		CompleteWritesBeforeFutureWrites();
+		AtomicDecrementU32(&Job->Counter->NumJobs);
+	}
+}
+
+static PLATFORM_ADD_JOBS(AddJobs) {
+	Assert(Jobs);
+	Assert(JobSystem.NumWorkers);
+
+	if (!NumJobs)
+		return;
+
+	if (Counter)
+		AtomicAddU32(&Counter->NumJobs, NumJobs);
+
+	u32 WorkerSlot = JobWorkerSlot;
+	for (u32 Index = 0; Index < NumJobs; Index++) {
+		Assert(Jobs[Index].Proc);
+
+		job_entry Entry = {Jobs[Index].Proc, Jobs[Index].Param, Counter};
+		if (WorkerSlot) {
+			// NOTE(ivan): Run the job right away if the deque is full, the caller would wait for it anyway.
+			if (!PushJob(&JobSystem.Deques[WorkerSlot - 1], &Entry))
+				RunJob(&Entry, WorkerSlot - 1);
+		} else {
+			while (!InjectJob(&Entry)) {
+				WakeJobWorkers(JobSystem.NumWorkers);
+				YieldThread();
+			}
+		}
+	}
+
+	// NOTE(ivan): Atomic read is a full barrier, which pairs with the one in RunJobWorker(): either the worker
+	// sees the new jobs before it sleeps, or we see the worker counted as sleeping and wake it up.
+	u32 NumSleeping = AtomicAddU32(&JobSystem.NumSleepingWorkers, 0);
+	if (NumSleeping)
+		WakeJobWorkers(Min(NumSleeping, NumJobs));
+}
+
+static PLATFORM_WAIT_FOR_JOB_COUNTER(WaitForJobCounter) {
+	Assert(Counter);
+
+	u32 WorkerSlot = JobWorkerSlot;
+	u32 NumIdleRounds = 0;
+	while (Counter->NumJobs) {
+		job_entry Job;
+		if (WorkerSlot && FindJob(WorkerSlot - 1, &Job)) {
+			RunJob(&Job, WorkerSlot - 1);
+			NumIdleRounds = 0;
+		} else if (++NumIdleRounds < JOB_SPIN_COUNT) {
+			YieldProcessor();
+		} else {
+			YieldThread();
+		}
+	}
+
+	// NOTE(ivan): Jobs' results must not be read before the counter is seen at zero.
+	CompleteReadsBeforeFutureReads();
+}
+
+// NOTE(ivan): Prepares the job system and makes the calling thread worker 0.
+static void
+InitJobSystem(u32 NumWorkers) {
+	Assert(NumWorkers && NumWorkers <= MAX_PLATFORM_JOB_WORKERS);
+
+	JobSystem.NumWorkers = NumWorkers;
+	JobSystem.IsStopping = false;
+	JobWorkerSlot = 1;
+}
+
+// NOTE(ivan): Worker thread's body, returns after StopJobSystem() has been called.
+static void
+RunJobWorker(u32 WorkerIndex) {
+	Assert(WorkerIndex && WorkerIndex < MAX_PLATFORM_JOB_WORKERS);
+
+	JobWorkerSlot = WorkerIndex + 1;
+
+	u32 NumIdleRounds = 0;
+	while (!JobSystem.IsStopping) {
+		job_entry Job;
+		if (FindJob(WorkerIndex, &Job)) {
+			RunJob(&Job, WorkerIndex);
+			NumIdleRounds = 0;
+		} else if (++NumIdleRounds < JOB_SPIN_COUNT) {
+			YieldProcessor();
+		} else {
+			// NOTE(ivan): Look once more after being counted as sleeping, see AddJobs().
+			AtomicIncrementU32(&JobSystem.NumSleepingWorkers);
+			b32 IsJobFound = FindJob(WorkerIndex, &Job);
+			if (!IsJobFound && !JobSystem.IsStopping)
+				SleepJobWorker();
+			AtomicDecrementU32(&JobSystem.NumSleepingWorkers);
+
+			if (IsJobFound)
+				RunJob(&Job, WorkerIndex);
+			NumIdleRounds = 0;
+		}
+	}
+}
+
+// NOTE(ivan): Tells the workers to quit, the platform layer waits for their threads afterwards.
+// Jobs which are still pending are dropped.
+static void
+StopJobSystem(void) {
+	JobSystem.IsStopping = true;
+	CompleteWritesBeforeFutureWrites();
+	WakeJobWorkers(JobSystem.NumWorkers);
+}
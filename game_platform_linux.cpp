@@ -0,0 +1,1114 @@
+// NOTE(ivan): POSIX includes.
+// NOTE(ivan): glibc's fcntl.h declares its own struct file_handle when _GNU_SOURCE is on (g++ always sets it),
+// rename it away so it does not collide with ours.
+#define file_handle linux_file_handle
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/syscall.h>
+#undef file_handle
+
+// NOTE(ivan): GCC cpuid intrinsics.
+#include <cpuid.h>
+
+#include "game.h"
+
+// NOTE(ivan): Linux platform layer.
+// NOTE(ivan): This one is headless: there is no window, no renderer and no input devices,
+// so it is only meant for running the game core on servers and build machines.
+
+// NOTE(ivan): Linux-specific game module structure.
+struct linux_game_module {
+	b32 IsValid; // NOTE(ivan): False if something went wrong and the game module is not loaded.
+	void *GameLibrary;
+
+	game_trigger *GameTrigger;
+};
+
+// NOTE(ivan): NUMA limits. Nodes past these are folded into the ones below,
+// processors past the limit are treated as being on node 0.
+#define MAX_LINUX_NUMA_NODES 64
+#define MAX_LINUX_CPUS 1024
+
+// NOTE(ivan): mbind() policy, the value is from linux/mempolicy.h which is not always installed.
+// Preferred policy falls back to other nodes when the node runs out of memory, instead of failing.
+#define LINUX_MPOL_PREFERRED 1
+
+// NOTE(ivan): Linux globals.
+static struct {
+	s32 ArgC;
+	char **ArgV;
+
+	// NOTE(ivan): NUMA topology. NUMANodeIds maps the real nodes to the OS node numbers, which might have gaps.
+	// CPUNodes maps the logical processors to the nodes reported in CPUInfo, real or simulated.
+	u32 NumRealNUMANodes;
+	b32 IsNUMASimulated;
+	u32 NUMANodeIds[MAX_LINUX_NUMA_NODES];
+	u8 CPUNodes[MAX_LINUX_CPUS];
+
+	// NOTE(ivan): Job workers' threads, worker 0 is the primary thread and has none.
+	sem_t JobSemaphore;
+	u32 NumJobThreads;
+	pthread_t JobThreads[MAX_PLATFORM_JOB_WORKERS];
+
+#if MUTEX_PROFILING
+	// NOTE(ivan): Mutex profiles, only appended. The mutex guarding them is not profiled itself.
+	ticket_mutex MutexProfilesMutex;
+	u32 NumMutexProfiles;
+	mutex_profile MutexProfiles[MAX_PLATFORM_MUTEX_PROFILES];
+#endif
+
+	// NOTE(ivan): Game module's entry, set while the module is loaded. Threads that might have run game code
+	// tell the game before they exit, see ExitGameThread().
+	game_trigger *GameTrigger;
+
+	// NOTE(ivan): Log writer's thread, and the log file if there is one (see "-logfile" parameter).
+	pthread_t LogThread;
+	b32 IsLogThread;
+	int LogFile;
+	b32 IsLogFile;
+
+	// NOTE(ivan): Set by the signal handler when the user asks the program to terminate.
+	volatile sig_atomic_t IsTerminating;
+} LinuxState;
+
+inline u64
+LinuxGetClock(void) {
+	struct timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+
+	return (u64)Time.tv_sec * 1000000000ULL + (u64)Time.tv_nsec;
+}
+
+inline f32
+LinuxGetSecondsElapsed(u64 Start, u64 End) {
+	return (f32)((f64)(End - Start) / 1000000000.0);
+}
+
+static void
+LinuxSignalHandler(int Signal) {
+	UnusedParam(Signal);
+	LinuxState.IsTerminating = true;
+}
+
+static PLATFORM_CHECK_PARAM(LinuxCheckParam) {
+	Assert(Param);
+
+	for (s32 Index = 0; Index < LinuxState.ArgC; Index++) {
+		if (strcmp(LinuxState.ArgV[Index], Param) == 0)
+			return Index;
+	}
+
+	return NOTFOUND;
+}
+
+static PLATFORM_CHECK_PARAM_VALUE(LinuxCheckParamValue) {
+	Assert(Param);
+
+	s32 Index = LinuxCheckParam(Param);
+	if (Index == NOTFOUND)
+		return 0;
+	if ((Index + 1) >= LinuxState.ArgC)
+		return 0;
+
+	return LinuxState.ArgV[Index + 1];
+}
+
+static void
+YieldThread(void) {
+	sched_yield();
+}
+
+// NOTE(ivan): Log's OS-specific parts, see game_platform_log.cpp.
+#define LOG_LINE_END "\n"
+
+static void
+LinuxWriteAll(int FileDesc, const char *Text, u32 Size) {
+	while (Size) {
+		ssize_t BytesWritten = write(FileDesc, Text, Size);
+		if (BytesWritten <= 0) {
+			if (BytesWritten < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		Text += BytesWritten;
+		Size -= (u32)BytesWritten;
+	}
+}
+
+static void
+WriteLogOutput(const char *Text, u32 Size) {
+	LinuxWriteAll(STDOUT_FILENO, Text, Size);
+	if (LinuxState.IsLogFile)
+		LinuxWriteAll(LinuxState.LogFile, Text, Size);
+}
+
+#include "game_platform_log.cpp"
+
+static void *
+LinuxLogThreadStart(void *Param) {
+	UnusedParam(Param);
+
+	RunLogWriter();
+	return 0;
+}
+
+// NOTE(ivan): Starts the log writer, the log stays synchronous if its thread cannot be started.
+static void
+LinuxStartLog(void) {
+	const char *ParamLogFile = LinuxCheckParamValue("-logfile");
+	if (ParamLogFile) {
+		LinuxState.LogFile = open(ParamLogFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		LinuxState.IsLogFile = (LinuxState.LogFile != -1);
+	}
+
+	StartLogWriter();
+	LinuxState.IsLogThread = (pthread_create(&LinuxState.LogThread, 0, LinuxLogThreadStart, 0) == 0);
+	if (!LinuxState.IsLogThread)
+		FlushLog();
+}
+
+static void
+LinuxStopLog(void) {
+	if (LinuxState.IsLogThread) {
+		StopLogWriter();
+		pthread_join(LinuxState.LogThread, 0);
+		LinuxState.IsLogThread = false;
+	}
+	FlushLog();
+
+	if (LinuxState.IsLogFile) {
+		close(LinuxState.LogFile);
+		LinuxState.IsLogFile = false;
+	}
+}
+
+static PLATFORM_OUTF(LinuxOutf) {
+	Assert(Format);
+
+	char Buffer[LOG_MAX_MESSAGE_SIZE] = {};
+	CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+
+	AddLogMessage(Buffer);
+}
+
+static PLATFORM_CRASHF(LinuxCrashf) {
+	Assert(Format);
+
+	static b32 AlreadyCrashed = false;
+	if (!AlreadyCrashed) {
+		AlreadyCrashed = true;
+
+		char Buffer[2048] = {};
+		CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+
+		// NOTE(ivan): Write out what has been logged so far, and the crash message right away.
+		FlushLog();
+		LinuxOutf("*** CRASH *** %s", Buffer);
+		fprintf(stderr, "%s: %s\n", GAMENAME, Buffer);
+	}
+
+	_exit(0);
+}
+
+// NOTE(ivan): On Linux file_handle is the file descriptor itself.
+static PLATFORM_FOPEN(LinuxFOpen) {
+	Assert(FileName);
+	Assert(AccessType);
+
+	int Flags = 0;
+	if ((AccessType & FileAccessType_OpenForReading) && (AccessType & FileAccessType_OpenForWriting))
+		Flags = O_RDWR | O_CREAT;
+	else if (AccessType & FileAccessType_OpenForReading)
+		Flags = O_RDONLY;
+	else if (AccessType & FileAccessType_OpenForWriting)
+		Flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	int FileDesc = open(FileName, Flags | O_CLOEXEC, 0644);
+	if (FileDesc == -1)
+		return NOTFOUND;
+
+	return (file_handle)FileDesc;
+}
+
+static PLATFORM_FCLOSE(LinuxFClose) {
+	Assert(FileHandle != NOTFOUND);
+	close(FileHandle);
+}
+
+static PLATFORM_FREAD(LinuxFRead) {
+	Assert(FileHandle != NOTFOUND);
+	Assert(Buffer);
+	Assert(Size);
+
+	u32 Result = 0;
+	while (Result < Size) {
+		ssize_t BytesRead = read(FileHandle, (u8 *)Buffer + Result, Size - Result);
+		if (BytesRead <= 0)
+			break;
+		Result += (u32)BytesRead;
+	}
+
+	return Result;
+}
+
+static PLATFORM_FWRITE(LinuxFWrite) {
+	Assert(FileHandle != NOTFOUND);
+	Assert(Buffer);
+	Assert(Size);
+
+	u32 Result = 0;
+	while (Result < Size) {
+		ssize_t BytesWritten = write(FileHandle, (u8 *)Buffer + Result, Size - Result);
+		if (BytesWritten <= 0)
+			break;
+		Result += (u32)BytesWritten;
+	}
+
+	return Result;
+}
+
+static PLATFORM_FSEEK(LinuxFSeek) {
+	Assert(FileHandle != NOTFOUND);
+	Assert(NewPos);
+
+	int Whence;
+	switch (SeekOrigin) {
+	default:
+	case FileSeekOrigin_Begin:   Whence = SEEK_SET; break;
+	case FileSeekOrigin_Current: Whence = SEEK_CUR; break;
+	case FileSeekOrigin_End:     Whence = SEEK_END; break;
+	};
+
+	off_t Result = lseek(FileHandle, (off_t)Size, Whence);
+	if (Result == (off_t)-1)
+		return false;
+
+	*NewPos = (uptr)Result;
+	return true;
+}
+
+static PLATFORM_FFLUSH(LinuxFFlush) {
+	Assert(FileHandle != NOTFOUND);
+	fsync(FileHandle);
+}
+
+static PLATFORM_COMMIT_MEMORY(LinuxCommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	return (mprotect(Base, Size, PROT_READ | PROT_WRITE) == 0);
+}
+
+static PLATFORM_DECOMMIT_MEMORY(LinuxDecommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	// NOTE(ivan): MADV_DONTNEED drops the physical pages right away, private anonymous
+	// mapping gives zero-filled pages on next touch. Older kernels refuse it for hugetlbfs pages,
+	// so clear them by hand, the pages still have to read as zeros after they are committed again.
+	if (madvise(Base, Size, MADV_DONTNEED) != 0)
+		memset(Base, 0, Size);
+	mprotect(Base, Size, PROT_NONE);
+}
+
+static PLATFORM_BIND_MEMORY_TO_NUMA_NODE(LinuxBindMemoryToNUMANode) {
+	Assert(Base);
+	Assert(Size);
+
+	// NOTE(ivan): Nothing to do on a single-node machine, unless the nodes are simulated,
+	// then the range still gets bound to exercise the same path a real NUMA machine takes.
+	if (LinuxState.NumRealNUMANodes <= 1 && !LinuxState.IsNUMASimulated)
+		return true;
+
+	u32 OSNode = LinuxState.NUMANodeIds[Node % LinuxState.NumRealNUMANodes];
+	unsigned long NodeMask = 1UL << OSNode;
+
+	// NOTE(ivan): The policy sticks to the range, so the pages land on the node on the first touch
+	// after each commit, including the ones recommitted after MADV_DONTNEED.
+	return (syscall(SYS_mbind, Base, Size, LINUX_MPOL_PREFERRED, &NodeMask, sizeof(NodeMask) * 8 + 1, 0) == 0);
+}
+
+static PLATFORM_GET_CURRENT_NUMA_NODE(LinuxGetCurrentNUMANode) {
+	s32 CPU = sched_getcpu();
+	if (CPU < 0 || CPU >= MAX_LINUX_CPUS)
+		return 0;
+
+	return LinuxState.CPUNodes[CPU];
+}
+
+// NOTE(ivan): RunThreads() thread's start parameters.
+struct linux_thread_start {
+	platform_thread_proc *Proc;
+	void *Param;
+	u32 ThreadIndex;
+};
+
+// NOTE(ivan): Lets the game release the calling thread's per-thread data.
+static void
+ExitGameThread(void) {
+	if (LinuxState.GameTrigger)
+		LinuxState.GameTrigger(GameTriggerType_ThreadExit, 0, 0, 0, 0, 0);
+}
+
+static void *
+LinuxThreadStart(void *Param) {
+	linux_thread_start *Start = (linux_thread_start *)Param;
+	Start->Proc(Start->Param, Start->ThreadIndex);
+	ExitGameThread();
+
+	return 0;
+}
+
+static PLATFORM_RUN_THREADS(LinuxRunThreads) {
+	Assert(Proc);
+	Assert(NumThreads && NumThreads <= MAX_PLATFORM_THREADS);
+
+	pthread_t Threads[MAX_PLATFORM_THREADS];
+	linux_thread_start Starts[MAX_PLATFORM_THREADS];
+
+	u32 NumStarted = 0;
+	for (; NumStarted < NumThreads; NumStarted++) {
+		Starts[NumStarted].Proc = Proc;
+		Starts[NumStarted].Param = Param;
+		Starts[NumStarted].ThreadIndex = NumStarted;
+		if (pthread_create(&Threads[NumStarted], 0, LinuxThreadStart, &Starts[NumStarted]) != 0)
+			break;
+	}
+
+	for (u32 Index = 0; Index < NumStarted; Index++)
+		pthread_join(Threads[Index], 0);
+
+	return (NumStarted == NumThreads);
+}
+
+#if MUTEX_PROFILING
+static PLATFORM_PROFILE_MUTEX(LinuxProfileMutex) {
+	Assert(Mutex);
+	Assert(MutexName);
+
+	EnterTicketMutex(&LinuxState.MutexProfilesMutex);
+
+	mutex_profile *Profile = Mutex->Profile;
+	if (!Profile && LinuxState.NumMutexProfiles < MAX_PLATFORM_MUTEX_PROFILES)
+		Profile = &LinuxState.MutexProfiles[LinuxState.NumMutexProfiles++];
+
+	if (Profile) {
+		memset(Profile->Name, 0, sizeof(Profile->Name));
+		strncpy(Profile->Name, MutexName, ArraySize(Profile->Name) - 1);
+		Mutex->Profile = Profile;
+	}
+
+	LeaveTicketMutex(&LinuxState.MutexProfilesMutex);
+}
+
+static PLATFORM_GET_MUTEX_PROFILES(LinuxGetMutexProfiles) {
+	Assert(NumProfiles);
+
+	*NumProfiles = LinuxState.NumMutexProfiles;
+	return LinuxState.MutexProfiles;
+}
+#endif
+
+// NOTE(ivan): Job system's OS-specific parts, see game_platform_jobs.cpp.
+static void
+WakeJobWorkers(u32 NumWorkers) {
+	for (u32 Index = 0; Index < NumWorkers; Index++)
+		sem_post(&LinuxState.JobSemaphore);
+}
+
+static void
+SleepJobWorker(void) {
+	while (sem_wait(&LinuxState.JobSemaphore) != 0 && errno == EINTR) {}
+}
+
+#include "game_platform_jobs.cpp"
+
+static void *
+LinuxJobThreadStart(void *Param) {
+	RunJobWorker((u32)(uptr)Param);
+	ExitGameThread();
+	return 0;
+}
+
+// NOTE(ivan): Starts one job worker per logical processor unless "-workers" parameter tells otherwise,
+// returns the count of the workers including the primary thread.
+static u32
+LinuxStartJobWorkers(u32 NumCoreThreads) {
+	u32 NumWorkers = NumCoreThreads;
+
+	const char *ParamWorkers = LinuxCheckParamValue("-workers");
+	if (ParamWorkers)
+		NumWorkers = (u32)atoi(ParamWorkers);
+	NumWorkers = Clamp(1u, (u32)MAX_PLATFORM_JOB_WORKERS, NumWorkers);
+
+	sem_init(&LinuxState.JobSemaphore, 0, 0);
+	InitJobSystem(NumWorkers);
+#if MUTEX_PROFILING
+	LinuxProfileMutex(&JobSystem.InjectionMutex, "job_injection");
+#endif
+
+	LinuxState.NumJobThreads = 0;
+	for (u32 WorkerIndex = 1; WorkerIndex < NumWorkers; WorkerIndex++) {
+		if (pthread_create(&LinuxState.JobThreads[LinuxState.NumJobThreads], 0,
+						   LinuxJobThreadStart, (void *)(uptr)WorkerIndex) != 0) {
+			LinuxOutf("Cannot start job worker %d!", WorkerIndex);
+			break;
+		}
+		LinuxState.NumJobThreads++;
+	}
+
+	// NOTE(ivan): Workers that could not be started must not be stolen from nor woken up.
+	JobSystem.NumWorkers = LinuxState.NumJobThreads + 1;
+	return JobSystem.NumWorkers;
+}
+
+static void
+LinuxStopJobWorkers(void) {
+	StopJobSystem();
+	for (u32 Index = 0; Index < LinuxState.NumJobThreads; Index++)
+		pthread_join(LinuxState.JobThreads[Index], 0);
+	LinuxState.NumJobThreads = 0;
+
+	sem_destroy(&LinuxState.JobSemaphore);
+}
+
+// NOTE(ivan): Reads first line of a small text file, returns false if the file cannot be read.
+static b32
+LinuxReadLine(const char *FileName, char *Buffer, u32 BufferSize) {
+	Assert(FileName);
+	Assert(Buffer);
+	Assert(BufferSize);
+
+	int FileDesc = open(FileName, O_RDONLY | O_CLOEXEC);
+	if (FileDesc == -1)
+		return false;
+
+	ssize_t BytesRead = read(FileDesc, Buffer, BufferSize - 1);
+	close(FileDesc);
+	if (BytesRead <= 0)
+		return false;
+
+	Buffer[BytesRead] = 0;
+	for (char *Ptr = Buffer; *Ptr; Ptr++) {
+		if (*Ptr == '\n') {
+			*Ptr = 0;
+			break;
+		}
+	}
+
+	return true;
+}
+
+// NOTE(ivan): Counts unique lines among a set of files, used to count cores and caches
+// which are shared between several logical processors.
+#define MAX_LINUX_UNIQUE_LINES 256
+struct linux_unique_lines {
+	u32 NumLines;
+	char Lines[MAX_LINUX_UNIQUE_LINES][64];
+};
+
+static void
+LinuxAddUniqueLine(linux_unique_lines *Unique, const char *Line) {
+	Assert(Unique);
+	Assert(Line);
+
+	for (u32 Index = 0; Index < Unique->NumLines; Index++) {
+		if (strcmp(Unique->Lines[Index], Line) == 0)
+			return;
+	}
+
+	if (Unique->NumLines < ArraySize(Unique->Lines)) {
+		strncpy(Unique->Lines[Unique->NumLines], Line, ArraySize(Unique->Lines[0]) - 1);
+		Unique->NumLines++;
+	}
+}
+
+// NOTE(ivan): Marks the logical processors listed in a node's cpulist ("0-3,8,10-11") as belonging to a given node.
+static void
+LinuxReadNUMANodeCPUs(u32 OSNode, u32 Node) {
+	char Path[256], List[1024];
+	snprintf(Path, ArraySize(Path), "/sys/devices/system/node/node%u/cpulist", OSNode);
+	if (!LinuxReadLine(Path, List, ArraySize(List)))
+		return;
+
+	char *Ptr = List;
+	while (*Ptr >= '0' && *Ptr <= '9') {
+		s32 First = (s32)strtol(Ptr, &Ptr, 10);
+		s32 Last = First;
+		if (*Ptr == '-')
+			Last = (s32)strtol(Ptr + 1, &Ptr, 10);
+		for (s32 CPU = First; CPU <= Last && CPU < MAX_LINUX_CPUS; CPU++)
+			LinuxState.CPUNodes[CPU] = (u8)Node;
+
+		if (*Ptr == ',')
+			Ptr++;
+	}
+}
+
+// NOTE(ivan): Overrides the real NUMA topology with a given count of nodes, for testing NUMA-aware code
+// on single-node machines. Logical processors are split between the nodes in contiguous ranges.
+static void
+LinuxSimulateNUMA(cpu_info *CPUInfo, u32 NumNodes) {
+	Assert(CPUInfo);
+
+	NumNodes = Min(Max(NumNodes, 1u), (u32)MAX_LINUX_NUMA_NODES);
+	CPUInfo->NumNUMA = NumNodes;
+	CPUInfo->IsNUMASimulated = true;
+	LinuxState.IsNUMASimulated = true;
+
+	u32 NumCPUs = Min(CPUInfo->NumCoreThreads, (u32)MAX_LINUX_CPUS);
+	for (u32 CPU = 0; CPU < NumCPUs; CPU++)
+		LinuxState.CPUNodes[CPU] = (u8)((CPU * NumNodes) / NumCPUs);
+}
+
+static cpu_info
+LinuxGatherCPUInfo(void) {
+	cpu_info CPUInfo = {};
+	u32 CPUId[4] = {}, ExIds = 0;
+
+	const u32 EAX = 0;
+	const u32 EBX = 1;
+	const u32 ECX = 2;
+	const u32 EDX = 3;
+
+	// NOTE(ivan): Obtain vendor name.
+	__cpuid(0, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+
+	memcpy(CPUInfo.VendorName + 0, &CPUId[EBX], 4);
+	memcpy(CPUInfo.VendorName + 4, &CPUId[EDX], 4);
+	memcpy(CPUInfo.VendorName + 8, &CPUId[ECX], 4);
+
+	if (strcmp(CPUInfo.VendorName, "GenuineIntel") == 0)
+		CPUInfo.IsIntel = true;
+	else if (strcmp(CPUInfo.VendorName, "AuthenticAMD") == 0)
+		CPUInfo.IsAMD = true;
+
+	// NOTE(ivan): Obtain brand name.
+	__cpuid(0x80000000, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+	ExIds = CPUId[EAX];
+
+	if (ExIds >= 0x80000004) {
+		for (u32 Func = 0x80000002, Pos = 0; Func <= 0x80000004; Func++, Pos += 16) {
+			__cpuid(Func, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+			memcpy(CPUInfo.BrandName + Pos, CPUId, sizeof(CPUId));
+		}
+	} else {
+		strcpy(CPUInfo.BrandName, "Unknown");
+	}
+
+	// NOTE(ivan): Check features.
+	__cpuid(1, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+	CPUInfo.SupportsMMX = (CPUId[EDX] & (1 << 23)) ? true : false;
+	CPUInfo.SupportsSSE = (CPUId[EDX] & (1 << 25)) ? true : false;
+	CPUInfo.SupportsSSE2 = (CPUId[EDX] & (1 << 26)) ? true : false;
+	CPUInfo.SupportsSSE3 = (CPUId[ECX] & (1 << 0)) ? true : false;
+	CPUInfo.SupportsSSSE3 = (CPUId[ECX] & (1 << 9)) ? true : false;
+	CPUInfo.SupportsSSE4_1 = (CPUId[ECX] & (1 << 19)) ? true : false;
+	CPUInfo.SupportsSSE4_2 = (CPUId[ECX] & (1 << 20)) ? true : false;
+	CPUInfo.SupportsHT = (CPUId[EDX] & (1 << 28)) ? true : false;
+
+	// NOTE(ivan): Check extended features.
+	if (ExIds >= 0x80000001) {
+		__cpuid(0x80000001, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+
+		CPUInfo.SupportsMMXExt = CPUInfo.IsAMD && ((CPUId[EDX] & (1 << 22)) ? true : false);
+		CPUInfo.Supports3DNow = CPUInfo.IsAMD && ((CPUId[EDX] & (1u << 31)) ? true : false);
+		CPUInfo.Supports3DNowExt = CPUInfo.IsAMD && ((CPUId[EDX] & (1 << 30)) ? true : false);
+		CPUInfo.SupportsSSE4A = CPUInfo.IsAMD && ((CPUId[ECX] & (1 << 6)) ? true : false);
+	}
+
+	// NOTE(ivan): Calculate cores/threads/caches count from sysfs topology.
+	static linux_unique_lines Cores, Caches[3];
+	Cores.NumLines = 0;
+	for (u32 Level = 0; Level < ArraySize(Caches); Level++)
+		Caches[Level].NumLines = 0;
+
+	s32 NumProcessors = (s32)sysconf(_SC_NPROCESSORS_ONLN);
+	if (NumProcessors < 1)
+		NumProcessors = 1;
+	CPUInfo.NumCoreThreads = NumProcessors;
+
+	for (s32 CPUIndex = 0; CPUIndex < NumProcessors; CPUIndex++) {
+		char Path[256], Package[64], Core[64], Line[192];
+
+		snprintf(Path, ArraySize(Path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", CPUIndex);
+		if (!LinuxReadLine(Path, Package, ArraySize(Package)))
+			continue;
+		snprintf(Path, ArraySize(Path), "/sys/devices/system/cpu/cpu%d/topology/core_id", CPUIndex);
+		if (!LinuxReadLine(Path, Core, ArraySize(Core)))
+			continue;
+		snprintf(Line, ArraySize(Line), "%s:%s", Package, Core);
+		LinuxAddUniqueLine(&Cores, Line);
+
+		for (u32 CacheIndex = 0; CacheIndex < 8; CacheIndex++) {
+			char Level[16], Type[32], Shared[64];
+
+			snprintf(Path, ArraySize(Path), "/sys/devices/system/cpu/cpu%d/cache/index%u/level", CPUIndex, CacheIndex);
+			if (!LinuxReadLine(Path, Level, ArraySize(Level)))
+				break;
+			snprintf(Path, ArraySize(Path), "/sys/devices/system/cpu/cpu%d/cache/index%u/type", CPUIndex, CacheIndex);
+			if (!LinuxReadLine(Path, Type, ArraySize(Type)))
+				break;
+			snprintf(Path, ArraySize(Path), "/sys/devices/system/cpu/cpu%d/cache/index%u/shared_cpu_list",
+					 CPUIndex, CacheIndex);
+			if (!LinuxReadLine(Path, Shared, ArraySize(Shared)))
+				break;
+
+			s32 CacheLevel = atoi(Level);
+			if (CacheLevel >= 1 && CacheLevel <= 3) {
+				snprintf(Line, ArraySize(Line), "%s:%s", Type, Shared);
+				LinuxAddUniqueLine(&Caches[CacheLevel - 1], Line);
+			}
+		}
+	}
+
+	CPUInfo.NumCores = Cores.NumLines ? Cores.NumLines : CPUInfo.NumCoreThreads;
+	CPUInfo.NumL1 = Caches[0].NumLines;
+	CPUInfo.NumL2 = Caches[1].NumLines;
+	CPUInfo.NumL3 = Caches[2].NumLines;
+
+	DIR *NodesDir = opendir("/sys/devices/system/node");
+	if (NodesDir) {
+		struct dirent *Entry;
+		while ((Entry = readdir(NodesDir)) != 0) {
+			if (strncmp(Entry->d_name, "node", 4) == 0 && Entry->d_name[4] >= '0' && Entry->d_name[4] <= '9') {
+				u32 OSNode = (u32)atoi(Entry->d_name + 4);
+				if (OSNode < (sizeof(unsigned long) * 8) && CPUInfo.NumNUMA < MAX_LINUX_NUMA_NODES) {
+					LinuxState.NUMANodeIds[CPUInfo.NumNUMA] = OSNode;
+					LinuxReadNUMANodeCPUs(OSNode, CPUInfo.NumNUMA);
+					CPUInfo.NumNUMA++;
+				}
+			}
+		}
+		closedir(NodesDir);
+	}
+	if (!CPUInfo.NumNUMA) {
+		LinuxState.NUMANodeIds[0] = 0;
+		CPUInfo.NumNUMA = 1;
+	}
+	LinuxState.NumRealNUMANodes = CPUInfo.NumNUMA;
+
+	// NOTE(ivan): Calculate clock speed.
+	// NOTE(ivan): CPU serialization: call the processor to ensure that all other prior called functions are completed now.
+	__cpuid(0, CPUId[EAX], CPUId[EBX], CPUId[ECX], CPUId[EDX]);
+
+	u64 StartCycle, EndCycle;
+	u64 StartClock, EndClock;
+
+	StartCycle = LinuxGetClock();
+	StartClock = __rdtsc();
+
+	usleep(300 * 1000); // NOTE(ivan): Sleep time should be as short as possible.
+
+	EndCycle = LinuxGetClock();
+	EndClock = __rdtsc();
+
+	f32 SecondsElapsed = LinuxGetSecondsElapsed(StartCycle, EndCycle);
+	u64 ClocksElapsed = EndClock - StartClock;
+
+	CPUInfo.ClockSpeed = (f32)(((f64)ClocksElapsed / SecondsElapsed) / (f32)(1000 * 1000 * 1000));
+
+	// NOTE(ivan): Complete.
+	return CPUInfo;
+}
+
+static b32
+LinuxIsOnBattery(void) {
+	char Status[64];
+	if (LinuxReadLine("/sys/class/power_supply/BAT0/status", Status, ArraySize(Status)))
+		return (strcmp(Status, "Discharging") == 0);
+
+	return false;
+}
+
+inline linux_game_module
+LinuxLoadGameModule(const char *ExecutablePath, const char *SharedName) {
+	Assert(ExecutablePath);
+	Assert(SharedName);
+
+	linux_game_module Result = {};
+
+	char GameLibraryName[2048] = {};
+	snprintf(GameLibraryName, ArraySize(GameLibraryName) - 1, "%s%s.so", ExecutablePath, SharedName);
+
+	LinuxOutf("Loading game module %s...", GameLibraryName);
+	Result.GameLibrary = dlopen(GameLibraryName, RTLD_NOW | RTLD_LOCAL);
+	if (Result.GameLibrary) {
+		Result.GameTrigger = (game_trigger *)dlsym(Result.GameLibrary, "GameTrigger");
+		if (Result.GameTrigger)
+			Result.IsValid = true;
+	} else {
+		LinuxOutf("...fail, %s", dlerror());
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Primary storage is reserved, not committed, so the reserve size is just a hard cap
+// of how much the game can ever commit. The pages are committed by the game on demand.
+static uptr
+LinuxCalculateStorageReserveSize(void) {
+	uptr Result = 0;
+
+	if (IsTargetCPU32Bit()) {
+		// NOTE(ivan): 32-bit address space is too fragmented to reserve gigabytes in one piece.
+		Result = Megabytes(1024);
+	} else if (IsTargetCPU64Bit()) {
+		// NOTE(ivan): Address space is plentiful, cap the storage by the amount of physical RAM.
+		s64 NumPhysPages = sysconf(_SC_PHYS_PAGES);
+		s64 PhysPageSize = sysconf(_SC_PAGESIZE);
+		if (NumPhysPages > 0 && PhysPageSize > 0)
+			Result = (uptr)NumPhysPages * (uptr)PhysPageSize;
+		else
+			Result = Gigabytes(4);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Returns a numeric value of a given /proc/meminfo field, or 0 if there is no such field.
+static uptr
+LinuxGetMemInfoValue(const char *Field) {
+	Assert(Field);
+
+	uptr Result = 0;
+
+	int FileDesc = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+	if (FileDesc != -1) {
+		char Buffer[8192];
+		ssize_t BytesRead = read(FileDesc, Buffer, sizeof(Buffer) - 1);
+		close(FileDesc);
+
+		if (BytesRead > 0) {
+			Buffer[BytesRead] = 0;
+
+			uptr FieldLength = strlen(Field);
+			for (char *Line = Buffer; Line && *Line; ) {
+				if (strncmp(Line, Field, FieldLength) == 0 && Line[FieldLength] == ':') {
+					Result = (uptr)strtoull(Line + FieldLength + 1, 0, 10);
+					break;
+				}
+
+				Line = strchr(Line, '\n');
+				if (Line)
+					Line++;
+			}
+		}
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Linux primary storage mapping.
+struct linux_storage {
+	u8 *MappingBase; // NOTE(ivan): What mmap() returned, the storage itself might start a bit further.
+	uptr MappingSize;
+
+	u8 *Base;
+	uptr Size;
+};
+
+// NOTE(ivan): Reserves primary storage, tries to back it with huge pages if requested:
+// preallocated hugetlbfs pages first, then transparent huge pages, then falls back to regular pages.
+static linux_storage
+LinuxReserveStorage(platform_api *API, b32 WantsHugePages) {
+	Assert(API);
+
+	linux_storage Result = {};
+	uptr ReserveSize = LinuxCalculateStorageReserveSize();
+
+	if (WantsHugePages) {
+		// NOTE(ivan): Hugetlbfs pages are reserved by the kernel at mmap() time, so only the free part
+		// of the system's huge pages pool, in whole huge pages, is mapped with them. The storage is reserved
+		// with regular pages first and the huge pages are mapped over its beginning, the rest of the storage
+		// stays backed by regular pages.
+		uptr HugePageSize = LinuxGetMemInfoValue("Hugepagesize") * 1024;
+		uptr HugePagesFreeSize = LinuxGetMemInfoValue("HugePages_Free") * HugePageSize;
+		uptr HugeSize = HugePageSize ? (Min(ReserveSize, HugePagesFreeSize) & ~(HugePageSize - 1)) : 0;
+		if (HugeSize) {
+			void *Mapping = mmap(0, ReserveSize + HugePageSize, PROT_NONE,
+								 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (Mapping != MAP_FAILED) {
+				u8 *Base = (u8 *)AlignPow2((uptr)Mapping, HugePageSize);
+				if (mmap(Base, HugeSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED, -1, 0) != MAP_FAILED) {
+					Result.MappingBase = (u8 *)Mapping;
+					Result.MappingSize = ReserveSize + HugePageSize;
+					Result.Base = Base;
+					Result.Size = ReserveSize;
+
+					API->PageSize = HugePageSize;
+					API->IsLargePages = true;
+					if (HugeSize < ReserveSize)
+						LinuxOutf("Primary storage is backed by hugetlbfs pages, %llu of %llu Mb, the rest by regular pages.",
+								  (u64)(HugeSize >> 20), (u64)(ReserveSize >> 20));
+					else
+						LinuxOutf("Primary storage is backed by hugetlbfs pages.");
+
+					return Result;
+				}
+
+				munmap(Mapping, ReserveSize + HugePageSize);
+			}
+		}
+
+		// NOTE(ivan): Transparent huge pages only need a huge-page-aligned madvise()'d range.
+		char THPMode[128] = {};
+		if (LinuxReadLine("/sys/kernel/mm/transparent_hugepage/enabled", THPMode, ArraySize(THPMode)) &&
+			!strstr(THPMode, "[never]")) {
+			char THPSize[64] = {};
+			uptr HugePageSize = Megabytes(2);
+			if (LinuxReadLine("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", THPSize, ArraySize(THPSize)))
+				HugePageSize = (uptr)strtoull(THPSize, 0, 10);
+
+			uptr Size = ReserveSize & ~(HugePageSize - 1);
+			void *Mapping = mmap(0, Size + HugePageSize, PROT_NONE,
+								 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (Mapping != MAP_FAILED) {
+				u8 *Base = (u8 *)AlignPow2((uptr)Mapping, HugePageSize);
+				if (madvise(Base, Size, MADV_HUGEPAGE) == 0) {
+					Result.MappingBase = (u8 *)Mapping;
+					Result.MappingSize = Size + HugePageSize;
+					Result.Base = Base;
+					Result.Size = Size;
+
+					API->PageSize = HugePageSize;
+					API->IsLargePages = true;
+					LinuxOutf("Primary storage is backed by transparent huge pages.");
+
+					return Result;
+				}
+
+				munmap(Mapping, Size + HugePageSize);
+			}
+		}
+
+		LinuxOutf("Huge pages are not available, falling back to regular pages.");
+	}
+
+	void *Mapping = mmap(0, ReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (Mapping != MAP_FAILED) {
+		Result.MappingBase = Result.Base = (u8 *)Mapping;
+		Result.MappingSize = Result.Size = ReserveSize;
+	}
+
+	return Result;
+}
+
+int
+main(int ArgC, char **ArgV) {
+	platform_api LinuxAPI = {};
+
+	game_memory GameMemory = {};
+	game_clocks GameClocks = {};
+	game_input GameInput = {};
+
+	LinuxState.ArgC = ArgC;
+	LinuxState.ArgV = ArgV;
+
+	LinuxAPI.CheckParam = LinuxCheckParam;
+	LinuxAPI.CheckParamValue = LinuxCheckParamValue;
+	LinuxAPI.Outf = LinuxOutf;
+	LinuxAPI.Crashf = LinuxCrashf;
+
+	LinuxAPI.FOpen = LinuxFOpen;
+	LinuxAPI.FClose = LinuxFClose;
+	LinuxAPI.FRead = LinuxFRead;
+	LinuxAPI.FWrite = LinuxFWrite;
+	LinuxAPI.FSeek = LinuxFSeek;
+	LinuxAPI.FFlush = LinuxFFlush;
+
+	LinuxAPI.CommitMemory = LinuxCommitMemory;
+	LinuxAPI.DecommitMemory = LinuxDecommitMemory;
+	LinuxAPI.BindMemoryToNUMANode = LinuxBindMemoryToNUMANode;
+	LinuxAPI.GetCurrentNUMANode = LinuxGetCurrentNUMANode;
+	LinuxAPI.RunThreads = LinuxRunThreads;
+	LinuxAPI.AddJobs = AddJobs;
+	LinuxAPI.WaitForJobCounter = WaitForJobCounter;
+#if MUTEX_PROFILING
+	LinuxAPI.ProfileMutex = LinuxProfileMutex;
+	LinuxAPI.GetMutexProfiles = LinuxGetMutexProfiles;
+#endif
+
+	// NOTE(ivan): Quit gracefully on Ctrl+C or kill.
+	struct sigaction SignalAction = {};
+	SignalAction.sa_handler = LinuxSignalHandler;
+	sigemptyset(&SignalAction.sa_mask);
+	sigaction(SIGINT, &SignalAction, 0);
+	sigaction(SIGTERM, &SignalAction, 0);
+
+	// NOTE(ivan): Start writing the log asynchronously.
+	LinuxStartLog();
+
+	// NOTE(ivan): Obtain CPU information.
+	LinuxAPI.CPUInfo = LinuxGatherCPUInfo();
+
+	// NOTE(ivan): Simulate NUMA topology if requested.
+	const char *ParamNUMA = LinuxCheckParamValue("-numa");
+	if (ParamNUMA)
+		LinuxSimulateNUMA(&LinuxAPI.CPUInfo, (u32)atoi(ParamNUMA));
+
+	// NOTE(ivan): Obtain virtual memory page size.
+	LinuxAPI.PageSize = (uptr)sysconf(_SC_PAGESIZE);
+
+	// NOTE(ivan): Obtain executable's file name, base name and path.
+	char ExecPath[1024] = {}, ExecName[1024] = {}, ExecNameNoExt[1024] = {};
+	char ModuleName[2048] = {};
+	ssize_t ModuleNameLength = readlink("/proc/self/exe", ModuleName, ArraySize(ModuleName) - 1);
+	if (ModuleNameLength <= 0)
+		strncpy(ModuleName, ArgV[0], ArraySize(ModuleName) - 1);
+
+	char *PastLastSlash = ModuleName, *Ptr = ModuleName;
+	while (*Ptr) {
+		if (*Ptr == '/')
+			PastLastSlash = Ptr + 1;
+		Ptr++;
+	}
+	strcpy(ExecName, PastLastSlash);
+	strncpy(ExecPath, ModuleName, PastLastSlash - ModuleName);
+
+	strcpy(ExecNameNoExt, ExecName);
+	for (Ptr = ExecNameNoExt; *Ptr; Ptr++) {
+		if (*Ptr == '.') {
+			*Ptr = 0;
+			break;
+		}
+	}
+
+	LinuxAPI.ExecutableName = ExecName;
+	LinuxAPI.ExecutableNameNoExt = ExecNameNoExt;
+	LinuxAPI.ExecutablePath = ExecPath;
+
+	// NOTE(ivan): Obtain game "shared name".
+	char SharedName[1024] = {};
+	strncpy(SharedName, ExecNameNoExt + 3, ArraySize(SharedName) - 1); // NOTE(ivan): Remove "run" from the name.
+
+	LinuxAPI.SharedName = SharedName;
+
+	// NOTE(ivan): Check whether the program is already running.
+	// The lock is released by the OS once the descriptor is closed, including on exec when restarting.
+	char LockName[1024] = {};
+	snprintf(LockName, ArraySize(LockName) - 1, "/tmp/%s.lock", SharedName);
+	int LockFile = open(LockName, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (LockFile != -1 && flock(LockFile, LOCK_EX | LOCK_NB) == 0) {
+		// NOTE(ivan): Set current working directory if necessary.
+		const char *ParamCwd = LinuxCheckParamValue("-cwd");
+		if (ParamCwd) {
+			if (chdir(ParamCwd) != 0)
+				LinuxOutf("Cannot change working directory to %s!", ParamCwd);
+		}
+
+		// NOTE(ivan): Headless frames limit, run forever if not set.
+		const char *ParamFrames = LinuxCheckParamValue("-frames");
+		s32 MaxFrames = ParamFrames ? atoi(ParamFrames) : 0;
+
+		// NOTE(ivan): Reserve game primary storage.
+		linux_storage Storage = LinuxReserveStorage(&LinuxAPI, LinuxCheckParam("-hugepages") != NOTFOUND);
+		if (Storage.Base) {
+			GameMemory.FreeStorage.Base = Storage.Base;
+			GameMemory.FreeStorage.Size = Storage.Size;
+			GameMemory.StorageTotalSize = Storage.Size;
+
+			// NOTE(ivan): Target seconds to last per one frame.
+			f32 GameTargetFramerate = (1.0f / 60);
+
+			// NOTE(ivan): Connect to game module.
+			linux_game_module GameModule = LinuxLoadGameModule(LinuxAPI.ExecutablePath, LinuxAPI.SharedName);
+			if (GameModule.IsValid) {
+				LinuxState.GameTrigger = GameModule.GameTrigger;
+
+				// NOTE(ivan): Start job workers, they live until the game is released.
+				LinuxAPI.NumJobWorkers = LinuxStartJobWorkers(LinuxAPI.CPUInfo.NumCoreThreads);
+
+				// NOTE(ivan): Prepare the game, no renderer is available.
+				GameModule.GameTrigger(GameTriggerType_Prepare,
+									   &LinuxAPI,
+									   0,
+									   &GameMemory,
+									   &GameClocks,
+									   &GameInput);
+
+				// NOTE(ivan): Prepare game clocks and timings.
+				u64 LastCPUClockCounter = __rdtsc();
+				u64 LastCycleCounter = LinuxGetClock();
+
+				// NOTE(ivan): Primary loop.
+				s32 NumFrames = 0;
+				b32 IsGameRunning = true;
+				while (IsGameRunning) {
+					// NOTE(ivan): Is running on battery?
+					LinuxAPI.IsOnBattery = LinuxIsOnBattery();
+
+					// NOTE(ivan): Update game frame.
+					GameModule.GameTrigger(GameTriggerType_Frame, 0, 0, 0, 0, 0);
+
+					// NOTE(ivan): Escape primary loop if quit has been requested.
+					IsGameRunning = !LinuxAPI.QuitRequested && !LinuxState.IsTerminating;
+					if (MaxFrames && ++NumFrames >= MaxFrames)
+						IsGameRunning = false;
+
+					// NOTE(ivan): Finalize timings and synchronize framerate.
+					f32 CycleSecondsElapsed = LinuxGetSecondsElapsed(LastCycleCounter, LinuxGetClock());
+					while (CycleSecondsElapsed < GameTargetFramerate) {
+						u32 SleepUS = (u32)((GameTargetFramerate - CycleSecondsElapsed) * 1000 * 1000);
+						if (SleepUS)
+							usleep(SleepUS);
+
+						CycleSecondsElapsed = LinuxGetSecondsElapsed(LastCycleCounter, LinuxGetClock());
+					}
+					GameClocks.SecondsPerFrame = CycleSecondsElapsed;
+
+					u64 EndCPUClockCounter = __rdtsc();
+					GameClocks.CPUClocksPerFrame = EndCPUClockCounter - LastCPUClockCounter;
+
+					u64 EndCycleCounter = LinuxGetClock();
+					GameClocks.FramesPerSecond = (f32)(1000000000.0 / (f64)(EndCycleCounter - LastCycleCounter));
+
+					LastCPUClockCounter = __rdtsc();
+					LastCycleCounter = EndCycleCounter;
+				}
+
+				// NOTE(ivan): Release game and its module. Job workers are stopped first, their exit
+				// runs game code that must not see the game released.
+				LinuxStopJobWorkers();
+				GameModule.GameTrigger(GameTriggerType_Release, 0, 0, 0, 0, 0);
+				LinuxState.GameTrigger = 0;
+				dlclose(GameModule.GameLibrary);
+			} else {
+				// NOTE(ivan): Game module cannot be loaded.
+				LinuxCrashf(GAMENAME " cannot load game shared object!");
+			}
+
+			munmap(Storage.MappingBase, Storage.MappingSize);
+		} else {
+			// NOTE(ivan): Game primary storage cannot be reserved.
+			LinuxCrashf(GAMENAME " primary storage cannnot be reserved!");
+		}
+
+		close(LockFile);
+	} else {
+		// NOTE(ivan): Game is already running.
+		LinuxCrashf(GAMENAME " instance is already running!");
+	}
+
+	// NOTE(ivan): Everything must be written out before restarting or quitting.
+	LinuxStopLog();
+
+	// NOTE(ivan): Replace the process image with a fresh one so the program restarts if requested.
+	if (LinuxAPI.QuitToRestart)
+		execv("/proc/self/exe", ArgV);
+
+	// NOTE(ivan): Goodbye world.
+	return LinuxAPI.QuitReturnCode;
+}
@@ -0,0 +1,282 @@
+// NOTE(ivan): Asynchronous log, shared by the platform layers which include this file.
+// Outf() formats the message on the calling thread and appends it to the calling thread's ring, the log writer
+// thread drains the rings and writes their messages out in large batches, so logging never waits for the console
+// or file I/O. Each thread sticks to one ring which it owns while appending, threads share rings only when
+// there are more of them than rings. Messages carry a sequence number, the writer puts the messages of
+// different rings back in order: it stops at the first gap in the numbers, a message that has been numbered
+// but is not in its ring yet, and goes on once the message's thread has finished appending it. Only FlushLog()
+// writes past a gap, a thread stuck in the middle of appending must not hold the final messages back.
+// A thread that finds its ring full gives the writer some time to drain it,
+// then drops the message, dropped messages are counted and the count is reported in the log.
+// Until the writer is started, and after it is stopped, messages are written synchronously.
+//
+// The platform layer including this file must provide the OS-specific parts before the include:
+//     LOG_LINE_END                              - string ending each message's line.
+//     static void WriteLogOutput(const char *Text, u32 Size) - writes a zero-terminated batch of lines out.
+//     static void YieldThread(void)             - gives the rest of the calling thread's time slice away.
+// and run RunLogWriter() on its own thread between StartLogWriter() and StopLogWriter(), then call FlushLog()
+// once the thread has finished.
+
+// NOTE(ivan): Log limits. Ring size must be a power of two.
+#define LOG_NUM_RINGS 64
+#define LOG_RING_SIZE Kilobytes(64)
+#define LOG_BATCH_SIZE Kilobytes(64)
+#define LOG_MAX_MESSAGE_SIZE 2048
+
+// NOTE(ivan): Times a thread yields waiting for the writer to make room in its ring before dropping a message.
+#define LOG_FULL_RING_YIELDS 64
+
+struct log_record_header {
+	u64 Sequence;
+	u32 Length;
+};
+
+// NOTE(ivan): Head and Tail grow forever, the data is indexed modulo ring size. The appending thread moves the tail,
+// the writer moves the head, they are on separate cache lines.
+struct log_ring {
+	CacheAligned volatile u32 IsAppending; // NOTE(ivan): Taken by the thread appending to the ring.
+	volatile u32 Tail;
+	CacheAligned volatile u32 Head;
+	u8 Data[LOG_RING_SIZE];
+};
+
+static struct {
+	volatile b32 IsAsync;
+	volatile b32 IsStopping;
+
+	CacheAligned volatile u64 NextSequence;
+	volatile u32 NumThreads; // NOTE(ivan): Threads that have been given a ring so far.
+	volatile u32 NumDroppedMessages;
+
+	// NOTE(ivan): Bumped to wake up the writer, which sleeps on it.
+	CacheAligned volatile u32 WakeSequence;
+	volatile u32 IsWriterSleeping;
+
+	// NOTE(ivan): Taken while draining the rings or writing synchronously, so batches are never interleaved.
+	ticket_mutex OutputMutex;
+	u64 NextWriteSequence; // NOTE(ivan): Sequence number of the message to be written next.
+	u32 NumReportedDrops;
+	u32 BatchSize;
+	char Batch[LOG_BATCH_SIZE];
+
+	log_ring Rings[LOG_NUM_RINGS];
+} LogState;
+
+// NOTE(ivan): Calling thread's ring index plus one, zero if the thread has not logged yet.
+static ThreadLocal u32 LogRingSlot;
+
+// NOTE(ivan): Ring copies, wrapping around the ring's end.
+static void
+CopyToLogRing(log_ring *Ring, u32 Position, const void *Source, u32 Size) {
+	u32 Offset = Position & (LOG_RING_SIZE - 1);
+	u32 FirstSize = Min(Size, (u32)LOG_RING_SIZE - Offset);
+	memcpy(Ring->Data + Offset, Source, FirstSize);
+	memcpy(Ring->Data, (u8 *)Source + FirstSize, Size - FirstSize);
+}
+
+static void
+CopyFromLogRing(log_ring *Ring, u32 Position, void *Dest, u32 Size) {
+	u32 Offset = Position & (LOG_RING_SIZE - 1);
+	u32 FirstSize = Min(Size, (u32)LOG_RING_SIZE - Offset);
+	memcpy(Dest, Ring->Data + Offset, FirstSize);
+	memcpy((u8 *)Dest + FirstSize, Ring->Data, Size - FirstSize);
+}
+
+// NOTE(ivan): Output mutex must be held.
+static void
+FlushLogBatch(void) {
+	if (LogState.BatchSize) {
+		LogState.Batch[LogState.BatchSize] = 0;
+		WriteLogOutput(LogState.Batch, LogState.BatchSize);
+		LogState.BatchSize = 0;
+	}
+}
+
+// NOTE(ivan): Output mutex must be held.
+static void
+AddLogBatchLine(const char *Text, u32 Length) {
+	Assert(Text);
+
+	u32 LineEndLength = sizeof(LOG_LINE_END) - 1;
+	if (LogState.BatchSize + Length + LineEndLength >= LOG_BATCH_SIZE)
+		FlushLogBatch();
+
+	memcpy(LogState.Batch + LogState.BatchSize, Text, Length);
+	memcpy(LogState.Batch + LogState.BatchSize + Length, LOG_LINE_END, LineEndLength);
+	LogState.BatchSize += Length + LineEndLength;
+}
+
+// NOTE(ivan): Writes out the messages in the rings up to the first gap in their sequence numbers,
+// or all of them if IsFinal is set. Returns false if there were none to write.
+static b32
+DrainLog(b32 IsFinal) {
+	b32 Result = false;
+
+	EnterTicketMutex(&LogState.OutputMutex);
+
+	u32 NumRings = Min(LogState.NumThreads, (u32)LOG_NUM_RINGS);
+	for (;;) {
+		// NOTE(ivan): Take the oldest message at the heads of the rings.
+		log_ring *OldestRing = 0;
+		log_record_header Oldest = {};
+		for (u32 Index = 0; Index < NumRings; Index++) {
+			log_ring *Ring = &LogState.Rings[Index];
+			if (Ring->Head == Ring->Tail)
+				continue;
+
+			CompleteReadsBeforeFutureReads();
+			log_record_header Header;
+			CopyFromLogRing(Ring, Ring->Head, &Header, sizeof(Header));
+			if (!OldestRing || Header.Sequence < Oldest.Sequence) {
+				OldestRing = Ring;
+				Oldest = Header;
+			}
+		}
+		if (!OldestRing)
+			break;
+		if (!IsFinal && Oldest.Sequence != LogState.NextWriteSequence)
+			break;
+
+		char Message[LOG_MAX_MESSAGE_SIZE];
+		CopyFromLogRing(OldestRing, OldestRing->Head + sizeof(Oldest), Message, Oldest.Length);
+		AddLogBatchLine(Message, Oldest.Length);
+
+		// NOTE(ivan): The message must be copied out before its room is given back.
+		CompleteWritesBeforeFutureWrites();
+		OldestRing->Head += sizeof(Oldest) + Oldest.Length;
+		LogState.NextWriteSequence = Oldest.Sequence + 1;
+		Result = true;
+	}
+
+	u32 NumDropped = LogState.NumDroppedMessages;
+	if (NumDropped != LogState.NumReportedDrops) {
+		char Message[128];
+		u32 Length = snprintf(Message, ArraySize(Message), "*** %u log messages dropped, %u in total ***",
+							  NumDropped - LogState.NumReportedDrops, NumDropped);
+		AddLogBatchLine(Message, Length);
+		LogState.NumReportedDrops = NumDropped;
+	}
+
+	FlushLogBatch();
+	LeaveTicketMutex(&LogState.OutputMutex);
+
+	return Result;
+}
+
+static void
+WakeLogWriter(void) {
+	AtomicIncrementU32(&LogState.WakeSequence);
+	WakeAllOnAddress(&LogState.WakeSequence);
+}
+
+// NOTE(ivan): Appends a message to the calling thread's ring, returns false if the ring has no room for it.
+static b32
+AppendLogMessage(log_ring *Ring, const char *Text, u32 Length) {
+	Assert(Ring);
+	Assert(Text);
+
+	b32 Result = false;
+
+	// NOTE(ivan): Only contended if the ring is shared and the other thread is appending right now.
+	while (AtomicExchangeU32(&Ring->IsAppending, 1))
+		YieldProcessor();
+
+	u32 Tail = Ring->Tail;
+	u32 Size = sizeof(log_record_header) + Length;
+	if (LOG_RING_SIZE - (Tail - Ring->Head) >= Size) {
+		log_record_header Header = {};
+		Header.Sequence = AtomicIncrementU64(&LogState.NextSequence);
+		Header.Length = Length;
+		CopyToLogRing(Ring, Tail, &Header, sizeof(Header));
+		CopyToLogRing(Ring, Tail + sizeof(Header), Text, Length);
+
+		// NOTE(ivan): The message must be visible before the writer sees the new tail.
+		CompleteWritesBeforeFutureWrites();
+		Ring->Tail = Tail + Size;
+		Result = true;
+	}
+
+	AtomicExchangeU32(&Ring->IsAppending, 0);
+	return Result;
+}
+
+static void
+AddLogMessage(const char *Text) {
+	Assert(Text);
+
+	u32 Length = (u32)Min(strlen(Text), (size_t)(LOG_MAX_MESSAGE_SIZE - 1));
+
+	if (!LogState.IsAsync) {
+		EnterTicketMutex(&LogState.OutputMutex);
+		AddLogBatchLine(Text, Length);
+		FlushLogBatch();
+		LeaveTicketMutex(&LogState.OutputMutex);
+		return;
+	}
+
+	if (!LogRingSlot)
+		LogRingSlot = (AtomicIncrementU32(&LogState.NumThreads) - 1) % LOG_NUM_RINGS + 1;
+	log_ring *Ring = &LogState.Rings[LogRingSlot - 1];
+
+	b32 IsAppended = AppendLogMessage(Ring, Text, Length);
+	for (u32 Yield = 0; !IsAppended && Yield < LOG_FULL_RING_YIELDS && LogState.IsAsync; Yield++) {
+		WakeLogWriter();
+		YieldThread();
+		IsAppended = AppendLogMessage(Ring, Text, Length);
+	}
+
+	if (!IsAppended) {
+		AtomicIncrementU32(&LogState.NumDroppedMessages);
+		return;
+	}
+
+	// NOTE(ivan): Atomic read is a full barrier, which pairs with the one in RunLogWriter(): either the writer
+	// sees the new tail before it sleeps, or we see it sleeping and wake it up. The writer might be waiting
+	// for this very message to fill a gap.
+	if (AtomicAddU32(&LogState.IsWriterSleeping, 0))
+		WakeLogWriter();
+}
+
+// NOTE(ivan): Switches the log to synchronous writing and writes out all the pending messages on the calling thread.
+// Crashf() calls it, so the messages logged before the crash are not lost.
+static void
+FlushLog(void) {
+	LogState.IsAsync = false;
+	CompleteWritesBeforeFutureWrites();
+	DrainLog(true);
+}
+
+// NOTE(ivan): Called before the writer thread is started, messages are queued from now on.
+static void
+StartLogWriter(void) {
+	LogState.NextWriteSequence = LogState.NextSequence + 1;
+	LogState.IsStopping = false;
+	LogState.IsAsync = true;
+}
+
+// NOTE(ivan): Writer thread's body, returns once StopLogWriter() has been called and everything is written out.
+static void
+RunLogWriter(void) {
+	while (!LogState.IsStopping) {
+		if (DrainLog(false))
+			continue;
+
+		// NOTE(ivan): Look once more after being marked as sleeping, see AddLogMessage().
+		// The OS does not put us to sleep if the wake sequence has been bumped since it was read.
+		u32 WakeSequence = LogState.WakeSequence;
+		AtomicExchangeU32(&LogState.IsWriterSleeping, 1);
+		if (!DrainLog(false) && !LogState.IsStopping)
+			SleepOnAddress(&LogState.WakeSequence, WakeSequence);
+		AtomicExchangeU32(&LogState.IsWriterSleeping, 0);
+	}
+
+	DrainLog(false);
+}
+
+// NOTE(ivan): Tells the writer to finish, the platform layer waits for the writer thread afterwards.
+static void
+StopLogWriter(void) {
+	LogState.IsStopping = true;
+	CompleteWritesBeforeFutureWrites();
+	WakeLogWriter();
+}
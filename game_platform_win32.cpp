@@ -58,6 +58,20 @@ struct win32_file {
 	HANDLE OSHandle;
 };
 
+// NOTE(ivan): NUMA limits. Only the first processor group is mapped to the nodes,
+// processors of other groups are treated as being on node 0.
+#define MAX_WIN32_NUMA_NODES 64
+#define MAX_WIN32_CPUS 64
+#define MAX_WIN32_NUMA_RANGES 256
+
+// NOTE(ivan): Address range bound to a NUMA node. Windows places pages on a node
+// only when they are committed, so the ranges are looked up by Win32CommitMemory().
+struct win32_numa_range {
+	u8 *Base;
+	uptr Size;
+	UCHAR OSNode;
+};
+
 // NOTE(ivan): Win32 globals.
 static struct {
 	HINSTANCE Instance;
@@ -72,6 +86,7 @@ static struct {
 	b32 IsDebugCursor;
 	b32 IsDebuggerActive; // NOTE(ivan): Indicates whether the program is running under the debugger.
 	b32 IsWindowActive; // NOTE(ivan): Indicates whether the main window is active or not (focused/not focused).
+	b32 IsLargePages; // NOTE(ivan): Indicates whether the primary storage is allocated with large pages.
 
 	// NOTE(ivan): Standard text stream.
 	HANDLE Stdout;
@@ -82,6 +97,38 @@ static struct {
 	// NOTE(ivan): Reserved file handles.
 	win32_file Files[MAX_WIN32_FILES_COUNT];
 	ticket_mutex FilesMutex;
+
+	// NOTE(ivan): NUMA topology. NUMANodeIds maps the real nodes to the OS node numbers,
+	// CPUNodes maps the logical processors to the nodes reported in CPUInfo, real or simulated.
+	u32 NumRealNUMANodes;
+	b32 IsNUMASimulated;
+	UCHAR NUMANodeIds[MAX_WIN32_NUMA_NODES];
+	u8 CPUNodes[MAX_WIN32_CPUS];
+
+	// NOTE(ivan): Ranges are only appended, readers see a range once NumNUMARanges covers it.
+	win32_numa_range NUMARanges[MAX_WIN32_NUMA_RANGES];
+	volatile u32 NumNUMARanges;
+	ticket_mutex NUMARangesMutex;
+
+	// NOTE(ivan): Job workers' threads, worker 0 is the primary thread and has none.
+	HANDLE JobSemaphore;
+	u32 NumJobThreads;
+	HANDLE JobThreads[MAX_PLATFORM_JOB_WORKERS];
+
+#if MUTEX_PROFILING
+	// NOTE(ivan): Mutex profiles, only appended. The mutex guarding them is not profiled itself.
+	ticket_mutex MutexProfilesMutex;
+	u32 NumMutexProfiles;
+	mutex_profile MutexProfiles[MAX_PLATFORM_MUTEX_PROFILES];
+#endif
+
+	// NOTE(ivan): Game module's entry, set while the module is loaded. Threads that might have run game code
+	// tell the game before they exit, see ExitGameThread().
+	game_trigger *GameTrigger;
+
+	// NOTE(ivan): Log writer's thread, and the log file if there is one (see "-logfile" parameter).
+	HANDLE LogThread;
+	HANDLE LogFile;
 } Win32State;
 
 // NOTE(ivan): Win32-specific system structure for setting thread name by Win32SetThreadName.
@@ -145,27 +192,83 @@ static PLATFORM_CHECK_PARAM_VALUE(Win32CheckParamValue) {
 	return Win32State.ArgV[Index + 1];
 }
 
-static PLATFORM_OUTF(Win32Outf) {
-	Assert(Format);
-
-	char Buffer[2048] = {};
-	CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+static void
+YieldThread(void) {
+	SwitchToThread();
+}
 
-	char FinalString[2048] = {};
-	u32 FinalStringLength = snprintf(FinalString, ArraySize(FinalString) - 1, "%s\r\n", Buffer);
+// NOTE(ivan): Log's OS-specific parts, see game_platform_log.cpp.
+#define LOG_LINE_END "\r\n"
 
+static void
+WriteLogOutput(const char *Text, u32 Size) {
 	// NOTE(ivan): Output to debugger's output window if any.
-	if (Win32State.IsDebuggerActive) {
-		OutputDebugStringA("## ");
-		OutputDebugStringA(FinalString);
-		OutputDebugStringA("\r\n");
-	}
+	if (Win32State.IsDebuggerActive)
+		OutputDebugStringA(Text);
 
 	// NOTE(ivan): Output to system console if any.
 	if (Win32State.Stdout) {
 		DWORD Unused;
-		WriteFile(Win32State.Stdout, FinalString, FinalStringLength, &Unused, 0);
+		WriteFile(Win32State.Stdout, Text, Size, &Unused, 0);
+	}
+
+	// NOTE(ivan): Output to log file if any.
+	if (Win32State.LogFile) {
+		DWORD Unused;
+		WriteFile(Win32State.LogFile, Text, Size, &Unused, 0);
+	}
+}
+
+#include "game_platform_log.cpp"
+
+static DWORD WINAPI
+Win32LogThreadStart(LPVOID Param) {
+	UnusedParam(Param);
+
+	RunLogWriter();
+	return 0;
+}
+
+// NOTE(ivan): Starts the log writer, the log stays synchronous if its thread cannot be started.
+static void
+Win32StartLog(void) {
+	const char *ParamLogFile = Win32CheckParamValue("-logfile");
+	if (ParamLogFile) {
+		Win32State.LogFile = CreateFileA(ParamLogFile, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS,
+										 FILE_ATTRIBUTE_NORMAL, 0);
+		if (Win32State.LogFile == INVALID_HANDLE_VALUE)
+			Win32State.LogFile = 0;
 	}
+
+	StartLogWriter();
+	Win32State.LogThread = CreateThread(0, 0, Win32LogThreadStart, 0, 0, 0);
+	if (!Win32State.LogThread)
+		FlushLog();
+}
+
+static void
+Win32StopLog(void) {
+	if (Win32State.LogThread) {
+		StopLogWriter();
+		WaitForSingleObject(Win32State.LogThread, INFINITE);
+		CloseHandle(Win32State.LogThread);
+		Win32State.LogThread = 0;
+	}
+	FlushLog();
+
+	if (Win32State.LogFile) {
+		CloseHandle(Win32State.LogFile);
+		Win32State.LogFile = 0;
+	}
+}
+
+static PLATFORM_OUTF(Win32Outf) {
+	Assert(Format);
+
+	char Buffer[LOG_MAX_MESSAGE_SIZE] = {};
+	CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
+
+	AddLogMessage(Buffer);
 }
 
 static PLATFORM_CRASHF(Win32Crashf) {
@@ -178,6 +281,8 @@ static PLATFORM_CRASHF(Win32Crashf) {
 		char Buffer[2048] = {};
 		CollectArgsN(Buffer, ArraySize(Buffer) - 1, Format);
 
+		// NOTE(ivan): Write out what has been logged so far, and the crash message right away.
+		FlushLog();
 		Win32Outf("*** CRASH *** %s", Buffer);
 		MessageBoxA(0, Buffer, GAMENAME, MB_OK | MB_ICONERROR | MB_TOPMOST);
 	}
@@ -244,11 +349,11 @@ static PLATFORM_FOPEN(Win32FOpen) {
 	DWORD FileShareMode = 0;
 	DWORD FileCreation = 0;
 	DWORD FileAttribs = 0;
-	if (AccessType | FileAccessType_OpenForReading) {
+	if (AccessType & FileAccessType_OpenForReading) {
 		FileAccess |= GENERIC_READ;
 		FileShareMode |= FILE_SHARE_READ;
 		FileCreation |= OPEN_EXISTING;
-	} else if (AccessType | FileAccessType_OpenForWriting) {
+	} else if (AccessType & FileAccessType_OpenForWriting) {
 		FileAccess |= GENERIC_WRITE;
 		FileShareMode |= FILE_SHARE_READ;
 		FileCreation |= CREATE_ALWAYS;
@@ -304,8 +409,6 @@ static PLATFORM_FWRITE(Win32FWrite) {
 
 static PLATFORM_FSEEK(Win32FSeek) {
 	Assert(FileHandle);
-	Assert(Size);
-	Assert(SeekOrigin);
 	Assert(NewPos);
 
 	b32 Result = false;
@@ -343,6 +446,235 @@ static PLATFORM_FFLUSH(Win32FFlush) {
 	FlushFileBuffers(Win32GetFile(FileHandle)->OSHandle);
 }
 
+static PLATFORM_COMMIT_MEMORY(Win32CommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	// NOTE(ivan): Large pages are non-pageable and committed all at once at allocation.
+	if (Win32State.IsLargePages)
+		return true;
+
+	for (u32 Index = 0; Index < Win32State.NumNUMARanges; Index++) {
+		win32_numa_range *Range = &Win32State.NUMARanges[Index];
+		if ((u8 *)Base >= Range->Base && (u8 *)Base < (Range->Base + Range->Size))
+			return (VirtualAllocExNuma(GetCurrentProcess(), Base, Size, MEM_COMMIT, PAGE_READWRITE, Range->OSNode) != 0);
+	}
+
+	return (VirtualAlloc(Base, Size, MEM_COMMIT, PAGE_READWRITE) != 0);
+}
+
+static PLATFORM_DECOMMIT_MEMORY(Win32DecommitMemory) {
+	Assert(Base);
+	Assert(Size);
+
+	// NOTE(ivan): Large pages cannot be decommitted, but the pages still have to read as zeros.
+	if (Win32State.IsLargePages) {
+		memset(Base, 0, Size);
+		return;
+	}
+
+	VirtualFree(Base, Size, MEM_DECOMMIT);
+}
+
+static PLATFORM_BIND_MEMORY_TO_NUMA_NODE(Win32BindMemoryToNUMANode) {
+	Assert(Base);
+	Assert(Size);
+
+	// NOTE(ivan): Large pages are committed all at once at allocation, nowhere to place them.
+	// Single-node machine needs no binding either, unless the nodes are simulated.
+	if (Win32State.IsLargePages)
+		return false;
+	if (Win32State.NumRealNUMANodes <= 1 && !Win32State.IsNUMASimulated)
+		return true;
+
+	b32 Result = false;
+
+	EnterTicketMutex(&Win32State.NUMARangesMutex);
+
+	u32 Index = Win32State.NumNUMARanges;
+	if (Index < ArraySize(Win32State.NUMARanges)) {
+		win32_numa_range *Range = &Win32State.NUMARanges[Index];
+		Range->Base = (u8 *)Base;
+		Range->Size = Size;
+		Range->OSNode = Win32State.NUMANodeIds[Node % Win32State.NumRealNUMANodes];
+
+		CompleteWritesBeforeFutureWrites();
+		Win32State.NumNUMARanges = Index + 1;
+		Result = true;
+	}
+
+	LeaveTicketMutex(&Win32State.NUMARangesMutex);
+
+	return Result;
+}
+
+static PLATFORM_GET_CURRENT_NUMA_NODE(Win32GetCurrentNUMANode) {
+	DWORD CPU = GetCurrentProcessorNumber();
+	if (CPU >= MAX_WIN32_CPUS)
+		return 0;
+
+	return Win32State.CPUNodes[CPU];
+}
+
+// NOTE(ivan): RunThreads() thread's start parameters.
+struct win32_thread_start {
+	platform_thread_proc *Proc;
+	void *Param;
+	u32 ThreadIndex;
+};
+
+// NOTE(ivan): Lets the game release the calling thread's per-thread data.
+static void
+ExitGameThread(void) {
+	if (Win32State.GameTrigger)
+		Win32State.GameTrigger(GameTriggerType_ThreadExit, 0, 0, 0, 0, 0);
+}
+
+static DWORD WINAPI
+Win32ThreadStart(LPVOID Param) {
+	win32_thread_start *Start = (win32_thread_start *)Param;
+	Start->Proc(Start->Param, Start->ThreadIndex);
+	ExitGameThread();
+
+	return 0;
+}
+
+static PLATFORM_RUN_THREADS(Win32RunThreads) {
+	Assert(Proc);
+	Assert(NumThreads && NumThreads <= MAX_PLATFORM_THREADS);
+
+	HANDLE Threads[MAX_PLATFORM_THREADS];
+	win32_thread_start Starts[MAX_PLATFORM_THREADS];
+
+	u32 NumStarted = 0;
+	for (; NumStarted < NumThreads; NumStarted++) {
+		Starts[NumStarted].Proc = Proc;
+		Starts[NumStarted].Param = Param;
+		Starts[NumStarted].ThreadIndex = NumStarted;
+
+		Threads[NumStarted] = CreateThread(0, 0, Win32ThreadStart, &Starts[NumStarted], 0, 0);
+		if (!Threads[NumStarted])
+			break;
+	}
+
+	if (NumStarted) {
+		WaitForMultipleObjects(NumStarted, Threads, TRUE, INFINITE);
+		for (u32 Index = 0; Index < NumStarted; Index++)
+			CloseHandle(Threads[Index]);
+	}
+
+	return (NumStarted == NumThreads);
+}
+
+#if MUTEX_PROFILING
+static PLATFORM_PROFILE_MUTEX(Win32ProfileMutex) {
+	Assert(Mutex);
+	Assert(MutexName);
+
+	EnterTicketMutex(&Win32State.MutexProfilesMutex);
+
+	mutex_profile *Profile = Mutex->Profile;
+	if (!Profile && Win32State.NumMutexProfiles < MAX_PLATFORM_MUTEX_PROFILES)
+		Profile = &Win32State.MutexProfiles[Win32State.NumMutexProfiles++];
+
+	if (Profile) {
+		memset(Profile->Name, 0, sizeof(Profile->Name));
+		strncpy(Profile->Name, MutexName, ArraySize(Profile->Name) - 1);
+		Mutex->Profile = Profile;
+	}
+
+	LeaveTicketMutex(&Win32State.MutexProfilesMutex);
+}
+
+static PLATFORM_GET_MUTEX_PROFILES(Win32GetMutexProfiles) {
+	Assert(NumProfiles);
+
+	*NumProfiles = Win32State.NumMutexProfiles;
+	return Win32State.MutexProfiles;
+}
+#endif
+
+// NOTE(ivan): Job system's OS-specific parts, see game_platform_jobs.cpp.
+static void
+WakeJobWorkers(u32 NumWorkers) {
+	ReleaseSemaphore(Win32State.JobSemaphore, NumWorkers, 0);
+}
+
+static void
+SleepJobWorker(void) {
+	WaitForSingleObject(Win32State.JobSemaphore, INFINITE);
+}
+
+#include "game_platform_jobs.cpp"
+
+static DWORD WINAPI
+Win32JobThreadStart(LPVOID Param) {
+	RunJobWorker((u32)(uptr)Param);
+	ExitGameThread();
+	return 0;
+}
+
+// NOTE(ivan): Starts one job worker per logical processor unless "-workers" parameter tells otherwise,
+// returns the count of the workers including the primary thread.
+static u32
+Win32StartJobWorkers(u32 NumCoreThreads) {
+	u32 NumWorkers = NumCoreThreads;
+
+	const char *ParamWorkers = Win32CheckParamValue("-workers");
+	if (ParamWorkers)
+		NumWorkers = (u32)atoi(ParamWorkers);
+	NumWorkers = Clamp(1u, (u32)MAX_PLATFORM_JOB_WORKERS, NumWorkers);
+
+	Win32State.JobSemaphore = CreateSemaphoreA(0, 0, MAX_PLATFORM_JOB_WORKERS * JOB_INJECTION_QUEUE_SIZE, 0);
+	InitJobSystem(NumWorkers);
+#if MUTEX_PROFILING
+	Win32ProfileMutex(&JobSystem.InjectionMutex, "job_injection");
+#endif
+
+	Win32State.NumJobThreads = 0;
+	for (u32 WorkerIndex = 1; WorkerIndex < NumWorkers; WorkerIndex++) {
+		HANDLE Thread = CreateThread(0, 0, Win32JobThreadStart, (LPVOID)(uptr)WorkerIndex, 0, 0);
+		if (!Thread) {
+			Win32Outf("Cannot start job worker %d!", WorkerIndex);
+			break;
+		}
+		Win32State.JobThreads[Win32State.NumJobThreads++] = Thread;
+	}
+
+	// NOTE(ivan): Workers that could not be started must not be stolen from nor woken up.
+	JobSystem.NumWorkers = Win32State.NumJobThreads + 1;
+	return JobSystem.NumWorkers;
+}
+
+static void
+Win32StopJobWorkers(void) {
+	StopJobSystem();
+	if (Win32State.NumJobThreads) {
+		WaitForMultipleObjects(Win32State.NumJobThreads, Win32State.JobThreads, TRUE, INFINITE);
+		for (u32 Index = 0; Index < Win32State.NumJobThreads; Index++)
+			CloseHandle(Win32State.JobThreads[Index]);
+		Win32State.NumJobThreads = 0;
+	}
+
+	CloseHandle(Win32State.JobSemaphore);
+}
+
+// NOTE(ivan): Overrides the real NUMA topology with a given count of nodes, for testing NUMA-aware code
+// on single-node machines. Logical processors are split between the nodes in contiguous ranges.
+static void
+Win32SimulateNUMA(cpu_info *CPUInfo, u32 NumNodes) {
+	Assert(CPUInfo);
+
+	NumNodes = Min(Max(NumNodes, 1u), (u32)MAX_WIN32_NUMA_NODES);
+	CPUInfo->NumNUMA = NumNodes;
+	CPUInfo->IsNUMASimulated = true;
+	Win32State.IsNUMASimulated = true;
+
+	u32 NumCPUs = Min(CPUInfo->NumCoreThreads, (u32)MAX_WIN32_CPUS);
+	for (u32 CPU = 0; CPU < NumCPUs; CPU++)
+		Win32State.CPUNodes[CPU] = (u8)((CPU * NumNodes) / NumCPUs);
+}
+
 static cpu_info
 Win32GatherCPUInfo(void) {
 	cpu_info CPUInfo = {};
@@ -428,7 +760,14 @@ Win32GatherCPUInfo(void) {
 			} break;
 
 			case RelationNumaNode: {
-				CPUInfo.NumNUMA++;
+				if (CPUInfo.NumNUMA < MAX_WIN32_NUMA_NODES) {
+					Win32State.NUMANodeIds[CPUInfo.NumNUMA] = (UCHAR)LogicalPtr->NumaNode.NodeNumber;
+					for (u32 CPU = 0; CPU < MAX_WIN32_CPUS; CPU++) {
+						if (LogicalPtr->ProcessorMask & ((ULONG_PTR)1 << CPU))
+							Win32State.CPUNodes[CPU] = (u8)CPUInfo.NumNUMA;
+					}
+					CPUInfo.NumNUMA++;
+				}
 			} break;
 			}
 
@@ -439,6 +778,11 @@ Win32GatherCPUInfo(void) {
 		if (LogicalInfo)
 			VirtualFree(LogicalInfo, 0, MEM_RELEASE);
 	}
+	if (!CPUInfo.NumNUMA) {
+		Win32State.NUMANodeIds[0] = 0;
+		CPUInfo.NumNUMA = 1;
+	}
+	Win32State.NumRealNUMANodes = CPUInfo.NumNUMA;
 
 	// NOTE(ivan): Calculate clock speed.
 	HANDLE CurrentProcess = GetCurrentProcess();
@@ -863,40 +1207,71 @@ Win32LoadRendererModule(const char *SharedName, const char *APIName) {
 	return Result;
 }
 
+// NOTE(ivan): Primary storage is reserved, not committed, so the reserve size is just a hard cap
+// of how much the game can ever commit. The pages are committed by the game on demand.
 static uptr
-Win32CalculateDesirableUsableMemorySize(void) {
-	uptr Result;
-
-	// NOTE(ivan): Detect how much memory is available.
-	MEMORYSTATUSEX MemStat;
-	MemStat.dwLength = sizeof(MemStat);
-	if (GlobalMemoryStatusEx(&MemStat)) {
-		// NOTE(ivan): Capture 80% of free RAM space and leave the rest for internal platform-layer and OS needs.
-		// TODO(ivan): Play aroud with this percent to achieve maximum RAM space allocation
-		// without stressing the OS and the environment too much.
-		Result = (uptr)((f64)MemStat.ullAvailPhys * 0.8);
-	} else {
-		// NOTE(ivan): Available free RAM detection went wrong
-		// for some strange reason - try to guess it approximately.
-		if (IsTargetCPU32Bit()) {
-			BOOL Is64BitWindows = FALSE;
-			if (!IsWow64Process(GetCurrentProcess(), &Is64BitWindows))
-				Is64BitWindows = FALSE;
-
-			// NOTE(ivan): 64-bit Windows allows 32-bit programs to eat 3 gigabytes of RAM
-			// instead of 2 gigabytes as in 32-bit Windows.
-			if (Is64BitWindows)        // NOTE(ivan): Requesting 3Gb of memory for 32-bit program
-				Result = Gigabytes(3); // requires it being built with /largeaddressaware MS linker option.
-			else
-				Result = Gigabytes(2);
-		} else if (IsTargetCPU64Bit()) {
+Win32CalculateStorageReserveSize(void) {
+	uptr Result = 0;
+
+	if (IsTargetCPU32Bit()) {
+		// NOTE(ivan): 32-bit address space is too fragmented to reserve gigabytes in one piece,
+		// leave the rest for DLLs, thread stacks, and drivers.
+		Result = Megabytes(1024);
+	} else if (IsTargetCPU64Bit()) {
+		// NOTE(ivan): Address space is plentiful, cap the storage by the amount of physical RAM.
+		MEMORYSTATUSEX MemStat;
+		MemStat.dwLength = sizeof(MemStat);
+		if (GlobalMemoryStatusEx(&MemStat))
+			Result = (uptr)MemStat.ullTotalPhys;
+		else
 			Result = Gigabytes(4);
+	}
+
+	return Result;
+}
+
+// NOTE(ivan): Enables SeLockMemoryPrivilege required by MEM_LARGE_PAGES.
+// Returns large page size, or 0 if large pages are not available for the current user.
+static uptr
+Win32EnableLargePages(void) {
+	uptr Result = 0;
+
+	HANDLE Token;
+	if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &Token)) {
+		TOKEN_PRIVILEGES Privileges = {};
+		Privileges.PrivilegeCount = 1;
+		Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		if (LookupPrivilegeValueA(0, "SeLockMemoryPrivilege", &Privileges.Privileges[0].Luid)) {
+			// NOTE(ivan): AdjustTokenPrivileges() succeeds even if the privilege is not assigned to the user,
+			// GetLastError() has to be checked for ERROR_NOT_ALL_ASSIGNED.
+			if (AdjustTokenPrivileges(Token, FALSE, &Privileges, 0, 0, 0) && GetLastError() == ERROR_SUCCESS)
+				Result = GetLargePageMinimum();
 		}
+
+		CloseHandle(Token);
 	}
 
 	return Result;
 }
 
+// NOTE(ivan): Large pages are non-pageable and committed up front, so the storage cannot be
+// as big as the reserved one, take a half of currently available physical memory instead.
+static uptr
+Win32CalculateLargePagesStorageSize(uptr LargePageSize) {
+	Assert(LargePageSize);
+
+	uptr Result = 0;
+
+	MEMORYSTATUSEX MemStat;
+	MemStat.dwLength = sizeof(MemStat);
+	if (GlobalMemoryStatusEx(&MemStat))
+		Result = (uptr)(MemStat.ullAvailPhys / 2);
+	if (IsTargetCPU32Bit())
+		Result = Min(Result, (uptr)Megabytes(1024));
+
+	return Result & ~(LargePageSize - 1);
+}
+
 static LRESULT CALLBACK
 Win32WindowProc(HWND Window, UINT Msg, WPARAM W, LPARAM L) {
 	switch (Msg) {
@@ -1039,6 +1414,22 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 	Win32API.FSeek = Win32FSeek;
 	Win32API.FFlush = Win32FFlush;
 
+	Win32API.CommitMemory = Win32CommitMemory;
+	Win32API.DecommitMemory = Win32DecommitMemory;
+	Win32API.BindMemoryToNUMANode = Win32BindMemoryToNUMANode;
+	Win32API.GetCurrentNUMANode = Win32GetCurrentNUMANode;
+	Win32API.RunThreads = Win32RunThreads;
+	Win32API.AddJobs = AddJobs;
+	Win32API.WaitForJobCounter = WaitForJobCounter;
+#if MUTEX_PROFILING
+	Win32API.ProfileMutex = Win32ProfileMutex;
+	Win32API.GetMutexProfiles = Win32GetMutexProfiles;
+
+	// NOTE(ivan): Profile the platform's own mutexes.
+	Win32ProfileMutex(&Win32State.FilesMutex, "win32_files");
+	Win32ProfileMutex(&Win32State.NUMARangesMutex, "win32_numa_ranges");
+#endif
+
 	// NOTE(ivan): Various Win32-specific strings declaration.
 	const char GameWindowClassName[] = (GAMENAME "Window");
 	const char GameExistsMutexName[] = (GAMENAME "Exists");
@@ -1075,6 +1466,16 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 		// NOTE(ivan): Obtain CPU information.
 		Win32API.CPUInfo = Win32GatherCPUInfo();
 
+		// NOTE(ivan): Simulate NUMA topology if requested.
+		const char *ParamNUMA = Win32CheckParamValue("-numa");
+		if (ParamNUMA)
+			Win32SimulateNUMA(&Win32API.CPUInfo, (u32)atoi(ParamNUMA));
+
+		// NOTE(ivan): Obtain virtual memory page size.
+		SYSTEM_INFO SystemInfo;
+		GetSystemInfo(&SystemInfo);
+		Win32API.PageSize = SystemInfo.dwPageSize;
+
 		// NOTE(ivan): Obtain executable's file name, base name and path.
 		char ExecPath[1024] = {}, ExecName[1024] = {}, ExecNameNoExt[1024] = {};
 		char ModuleName[2048] = {};
@@ -1141,18 +1542,48 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 					WriteFile(Win32State.Stdout, "\r\n", 2, &Unused, 0);
 				}
 			}
+
+			// NOTE(ivan): Start writing the log asynchronously.
+			Win32StartLog();
 			
 			// NOTE(ivan): Set current working directory if necessary.
 			const char *ParamCwd = Win32CheckParamValue("-cwd");
 			if (ParamCwd)
 				SetCurrentDirectoryA(ParamCwd);
 
-			// NOTE(ivan): Create game primary storage.
-			GameMemory.FreeStorage.Size = Win32CalculateDesirableUsableMemorySize();
-			GameMemory.FreeStorage.Base = (u8 *)VirtualAlloc(0, GameMemory.FreeStorage.Size, MEM_COMMIT, PAGE_READWRITE);
+			// NOTE(ivan): Allocate game primary storage with large pages if requested.
+			if (Win32CheckParam("-hugepages") != NOTFOUND) {
+				uptr LargePageSize = Win32EnableLargePages();
+				if (LargePageSize) {
+					GameMemory.FreeStorage.Size = Win32CalculateLargePagesStorageSize(LargePageSize);
+					if (GameMemory.FreeStorage.Size)
+						GameMemory.FreeStorage.Base = (u8 *)VirtualAlloc(0, GameMemory.FreeStorage.Size,
+																		 MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+																		 PAGE_READWRITE);
+					if (GameMemory.FreeStorage.Base) {
+						Win32State.IsLargePages = true;
+						Win32API.IsLargePages = true;
+						Win32API.PageSize = LargePageSize;
+					} else {
+						Win32Outf("Large pages allocation failed, falling back to regular pages.");
+					}
+				} else {
+					Win32Outf("Large pages are not available (SeLockMemoryPrivilege is not held), falling back to regular pages.");
+				}
+			}
+
+			// NOTE(ivan): Reserve game primary storage.
+			if (!GameMemory.FreeStorage.Base) {
+				GameMemory.FreeStorage.Size = Win32CalculateStorageReserveSize();
+				GameMemory.FreeStorage.Base = (u8 *)VirtualAlloc(0, GameMemory.FreeStorage.Size,
+																 MEM_RESERVE, PAGE_NOACCESS);
+			}
 			if (GameMemory.FreeStorage.Base) {
 				GameMemory.StorageTotalSize = GameMemory.FreeStorage.Size;
 
+				// NOTE(ivan): The game eats the storage from its beginning, remember where it starts.
+				u8 *StorageBase = GameMemory.FreeStorage.Base;
+
 				// NOTE(ivan): Create main window.
 				WNDCLASSA WindowClass = {};
 				WindowClass.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
@@ -1203,6 +1634,11 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 						// NOTE(ivan): Connect to game module.
 						win32_game_module GameModule = Win32LoadGameModule(Win32API.SharedName);
 						if (GameModule.IsValid) {
+							Win32State.GameTrigger = GameModule.GameTrigger;
+
+							// NOTE(ivan): Start job workers, they live until the game is released.
+							Win32API.NumJobWorkers = Win32StartJobWorkers(Win32API.CPUInfo.NumCoreThreads);
+
 							// NOTE(ivan): Load appropriate renderer module.
 							win32_renderer_module RendererModule = Win32LoadRendererModule(Win32API.SharedName,
 																						   "dx11");
@@ -1445,8 +1881,11 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 								Win32Crashf(GAMENAME " cannot load renderer DLL!");
 							}
 
-							// NOTE(ivan): Release game and its module.
+							// NOTE(ivan): Release game and its module. Job workers are stopped first, their exit
+							// runs game code that must not see the game released.
+							Win32StopJobWorkers();
 							GameModule.GameTrigger(GameTriggerType_Release, 0, 0, 0, 0, 0);
+							Win32State.GameTrigger = 0;
 							FreeLibrary(GameModule.GameLibrary);
 						} else {
 							// NOTE(ivan): Game module cannot be loaded.
@@ -1471,12 +1910,15 @@ WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine, int ShowC
 					Win32Crashf(GAMENAME " window class cannot be registered!");
 				}
 
-				VirtualFree(GameMemory.FreeStorage.Base, 0, MEM_RELEASE);
+				VirtualFree(StorageBase, 0, MEM_RELEASE);
 			} else {
 				// NOTE(ivan): Game primary storage cannot be allocated.
-				Win32Crashf(GAMENAME " primary storage cannnot be allocated!");
+				Win32Crashf(GAMENAME " primary storage cannnot be reserved!");
 			}
 
+			// NOTE(ivan): Everything must be written out before quitting.
+			Win32StopLog();
+
 			// NOTE(ivan): No longer needs to be set.
 			ReleaseMutex(ExistsMutex);
 			CloseHandle(ExistsMutex);
@@ -13,7 +13,10 @@
 #define NTDDI_VERSION NTDDI_VERSION_FROM_WIN32_WINNT(_WIN32_WINNT)
 
 // NOTE(ivan): Win32 API strict mode enable.
-#define STRICT
+// NOTE(ivan): The base headers game_platform.h brings in with synchapi.h might have enabled it already.
+#ifndef STRICT
+#    define STRICT
+#endif
 
 // NOTE(ivan): Win32 API rarely-used routines exclusion.
 //